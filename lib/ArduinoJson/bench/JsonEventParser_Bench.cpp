@@ -0,0 +1,118 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+// Compares JsonEventParser with JsonBuffer::parseObject() when two fields are
+// needed from documents of 1 KB and 100 KB.
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// {"readings":[{"id":0,"name":"sensor 0","value":0.5,"ok":true},...],
+//  "count":N,"status":"done"}
+static std::string makeDocument(size_t size) {
+  std::string json = "{\"readings\":[";
+  int count = 0;
+  while (json.size() + 100 < size) {
+    char reading[80];
+    sprintf(reading, "%s{\"id\":%d,\"name\":\"sensor %d\",\"value\":%d.5,"
+                     "\"ok\":true}",
+            count ? "," : "", count, count, count);
+    json += reading;
+    count++;
+  }
+  char end[40];
+  sprintf(end, "],\"count\":%d,\"status\":\"done\"}", count);
+  return json + end;
+}
+
+// Picks "count" and "status" out of the events
+class FieldPicker {
+ public:
+  FieldPicker() : depth(0), count(0), status(NULL), _field(NULL) {}
+
+  bool startObject() { return enter(); }
+  bool endObject() { return leave(); }
+  bool startArray() { return enter(); }
+  bool endArray() { return leave(); }
+  bool key(const char *key) {
+    _field = depth == 1 ? key : NULL;
+    return true;
+  }
+  bool value(const JsonVariant &value) {
+    if (_field && !strcmp(_field, "count")) count = value.as<int>();
+    if (_field && !strcmp(_field, "status")) status = value.as<const char *>();
+    _field = NULL;
+    return true;
+  }
+
+  int depth;
+  int count;
+  const char *status;
+
+ private:
+  bool enter() {
+    depth++;
+    _field = NULL;
+    return true;
+  }
+  bool leave() {
+    depth--;
+    return true;
+  }
+
+  const char *_field;
+};
+
+static double microsPerParse(clock_t elapsed, int iterations) {
+  return 1e6 * static_cast<double>(elapsed) / CLOCKS_PER_SEC / iterations;
+}
+
+static void bench(size_t size, int iterations) {
+  std::string json = makeDocument(size);
+  std::vector<char> copy(json.size() + 1);
+  int count = 0;
+  size_t domSize = 0;
+
+  clock_t start = clock();
+  for (int i = 0; i < iterations; i++) {
+    memcpy(&copy[0], json.c_str(), copy.size());
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject &root = jsonBuffer.parseObject(&copy[0]);
+    count += root["count"].as<int>();
+    domSize = jsonBuffer.size();
+  }
+  double dom = microsPerParse(clock() - start, iterations);
+
+  start = clock();
+  for (int i = 0; i < iterations; i++) {
+    memcpy(&copy[0], json.c_str(), copy.size());
+    FieldPicker picker;
+    JsonEventParser<FieldPicker> parser(picker);
+    parser.parse(&copy[0]);
+    count -= picker.count;
+  }
+  double events = microsPerParse(clock() - start, iterations);
+
+  if (count != 0) printf("the two parsers disagree\n");
+  printf("%6lu bytes: DOM %9.1f us, %7lu bytes of JsonBuffer\n",
+         static_cast<unsigned long>(json.size()), dom,
+         static_cast<unsigned long>(domSize));
+  printf("%6lu bytes: events %6.1f us, %7lu bytes of parser\n",
+         static_cast<unsigned long>(json.size()), events,
+         static_cast<unsigned long>(sizeof(JsonEventParser<FieldPicker>) +
+                                    sizeof(FieldPicker)));
+}
+
+int main() {
+  bench(1024, 20000);
+  bench(100 * 1024, 200);
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+// Times building objects of 10, 100 and 1000 keys with set() and looking up
+// each key. JsonObject_Index_Bench uses plain lists, and
+// JsonObject_Index_Bench_Indexed the index, with
+// ARDUINOJSON_OBJECT_INDEX_THRESHOLD set to 1.
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+static double microsPer(clock_t elapsed, int iterations) {
+  return 1e6 * static_cast<double>(elapsed) / CLOCKS_PER_SEC / iterations;
+}
+
+static void bench(int keyCount, int iterations) {
+  std::vector<char> keys(static_cast<size_t>(keyCount) * 8);
+  for (int i = 0; i < keyCount; i++) sprintf(&keys[i * 8], "key%d", i);
+
+  clock_t setTime = 0;
+  clock_t getTime = 0;
+  long sum = 0;
+  size_t memory = 0;
+
+  for (int n = 0; n < iterations; n++) {
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject &object = jsonBuffer.createObject();
+
+    clock_t start = clock();
+    for (int i = 0; i < keyCount; i++) object.set(&keys[i * 8], i);
+    setTime += clock() - start;
+
+    start = clock();
+    for (int i = 0; i < keyCount; i++) sum += object.get<long>(&keys[i * 8]);
+    getTime += clock() - start;
+
+    memory = jsonBuffer.size();
+  }
+
+  printf("%4d keys: set %8.2f us, get %8.2f us, %6lu bytes (checksum %ld)\n",
+         keyCount, microsPer(setTime, iterations),
+         microsPer(getTime, iterations), static_cast<unsigned long>(memory),
+         sum);
+}
+
+int main() {
+  printf("ARDUINOJSON_OBJECT_INDEX_THRESHOLD = %d\n",
+         ARDUINOJSON_OBJECT_INDEX_THRESHOLD);
+  bench(10, 100000);
+  bench(100, 10000);
+  bench(1000, 200);
+  return 0;
+}
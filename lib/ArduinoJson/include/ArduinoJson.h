@@ -7,6 +7,7 @@
 
 #include "ArduinoJson/DynamicJsonBuffer.hpp"
 #include "ArduinoJson/JsonArray.hpp"
+#include "ArduinoJson/JsonEventParser.hpp"
 #include "ArduinoJson/JsonObject.hpp"
 #include "ArduinoJson/StaticJsonBuffer.hpp"
 
@@ -0,0 +1,37 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+
+// This class reproduces the part of Arduino's Stream class used by the parser
+class Stream {
+ public:
+  virtual ~Stream() {}
+
+  // Returns the next byte or -1 if there is none
+  virtual int read() = 0;
+
+  size_t readBytes(char* buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = read();
+      if (c < 0) break;
+      buffer[n++] = static_cast<char>(c);
+    }
+    return n;
+  }
+};
+
+#else
+
+#include <Stream.h>
+
+#endif
@@ -74,6 +74,15 @@
 
 #endif
 
+// index the keys of the objects that have more than this number of keys,
+// when they are in a DynamicJsonBuffer (0 = never)
+// The index is allocated in the DynamicJsonBuffer: an indexed object with n
+// keys takes up to (5 + 8 * (n + 1)) * sizeof(void *) more bytes than
+// JSON_OBJECT_SIZE(n), counting the tables left behind as it grows.
+#ifndef ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+#define ARDUINOJSON_OBJECT_INDEX_THRESHOLD 0
+#endif
+
 #if ARDUINOJSON_USE_LONG_LONG && ARDUINOJSON_USE_INT64
 #error ARDUINOJSON_USE_LONG_LONG and ARDUINOJSON_USE_INT64 cannot be set together
 #endif
@@ -56,7 +56,24 @@ class BlockJsonBuffer : public JsonBuffer {
     return canAllocInHead(bytes) ? allocInHead(bytes) : allocInNewBlock(bytes);
   }
 
+  virtual void* resize(void* block, size_t oldSize, size_t newSize) {
+    if (isLastInHead(block, oldSize)) {
+      size_t start = _head->size - round_size_up(oldSize);
+      if (start + newSize <= _head->capacity) {
+        _head->size = start + round_size_up(newSize);
+        return block;
+      }
+    }
+    return JsonBuffer::resize(block, oldSize, newSize);
+  }
+
  private:
+  bool isLastInHead(void* block, size_t bytes) const {
+    return _head != NULL &&
+           static_cast<uint8_t*>(block) + round_size_up(bytes) ==
+               _head->data + _head->size;
+  }
+
   bool canAllocInHead(size_t bytes) const {
     return _head != NULL && _head->size + bytes <= _head->capacity;
   }
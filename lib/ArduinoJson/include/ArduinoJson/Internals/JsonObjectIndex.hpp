@@ -0,0 +1,77 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+#include "../Configuration.hpp"
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+
+#include "../JsonBuffer.hpp"
+#include "../JsonPair.hpp"
+#include "ListNode.hpp"
+
+namespace ArduinoJson {
+namespace Internals {
+
+// A hash table of the nodes of a JsonObject, so that the keys of a big object
+// are not searched one by one.
+// It is allocated in the JsonBuffer, like the nodes, in a single block with
+// its first table. It also keeps the last node, so that adding a key doesn't
+// go through the whole list.
+// This internal class is not indended to be used directly.
+class JsonObjectIndex {
+ public:
+  typedef ListNode<JsonPair> node_type;
+
+  // Indexes the nodes of a list, leaving room for one more.
+  // Returns NULL if the allocation fails, in which case no memory is used.
+  static JsonObjectIndex *create(JsonBuffer *buffer, node_type *firstNode);
+
+  // Returns the node with the specified key, or NULL
+  node_type *find(const char *key) const;
+
+  // Indexes a new node, making the table bigger if needed.
+  // Returns false if there is no room left.
+  bool add(node_type *node);
+
+  void remove(node_type *node);
+
+  node_type *last() const { return _last; }
+  void setLast(node_type *node) { _last = node; }
+
+ private:
+  // The table follows the index in the block
+  JsonObjectIndex(JsonBuffer *buffer, size_t capacity)
+      : _buffer(buffer),
+        _slots(reinterpret_cast<node_type **>(this + 1)),
+        _capacity(capacity),
+        _count(0),
+        _last(NULL) {
+    memset(_slots, 0, capacity * sizeof(node_type *));
+  }
+
+  void *operator new(size_t n, JsonBuffer *buffer, size_t capacity) throw() {
+    return buffer->alloc(n + capacity * sizeof(node_type *));
+  }
+  void operator delete(void *, JsonBuffer *, size_t) throw() {}
+
+  static node_type **allocSlots(JsonBuffer *buffer, size_t capacity);
+  size_t home(const char *key) const;
+  bool grow();
+  void insert(node_type *node);
+
+  JsonBuffer *_buffer;
+  node_type **_slots;
+  size_t _capacity;  // always a power of two
+  size_t _count;
+  node_type *_last;
+};
+}
+}
+
+#endif  // ARDUINOJSON_OBJECT_INDEX_THRESHOLD
@@ -9,28 +9,32 @@
 
 #include "../JsonBuffer.hpp"
 #include "../JsonVariant.hpp"
+#include "JsonTokenizer.hpp"
 
 namespace ArduinoJson {
 namespace Internals {
 
-// Parse JSON string to create JsonArrays and JsonObjects
+// Parse JSON to create JsonArrays and JsonObjects
+// The tokens are read by TReader, which is JsonTokenizer for a string in
+// memory and JsonStreamTokenizer for a Stream. Both have peek(), skip() and
+// parseString().
 // This internal class is not indended to be used directly.
 // Instead, use JsonBuffer.parseArray() or .parseObject()
+template <typename TReader>
 class JsonParser {
  public:
-  JsonParser(JsonBuffer *buffer, char *json, uint8_t nestingLimit)
-      : _buffer(buffer),
-        _readPtr(json ? json : ""),
-        _writePtr(json),
-        _nestingLimit(nestingLimit) {}
+  JsonParser(JsonBuffer *buffer, TReader &reader, uint8_t nestingLimit)
+      : _buffer(buffer), _reader(reader), _nestingLimit(nestingLimit) {}
 
   JsonArray &parseArray();
   JsonObject &parseObject();
 
  private:
-  bool skip(char charToSkip);
+  // cannot be assigned
+  JsonParser &operator=(const JsonParser &);
+
+  bool skip(char charToSkip) { return _reader.skip(charToSkip); }
 
-  const char *parseString();
   bool parseAnythingTo(JsonVariant *destination);
   FORCE_INLINE bool parseAnythingToUnsafe(JsonVariant *destination);
 
@@ -39,9 +43,10 @@ class JsonParser {
   inline bool parseStringTo(JsonVariant *destination);
 
   JsonBuffer *_buffer;
-  const char *_readPtr;
-  char *_writePtr;
+  TReader &_reader;
   uint8_t _nestingLimit;
 };
 }
 }
+
+#include "JsonParser.ipp"
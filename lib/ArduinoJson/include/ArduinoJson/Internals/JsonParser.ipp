@@ -5,26 +5,17 @@
 // https://github.com/bblanchon/ArduinoJson
 // If you like this project, please add a star!
 
-#include "../../include/ArduinoJson/Internals/JsonParser.hpp"
-
-#include "../../include/ArduinoJson/Internals/Comments.hpp"
-#include "../../include/ArduinoJson/Internals/Encoding.hpp"
-#include "../../include/ArduinoJson/JsonArray.hpp"
-#include "../../include/ArduinoJson/JsonBuffer.hpp"
-#include "../../include/ArduinoJson/JsonObject.hpp"
-
-using namespace ArduinoJson;
-using namespace ArduinoJson::Internals;
-
-bool JsonParser::skip(char charToSkip) {
-  const char *ptr = skipSpacesAndComments(_readPtr);
-  if (*ptr != charToSkip) return false;
-  ptr++;
-  _readPtr = skipSpacesAndComments(ptr);
-  return true;
-}
+#pragma once
+
+#include "../JsonArray.hpp"
+#include "../JsonObject.hpp"
+#include "JsonParser.hpp"
 
-bool JsonParser::parseAnythingTo(JsonVariant *destination) {
+namespace ArduinoJson {
+namespace Internals {
+
+template <typename TReader>
+bool JsonParser<TReader>::parseAnythingTo(JsonVariant *destination) {
   if (_nestingLimit == 0) return false;
   _nestingLimit--;
   bool success = parseAnythingToUnsafe(destination);
@@ -32,10 +23,10 @@ bool JsonParser::parseAnythingTo(JsonVariant *destination) {
   return success;
 }
 
-inline bool JsonParser::parseAnythingToUnsafe(JsonVariant *destination) {
-  _readPtr = skipSpacesAndComments(_readPtr);
-
-  switch (*_readPtr) {
+template <typename TReader>
+inline bool JsonParser<TReader>::parseAnythingToUnsafe(
+    JsonVariant *destination) {
+  switch (_reader.peek()) {
     case '[':
       return parseArrayTo(destination);
 
@@ -47,7 +38,8 @@ inline bool JsonParser::parseAnythingToUnsafe(JsonVariant *destination) {
   }
 }
 
-JsonArray &JsonParser::parseArray() {
+template <typename TReader>
+JsonArray &JsonParser<TReader>::parseArray() {
   // Create an empty array
   JsonArray &array = _buffer->createArray();
 
@@ -78,7 +70,8 @@ ERROR_NO_MEMORY:
   return JsonArray::invalid();
 }
 
-bool JsonParser::parseArrayTo(JsonVariant *destination) {
+template <typename TReader>
+bool JsonParser<TReader>::parseArrayTo(JsonVariant *destination) {
   JsonArray &array = parseArray();
   if (!array.success()) return false;
 
@@ -86,7 +79,8 @@ bool JsonParser::parseArrayTo(JsonVariant *destination) {
   return true;
 }
 
-JsonObject &JsonParser::parseObject() {
+template <typename TReader>
+JsonObject &JsonParser<TReader>::parseObject() {
   // Create an empty object
   JsonObject &object = _buffer->createObject();
 
@@ -97,7 +91,7 @@ JsonObject &JsonParser::parseObject() {
   // Read each key value pair
   for (;;) {
     // 1 - Parse key
-    const char *key = parseString();
+    const char *key = _reader.parseString();
     if (!key) goto ERROR_INVALID_KEY;
     if (!skip(':')) goto ERROR_MISSING_COLON;
 
@@ -124,7 +118,8 @@ ERROR_NO_MEMORY:
   return JsonObject::invalid();
 }
 
-bool JsonParser::parseObjectTo(JsonVariant *destination) {
+template <typename TReader>
+bool JsonParser<TReader>::parseObjectTo(JsonVariant *destination) {
   JsonObject &object = parseObject();
   if (!object.success()) return false;
 
@@ -132,65 +127,10 @@ bool JsonParser::parseObjectTo(JsonVariant *destination) {
   return true;
 }
 
-static inline bool isInRange(char c, char min, char max) {
-  return min <= c && c <= max;
-}
-
-static inline bool isLetterOrNumber(char c) {
-  return isInRange(c, '0', '9') || isInRange(c, 'a', 'z') ||
-         isInRange(c, 'A', 'Z') || c == '-' || c == '.';
-}
-
-static inline bool isQuote(char c) { return c == '\'' || c == '\"'; }
-
-const char *JsonParser::parseString() {
-  const char *readPtr = _readPtr;
-  char *writePtr = _writePtr;
-
-  char c = *readPtr;
-
-  if (isQuote(c)) {  // quotes
-    char stopChar = c;
-    for (;;) {
-      c = *++readPtr;
-      if (c == '\0') break;
-
-      if (c == stopChar) {
-        readPtr++;
-        break;
-      }
-
-      if (c == '\\') {
-        // replace char
-        c = Encoding::unescapeChar(*++readPtr);
-        if (c == '\0') break;
-      }
-
-      *writePtr++ = c;
-    }
-  } else {  // no quotes
-    for (;;) {
-      if (!isLetterOrNumber(c)) break;
-      *writePtr++ = c;
-      c = *++readPtr;
-    }
-  }
-  // end the string here
-  *writePtr++ = '\0';
-
-  const char *startPtr = _writePtr;
-
-  // update end ptr
-  _readPtr = readPtr;
-  _writePtr = writePtr;
-
-  // return pointer to unquoted string
-  return startPtr;
-}
-
-bool JsonParser::parseStringTo(JsonVariant *destination) {
-  bool hasQuotes = isQuote(_readPtr[0]);
-  const char *value = parseString();
+template <typename TReader>
+bool JsonParser<TReader>::parseStringTo(JsonVariant *destination) {
+  bool hasQuotes = JsonTokenizer::isQuote(_reader.peek());
+  const char *value = _reader.parseString();
   if (value == NULL) return false;
   if (hasQuotes) {
     *destination = value;
@@ -199,3 +139,5 @@ bool JsonParser::parseStringTo(JsonVariant *destination) {
   }
   return true;
 }
+}
+}
@@ -0,0 +1,71 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+#include "../Arduino/Stream.hpp"
+#include "../JsonBuffer.hpp"
+
+namespace ArduinoJson {
+namespace Internals {
+
+// Reads the tokens of JSON read from a Stream.
+// Unlike JsonTokenizer, the input doesn't need to be in memory: only the
+// content of the strings is copied in the JsonBuffer.
+// This internal class is used by JsonParser.
+class JsonStreamTokenizer {
+ public:
+  JsonStreamTokenizer(JsonBuffer *buffer, Stream &stream)
+      : _buffer(buffer),
+        _stream(stream),
+        _current(0),
+        _loaded(false),
+        _string(NULL),
+        _length(0),
+        _capacity(0) {}
+
+  // Skips spaces and comments and returns the next char, without consuming it
+  char peek();
+
+  // Consumes the next char, and the spaces and comments before it, if it is
+  // the expected one
+  bool skip(char charToSkip);
+
+  // Consumes a quoted or unquoted string and returns a copy in the JsonBuffer
+  const char *parseString();
+
+ private:
+  // cannot be assigned
+  JsonStreamTokenizer &operator=(const JsonStreamTokenizer &);
+
+  // The character under the cursor, '\0' at the end of the stream.
+  // It is only read from the stream when needed, so that nothing is read
+  // past the end of the JSON document.
+  char current();
+  // Once the end is reached, the cursor stays there.
+  void move() {
+    if (_current != '\0') _loaded = false;
+  }
+
+  void skipSpacesAndComments();
+  bool append(char c);
+
+  // Strings are read here and then copied in the JsonBuffer. Longer strings
+  // are read directly in the JsonBuffer, in a block that is resized as needed.
+  static const size_t SCRATCH_SIZE = 32;
+
+  JsonBuffer *_buffer;
+  Stream &_stream;
+  char _current;
+  bool _loaded;
+  char _scratch[SCRATCH_SIZE];
+  char *_string;
+  size_t _length;
+  size_t _capacity;
+};
+}
+}
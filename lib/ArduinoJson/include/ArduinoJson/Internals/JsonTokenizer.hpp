@@ -0,0 +1,50 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+namespace ArduinoJson {
+namespace Internals {
+
+// Reads the tokens of a JSON string in place.
+// Strings are unescaped and null-terminated over the input, so it must be
+// writable.
+// This internal class is used by JsonParser and JsonEventParser.
+// Its character classes are shared with JsonStreamTokenizer.
+class JsonTokenizer {
+ public:
+  explicit JsonTokenizer(char *json)
+      : _readPtr(json ? json : ""), _writePtr(json) {}
+
+  // Skips spaces and comments and returns the next char, without consuming it
+  char peek();
+
+  // Consumes the next char, and the spaces and comments around it, if it is
+  // the expected one
+  bool skip(char charToSkip);
+
+  // Consumes a quoted or unquoted string and returns it
+  const char *parseString();
+
+  static bool isQuote(char c) { return c == '\'' || c == '\"'; }
+
+  // The characters of an unquoted string
+  static bool isLetterOrNumber(char c) {
+    return isInRange(c, '0', '9') || isInRange(c, 'a', 'z') ||
+           isInRange(c, 'A', 'Z') || c == '-' || c == '.';
+  }
+
+ private:
+  static bool isInRange(char c, char min, char max) {
+    return min <= c && c <= max;
+  }
+
+  const char *_readPtr;
+  char *_writePtr;
+};
+}
+}
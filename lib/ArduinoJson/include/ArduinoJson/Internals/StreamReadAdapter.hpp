@@ -0,0 +1,39 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+#include "../Configuration.hpp"
+
+#if ARDUINOJSON_ENABLE_STD_STREAM
+
+#include "../Arduino/Stream.hpp"
+
+#include <istream>
+
+namespace ArduinoJson {
+namespace Internals {
+
+class StreamReadAdapter : public Stream {
+ public:
+  explicit StreamReadAdapter(std::istream& is) : _is(is) {}
+
+  virtual int read() {
+    int c = _is.get();
+    return c == std::istream::traits_type::eof() ? -1 : c;
+  }
+
+ private:
+  // cannot be assigned
+  StreamReadAdapter& operator=(const StreamReadAdapter&);
+
+  std::istream& _is;
+};
+}
+}
+
+#endif  // ARDUINOJSON_ENABLE_STD_STREAM
@@ -11,9 +11,15 @@
 #include <stdint.h>  // for uint8_t
 #include <string.h>
 
+#include "Arduino/Stream.hpp"
 #include "Arduino/String.hpp"
+#include "Configuration.hpp"
 #include "JsonVariant.hpp"
 
+#if ARDUINOJSON_ENABLE_STD_STREAM
+#include <iosfwd>
+#endif
+
 #if defined(__clang__)
 #pragma clang diagnostic ignored "-Wnon-virtual-dtor"
 #elif defined(__GNUC__)
@@ -71,6 +77,16 @@ class JsonBuffer {
     return parseArray(json.c_str(), nesting);
   }
 
+  // Same as above, reading the JSON from a Stream, such as a network client.
+  // Only the content of the strings is copied in the JsonBuffer, and nothing
+  // is read past the closing bracket.
+  JsonArray &parseArray(Stream &json, uint8_t nesting = DEFAULT_LIMIT);
+
+#if ARDUINOJSON_ENABLE_STD_STREAM
+  // Same as above with a std::istream
+  JsonArray &parseArray(std::istream &json, uint8_t nesting = DEFAULT_LIMIT);
+#endif
+
   // Allocates and populate a JsonObject from a JSON string.
   //
   // The First argument is a pointer to the JSON string, the memory must be
@@ -94,6 +110,16 @@ class JsonBuffer {
     return parseObject(json.c_str(), nesting);
   }
 
+  // Same as above, reading the JSON from a Stream, such as a network client.
+  // Only the content of the strings is copied in the JsonBuffer, and nothing
+  // is read past the closing brace.
+  JsonObject &parseObject(Stream &json, uint8_t nesting = DEFAULT_LIMIT);
+
+#if ARDUINOJSON_ENABLE_STD_STREAM
+  // Same as above with a std::istream
+  JsonObject &parseObject(std::istream &json, uint8_t nesting = DEFAULT_LIMIT);
+#endif
+
   // Duplicate a string
   char *strdup(const char *src) {
     return src ? strdup(src, strlen(src)) : NULL;
@@ -104,20 +130,17 @@ class JsonBuffer {
   // Return a pointer to the allocated memory or NULL if allocation fails.
   virtual void *alloc(size_t size) = 0;
 
- protected:
-  // Preserve aligment if nessary
-  static FORCE_INLINE size_t round_size_up(size_t bytes) {
-#if ARDUINOJSON_ENABLE_ALIGNMENT
-    const size_t x = sizeof(void *) - 1;
-    return (bytes + x) & ~x;
-#else
-    return bytes;
-#endif
+  // Resizes a block returned by alloc(), keeping its content.
+  // The last block allocated is resized in place when possible, otherwise a
+  // new block is allocated.
+  // Return a pointer to the block or NULL if allocation fails.
+  virtual void *resize(void *block, size_t oldSize, size_t newSize) {
+    if (newSize <= oldSize) return block;
+    void *dest = alloc(newSize);
+    if (dest != NULL) memcpy(dest, block, oldSize);
+    return dest;
   }
 
- private:
-  char *strdup(const char *, size_t);
-
   // Default value of nesting limit of parseArray() and parseObject().
   //
   // The nesting limit is a contain on the level of nesting allowed in the
@@ -132,5 +155,25 @@ class JsonBuffer {
   // lead to
   // a security risk.
   static const uint8_t DEFAULT_LIMIT = 10;
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  // Tells whether big JsonObjects can use more memory for an index of their
+  // keys.
+  virtual bool canIndexObjects() const { return true; }
+#endif
+
+ protected:
+  // Preserve aligment if nessary
+  static FORCE_INLINE size_t round_size_up(size_t bytes) {
+#if ARDUINOJSON_ENABLE_ALIGNMENT
+    const size_t x = sizeof(void *) - 1;
+    return (bytes + x) & ~x;
+#else
+    return bytes;
+#endif
+  }
+
+ private:
+  char *strdup(const char *, size_t);
 };
 }
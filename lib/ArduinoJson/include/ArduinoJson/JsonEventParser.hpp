@@ -0,0 +1,118 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#pragma once
+
+#include "Internals/JsonTokenizer.hpp"
+#include "JsonBuffer.hpp"
+#include "JsonVariant.hpp"
+
+namespace ArduinoJson {
+
+// Parses a JSON string and passes each element to a handler as it is read.
+// No JsonArray or JsonObject is created, so the memory used doesn't depend on
+// the size of the document.
+//
+// The handler must have the following methods, each returning false to stop
+// the parsing:
+//   bool startObject();
+//   bool key(const char *key);
+//   bool endObject();
+//   bool startArray();
+//   bool endArray();
+//   bool value(const JsonVariant &value);
+//
+// As with JsonBuffer::parseObject(), the JSON string must be writable because
+// the strings passed to the handler are unescaped in place.
+template <typename THandler>
+class JsonEventParser {
+ public:
+  // The nesting limit works as in JsonBuffer::parseObject()
+  explicit JsonEventParser(THandler &handler,
+                           uint8_t nestingLimit = JsonBuffer::DEFAULT_LIMIT)
+      : _handler(handler), _tokenizer(NULL), _nestingLimit(nestingLimit) {}
+
+  // Returns true if the whole array or object was read, false if it is invalid
+  // or if the handler stopped the parsing.
+  bool parse(char *json) {
+    _tokenizer = Internals::JsonTokenizer(json);
+    switch (_tokenizer.peek()) {
+      case '[':
+        return parseArray();
+
+      case '{':
+        return parseObject();
+
+      default:
+        return false;
+    }
+  }
+
+ private:
+  // cannot be assigned
+  JsonEventParser &operator=(const JsonEventParser &);
+
+  bool parseAnything() {
+    if (_nestingLimit == 0) return false;
+    _nestingLimit--;
+    bool success = parseAnythingUnsafe();
+    _nestingLimit++;
+    return success;
+  }
+
+  bool parseAnythingUnsafe() {
+    switch (_tokenizer.peek()) {
+      case '[':
+        return parseArray();
+
+      case '{':
+        return parseObject();
+
+      default:
+        return parseValue();
+    }
+  }
+
+  bool parseArray() {
+    if (!_tokenizer.skip('[')) return false;
+    if (!_handler.startArray()) return false;
+    if (_tokenizer.skip(']')) return _handler.endArray();
+
+    for (;;) {
+      if (!parseAnything()) return false;
+      if (_tokenizer.skip(']')) return _handler.endArray();
+      if (!_tokenizer.skip(',')) return false;
+    }
+  }
+
+  bool parseObject() {
+    if (!_tokenizer.skip('{')) return false;
+    if (!_handler.startObject()) return false;
+    if (_tokenizer.skip('}')) return _handler.endObject();
+
+    for (;;) {
+      const char *key = _tokenizer.parseString();
+      if (!_handler.key(key)) return false;
+      if (!_tokenizer.skip(':')) return false;
+      if (!parseAnything()) return false;
+      if (_tokenizer.skip('}')) return _handler.endObject();
+      if (!_tokenizer.skip(',')) return false;
+    }
+  }
+
+  bool parseValue() {
+    bool hasQuotes = Internals::JsonTokenizer::isQuote(_tokenizer.peek());
+    const char *value = _tokenizer.parseString();
+    if (hasQuotes) return _handler.value(JsonVariant(value));
+    return _handler.value(JsonVariant(Internals::Unparsed(value)));
+  }
+
+  THandler &_handler;
+  Internals::JsonTokenizer _tokenizer;
+  uint8_t _nestingLimit;
+};
+}
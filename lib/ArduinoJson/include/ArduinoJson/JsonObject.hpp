@@ -29,6 +29,10 @@ namespace ArduinoJson {
 class JsonArray;
 class JsonBuffer;
 
+namespace Internals {
+class JsonObjectIndex;
+}
+
 // A dictionary of JsonVariant indexed by string (char*)
 //
 // The constructor is private, instances must be created via
@@ -53,7 +57,11 @@ class JsonObject : public Internals::JsonPrintable<JsonObject>,
   // You should not use this constructor directly.
   // Instead, use JsonBuffer::createObject() or JsonBuffer.parseObject().
   FORCE_INLINE explicit JsonObject(JsonBuffer* buffer)
-      : Internals::List<JsonPair>(buffer) {}
+      : Internals::List<JsonPair>(buffer) {
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+    _index = NULL;
+#endif
+  }
 
   // Gets or sets the value associated with the specified key.
   FORCE_INLINE JsonObjectSubscript<const char*> operator[](const char* key);
@@ -135,6 +143,12 @@ class JsonObject : public Internals::JsonPrintable<JsonObject>,
   // Returns the list node that matches the specified key.
   node_type* getNodeAt(const char* key) const;
 
+  // Appends a node to the list, with the index if there is one.
+  node_type* appendNode();
+  // Adds the key of a new node to the index. Adding a key to an object with
+  // ARDUINOJSON_OBJECT_INDEX_THRESHOLD keys creates the index.
+  void indexNode(node_type*);
+
   node_type* getOrCreateNodeAt(const char* key);
 
   template <typename T>
@@ -147,6 +161,11 @@ class JsonObject : public Internals::JsonPrintable<JsonObject>,
 
   // The instance returned by JsonObject::invalid()
   static JsonObject _invalid;
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  // Created lazily in the JsonBuffer, NULL for small objects
+  Internals::JsonObjectIndex* _index;
+#endif
 };
 }
 
@@ -48,17 +48,14 @@ inline bool JsonObject::containsKey(JsonObjectKey key) const {
   return getNodeAt(key.c_str()) != NULL;
 }
 
-inline void JsonObject::remove(JsonObjectKey key) {
-  removeNode(getNodeAt(key.c_str()));
-}
-
 template <typename T>
 inline bool JsonObject::setNodeAt(JsonObjectKey key, T value) {
   node_type *node = getNodeAt(key.c_str());
   if (!node) {
-    node = addNewNode();
+    node = appendNode();
     if (!node || !setNodeKey(node, key))
       return false;
+    indexNode(node);
   }
   return setNodeValue<T>(node, value);
 }
@@ -29,7 +29,26 @@ class StaticJsonBuffer : public JsonBuffer {
     return p;
   }
 
+  virtual void* resize(void* block, size_t oldSize, size_t newSize) {
+    if (!isLast(block, oldSize))
+      return JsonBuffer::resize(block, oldSize, newSize);
+    size_t start = _size - round_size_up(oldSize);
+    if (start + newSize > CAPACITY) return NULL;
+    _size = start + round_size_up(newSize);
+    return block;
+  }
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  // The objects are not indexed, so that JSON_OBJECT_SIZE() remains exact
+  virtual bool canIndexObjects() const { return false; }
+#endif
+
  private:
+  bool isLast(void* block, size_t bytes) const {
+    return static_cast<uint8_t*>(block) + round_size_up(bytes) ==
+           &_buffer[_size];
+  }
+
   uint8_t _buffer[CAPACITY];
   size_t _size;
 };
@@ -0,0 +1,122 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include "../../include/ArduinoJson/Internals/JsonObjectIndex.hpp"
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+
+#include <string.h>  // for strcmp
+
+using namespace ArduinoJson;
+using namespace ArduinoJson::Internals;
+
+// FNV-1a
+static uint32_t hashKey(const char *key) {
+  uint32_t hash = 2166136261UL;
+  while (*key) {
+    hash ^= static_cast<uint8_t>(*key++);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+JsonObjectIndex::node_type **JsonObjectIndex::allocSlots(JsonBuffer *buffer,
+                                                         size_t capacity) {
+  size_t bytes = capacity * sizeof(node_type *);
+  node_type **slots = static_cast<node_type **>(buffer->alloc(bytes));
+  if (slots) memset(slots, 0, bytes);
+  return slots;
+}
+
+JsonObjectIndex *JsonObjectIndex::create(JsonBuffer *buffer,
+                                         node_type *firstNode) {
+  // keep the table at most half full, even after the next key is added
+  size_t count = 0;
+  for (node_type *node = firstNode; node; node = node->next) count++;
+  size_t capacity = 4;
+  while (capacity < 2 * (count + 1)) capacity *= 2;
+
+  JsonObjectIndex *index =
+      new (buffer, capacity) JsonObjectIndex(buffer, capacity);
+  if (!index) return NULL;
+
+  for (node_type *node = firstNode; node; node = node->next) {
+    // a node whose key couldn't be copied can't be found anyway
+    if (node->content.key) index->insert(node);
+    index->_last = node;
+  }
+  return index;
+}
+
+size_t JsonObjectIndex::home(const char *key) const {
+  return static_cast<size_t>(hashKey(key)) & (_capacity - 1);
+}
+
+JsonObjectIndex::node_type *JsonObjectIndex::find(const char *key) const {
+  for (size_t i = home(key);; i = (i + 1) & (_capacity - 1)) {
+    node_type *node = _slots[i];
+    if (!node) return NULL;
+    if (!strcmp(node->content.key, key)) return node;
+  }
+}
+
+void JsonObjectIndex::insert(node_type *node) {
+  size_t i = home(node->content.key);
+  while (_slots[i]) i = (i + 1) & (_capacity - 1);
+  _slots[i] = node;
+  _count++;
+}
+
+bool JsonObjectIndex::grow() {
+  size_t capacity = _capacity * 2;
+  node_type **slots = allocSlots(_buffer, capacity);
+  if (!slots) return false;
+
+  // the old table stays in the JsonBuffer, which can't free memory
+  node_type **oldSlots = _slots;
+  size_t oldCapacity = _capacity;
+  _slots = slots;
+  _capacity = capacity;
+  _count = 0;
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (oldSlots[i]) insert(oldSlots[i]);
+  }
+  return true;
+}
+
+bool JsonObjectIndex::add(node_type *node) {
+  if (2 * (_count + 1) > _capacity) grow();
+  // one slot must stay empty to end the searches
+  if (_count + 1 >= _capacity) return false;
+  insert(node);
+  return true;
+}
+
+void JsonObjectIndex::remove(node_type *node) {
+  size_t mask = _capacity - 1;
+  size_t i = home(node->content.key);
+  while (_slots[i] != node) {
+    if (!_slots[i]) return;
+    i = (i + 1) & mask;
+  }
+  _slots[i] = NULL;
+  _count--;
+
+  // move back the following nodes that would no longer be found
+  for (size_t j = (i + 1) & mask; _slots[j]; j = (j + 1) & mask) {
+    size_t k = home(_slots[j]->content.key);
+    // the node can move to i if its home isn't in the range (i, j]
+    bool between = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+    if (!between) {
+      _slots[i] = _slots[j];
+      _slots[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+#endif  // ARDUINOJSON_OBJECT_INDEX_THRESHOLD
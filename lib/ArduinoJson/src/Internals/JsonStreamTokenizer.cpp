@@ -0,0 +1,142 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include "../../include/ArduinoJson/Internals/JsonStreamTokenizer.hpp"
+
+#include "../../include/ArduinoJson/Internals/Encoding.hpp"
+#include "../../include/ArduinoJson/Internals/JsonTokenizer.hpp"
+
+using namespace ArduinoJson;
+using namespace ArduinoJson::Internals;
+
+char JsonStreamTokenizer::current() {
+  if (!_loaded) {
+    char c;
+    _current = _stream.readBytes(&c, 1) == 1 ? c : '\0';
+    _loaded = true;
+  }
+  return _current;
+}
+
+void JsonStreamTokenizer::skipSpacesAndComments() {
+  for (;;) {
+    switch (current()) {
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        move();
+        continue;
+      case '/':
+        move();
+        switch (current()) {
+          case '*':
+            move();
+            for (;;) {
+              char c = current();
+              if (c == '\0') return;
+              move();
+              if (c == '*' && current() == '/') break;
+            }
+            move();
+            break;
+          case '/':
+            while (current() != '\0' && current() != '\n') move();
+            break;
+          default:
+            // a lone slash is never valid JSON, and it can't be put back, so
+            // stop here as if it was the end of the stream
+            _current = '\0';
+            _loaded = true;
+            return;
+        }
+        break;
+      default:
+        return;
+    }
+  }
+}
+
+char JsonStreamTokenizer::peek() {
+  skipSpacesAndComments();
+  return current();
+}
+
+bool JsonStreamTokenizer::skip(char charToSkip) {
+  if (peek() != charToSkip) return false;
+  // unlike JsonTokenizer, the following spaces are not skipped, to avoid
+  // waiting for input after the end of the document
+  move();
+  return true;
+}
+
+bool JsonStreamTokenizer::append(char c) {
+  if (_length == _capacity) {
+    // the string doesn't fit: move it to the JsonBuffer, or make it bigger
+    size_t capacity = _capacity * 2;
+    char *block;
+    if (_string == _scratch) {
+      block = static_cast<char *>(_buffer->alloc(capacity));
+      if (block != NULL) memcpy(block, _scratch, _length);
+    } else {
+      block = static_cast<char *>(_buffer->resize(_string, _capacity, capacity));
+    }
+    if (block == NULL) return false;
+    _string = block;
+    _capacity = capacity;
+  }
+  _string[_length++] = c;
+  return true;
+}
+
+const char *JsonStreamTokenizer::parseString() {
+  _string = _scratch;
+  _length = 0;
+  _capacity = SCRATCH_SIZE;
+
+  char c = peek();
+
+  if (JsonTokenizer::isQuote(c)) {  // quotes
+    char stopChar = c;
+    for (;;) {
+      move();
+      c = current();
+      if (c == '\0') break;
+
+      if (c == stopChar) {
+        move();
+        break;
+      }
+
+      if (c == '\\') {
+        // replace char
+        move();
+        c = Encoding::unescapeChar(current());
+        if (c == '\0') break;
+      }
+
+      if (!append(c)) return NULL;
+    }
+  } else {  // no quotes
+    for (;;) {
+      if (!JsonTokenizer::isLetterOrNumber(c)) break;
+      if (!append(c)) return NULL;
+      move();
+      c = current();
+    }
+  }
+  // end the string here
+  if (!append('\0')) return NULL;
+
+  // a long string is already in the JsonBuffer, give back what's unused
+  if (_string != _scratch)
+    return static_cast<char *>(_buffer->resize(_string, _capacity, _length));
+
+  char *copy = static_cast<char *>(_buffer->alloc(_length));
+  if (copy != NULL) memcpy(copy, _scratch, _length);
+  return copy;
+}
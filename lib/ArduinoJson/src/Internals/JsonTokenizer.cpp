@@ -0,0 +1,71 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include "../../include/ArduinoJson/Internals/JsonTokenizer.hpp"
+
+#include "../../include/ArduinoJson/Internals/Comments.hpp"
+#include "../../include/ArduinoJson/Internals/Encoding.hpp"
+
+using namespace ArduinoJson::Internals;
+
+char JsonTokenizer::peek() {
+  _readPtr = skipSpacesAndComments(_readPtr);
+  return *_readPtr;
+}
+
+bool JsonTokenizer::skip(char charToSkip) {
+  const char *ptr = skipSpacesAndComments(_readPtr);
+  if (*ptr != charToSkip) return false;
+  ptr++;
+  _readPtr = skipSpacesAndComments(ptr);
+  return true;
+}
+
+const char *JsonTokenizer::parseString() {
+  const char *readPtr = _readPtr;
+  char *writePtr = _writePtr;
+
+  char c = *readPtr;
+
+  if (isQuote(c)) {  // quotes
+    char stopChar = c;
+    for (;;) {
+      c = *++readPtr;
+      if (c == '\0') break;
+
+      if (c == stopChar) {
+        readPtr++;
+        break;
+      }
+
+      if (c == '\\') {
+        // replace char
+        c = Encoding::unescapeChar(*++readPtr);
+        if (c == '\0') break;
+      }
+
+      *writePtr++ = c;
+    }
+  } else {  // no quotes
+    for (;;) {
+      if (!isLetterOrNumber(c)) break;
+      *writePtr++ = c;
+      c = *++readPtr;
+    }
+  }
+  // end the string here
+  *writePtr++ = '\0';
+
+  const char *startPtr = _writePtr;
+
+  // update end ptr
+  _readPtr = readPtr;
+  _writePtr = writePtr;
+
+  // return pointer to unquoted string
+  return startPtr;
+}
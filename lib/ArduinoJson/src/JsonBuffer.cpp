@@ -8,6 +8,8 @@
 #include "../include/ArduinoJson/JsonBuffer.hpp"
 
 #include "../include/ArduinoJson/Internals/JsonParser.hpp"
+#include "../include/ArduinoJson/Internals/JsonStreamTokenizer.hpp"
+#include "../include/ArduinoJson/Internals/StreamReadAdapter.hpp"
 #include "../include/ArduinoJson/JsonArray.hpp"
 #include "../include/ArduinoJson/JsonObject.hpp"
 
@@ -25,15 +27,41 @@ JsonObject &JsonBuffer::createObject() {
 }
 
 JsonArray &JsonBuffer::parseArray(char *json, uint8_t nestingLimit) {
-  JsonParser parser(this, json, nestingLimit);
+  JsonTokenizer tokenizer(json);
+  JsonParser<JsonTokenizer> parser(this, tokenizer, nestingLimit);
   return parser.parseArray();
 }
 
 JsonObject &JsonBuffer::parseObject(char *json, uint8_t nestingLimit) {
-  JsonParser parser(this, json, nestingLimit);
+  JsonTokenizer tokenizer(json);
+  JsonParser<JsonTokenizer> parser(this, tokenizer, nestingLimit);
   return parser.parseObject();
 }
 
+JsonArray &JsonBuffer::parseArray(Stream &json, uint8_t nestingLimit) {
+  JsonStreamTokenizer tokenizer(this, json);
+  JsonParser<JsonStreamTokenizer> parser(this, tokenizer, nestingLimit);
+  return parser.parseArray();
+}
+
+JsonObject &JsonBuffer::parseObject(Stream &json, uint8_t nestingLimit) {
+  JsonStreamTokenizer tokenizer(this, json);
+  JsonParser<JsonStreamTokenizer> parser(this, tokenizer, nestingLimit);
+  return parser.parseObject();
+}
+
+#if ARDUINOJSON_ENABLE_STD_STREAM
+JsonArray &JsonBuffer::parseArray(std::istream &json, uint8_t nestingLimit) {
+  StreamReadAdapter adapter(json);
+  return parseArray(adapter, nestingLimit);
+}
+
+JsonObject &JsonBuffer::parseObject(std::istream &json, uint8_t nestingLimit) {
+  StreamReadAdapter adapter(json);
+  return parseObject(adapter, nestingLimit);
+}
+#endif
+
 char *JsonBuffer::strdup(const char *source, size_t length) {
   size_t size = length + 1;
   char *dest = static_cast<char *>(alloc(size));
@@ -9,6 +9,7 @@
 
 #include <string.h>  // for strcmp
 
+#include "../include/ArduinoJson/Internals/JsonObjectIndex.hpp"
 #include "../include/ArduinoJson/Internals/StaticStringBuilder.hpp"
 #include "../include/ArduinoJson/JsonArray.hpp"
 #include "../include/ArduinoJson/JsonBuffer.hpp"
@@ -19,12 +20,62 @@ using namespace ArduinoJson::Internals;
 JsonObject JsonObject::_invalid(NULL);
 
 JsonObject::node_type *JsonObject::getNodeAt(const char *key) const {
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  if (_index) return _index->find(key);
+#endif
   for (node_type *node = _firstNode; node; node = node->next) {
     if (!strcmp(node->content.key, key)) return node;
   }
   return NULL;
 }
 
+JsonObject::node_type *JsonObject::appendNode() {
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  if (_index) {
+    node_type *newNode = new (_buffer) node_type();
+    if (!newNode) return NULL;
+    if (_index->last())
+      _index->last()->next = newNode;
+    else
+      _firstNode = newNode;
+    _index->setLast(newNode);
+    return newNode;
+  }
+#endif
+  return addNewNode();
+}
+
+void JsonObject::indexNode(node_type *node) {
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  if (_index) {
+    // without room to grow, the index is dropped and rebuilt on the next add
+    if (!_index->add(node)) _index = NULL;
+    return;
+  }
+  // the object is big enough to make the next lookups worth an index
+  if (_buffer->canIndexObjects() &&
+      size() > ARDUINOJSON_OBJECT_INDEX_THRESHOLD)
+    _index = JsonObjectIndex::create(_buffer, _firstNode);
+#else
+  (void)node;
+#endif
+}
+
+void JsonObject::remove(JsonObjectKey key) {
+  node_type *node = getNodeAt(key.c_str());
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+  if (_index && node) {
+    _index->remove(node);
+    if (_index->last() == node) {
+      node_type *last = NULL;
+      for (node_type *n = _firstNode; n != node; n = n->next) last = n;
+      _index->setLast(last);
+    }
+  }
+#endif
+  removeNode(node);
+}
+
 void JsonObject::writeTo(JsonWriter &writer) const {
   writer.beginObject();
 
@@ -8,6 +8,13 @@
 #include <gtest/gtest.h>
 #include <ArduinoJson.h>
 
+// An object with more than ARDUINOJSON_OBJECT_INDEX_THRESHOLD keys also has an
+// index, which JSON_OBJECT_SIZE() doesn't count
+static bool isIndexed(size_t keys) {
+  return ARDUINOJSON_OBJECT_INDEX_THRESHOLD != 0 &&
+         keys > ARDUINOJSON_OBJECT_INDEX_THRESHOLD;
+}
+
 TEST(DynamicJsonBuffer_Object_Tests, GrowsWithObject) {
   DynamicJsonBuffer json;
 
@@ -15,11 +22,18 @@ TEST(DynamicJsonBuffer_Object_Tests, GrowsWithObject) {
   ASSERT_EQ(JSON_OBJECT_SIZE(0), json.size());
 
   obj["hello"] = 1;
-  ASSERT_EQ(JSON_OBJECT_SIZE(1), json.size());
+  if (isIndexed(1))
+    ASSERT_LT(JSON_OBJECT_SIZE(1), json.size());
+  else
+    ASSERT_EQ(JSON_OBJECT_SIZE(1), json.size());
 
   obj["world"] = 2;
-  ASSERT_EQ(JSON_OBJECT_SIZE(2), json.size());
+  if (isIndexed(2))
+    ASSERT_LT(JSON_OBJECT_SIZE(2), json.size());
+  else
+    ASSERT_EQ(JSON_OBJECT_SIZE(2), json.size());
+  size_t size = json.size();
 
   obj["world"] = 3;  // <- same key, should not grow
-  ASSERT_EQ(JSON_OBJECT_SIZE(2), json.size());
+  ASSERT_EQ(size, json.size());
 }
@@ -0,0 +1,125 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include <string>
+#include <gtest/gtest.h>
+#include <ArduinoJson.h>
+
+// Writes each event to a string
+class EventRecorder {
+ public:
+  EventRecorder() : stopAtKey(NULL) {}
+
+  bool startObject() { return record("{"); }
+  bool key(const char *key) {
+    record("key:");
+    record(key);
+    return !stopAtKey || strcmp(key, stopAtKey) != 0;
+  }
+  bool endObject() { return record("}"); }
+  bool startArray() { return record("["); }
+  bool endArray() { return record("]"); }
+  bool value(const JsonVariant &value) {
+    if (value.is<const char *>()) {
+      record("string:");
+      return record(value.as<const char *>());
+    }
+    if (value.is<long>()) {
+      record("long:");
+      return record(value.as<String>().c_str());
+    }
+    record("other:");
+    return record(value.as<String>().c_str());
+  }
+
+  std::string events;
+  const char *stopAtKey;
+
+ private:
+  bool record(const char *s) {
+    if (!events.empty() && events[events.size() - 1] != ':') events += ' ';
+    events += s;
+    return true;
+  }
+};
+
+class JsonEventParser_Tests : public testing::Test {
+ protected:
+  bool whenInputIs(const char *json, uint8_t nestingLimit = 10) {
+    strcpy(_jsonString, json);
+    JsonEventParser<EventRecorder> parser(_recorder, nestingLimit);
+    return parser.parse(_jsonString);
+  }
+
+  void eventsMustBe(const char *expected) {
+    EXPECT_EQ(expected, _recorder.events);
+  }
+
+  EventRecorder _recorder;
+
+ private:
+  char _jsonString[256];
+};
+
+TEST_F(JsonEventParser_Tests, EmptyObject) {
+  EXPECT_TRUE(whenInputIs("{}"));
+  eventsMustBe("{ }");
+}
+
+TEST_F(JsonEventParser_Tests, EmptyArray) {
+  EXPECT_TRUE(whenInputIs(" [ ] "));
+  eventsMustBe("[ ]");
+}
+
+TEST_F(JsonEventParser_Tests, Values) {
+  EXPECT_TRUE(whenInputIs("[\"hello\", 'world', 42, true, null, 3.5]"));
+  eventsMustBe(
+      "[ string:hello string:world long:42 other:true other:null other:3.5 ]");
+}
+
+TEST_F(JsonEventParser_Tests, Object) {
+  EXPECT_TRUE(whenInputIs("{\"a\":1,'b':\"two\",c:[]}"));
+  eventsMustBe("{ key:a long:1 key:b string:two key:c [ ] }");
+}
+
+TEST_F(JsonEventParser_Tests, Nested) {
+  EXPECT_TRUE(whenInputIs("{\"a\":[{\"b\":[1,2]},{}],/* c */\"d\":{}}"));
+  eventsMustBe("{ key:a [ { key:b [ long:1 long:2 ] } { } ] key:d { } }");
+}
+
+TEST_F(JsonEventParser_Tests, EscapedString) {
+  EXPECT_TRUE(whenInputIs("[\"1\\\"2\\n3\"]"));
+  eventsMustBe("[ string:1\"2\n3 ]");
+}
+
+TEST_F(JsonEventParser_Tests, HandlerStopsParsing) {
+  _recorder.stopAtKey = "b";
+  EXPECT_FALSE(whenInputIs("{\"a\":1,\"b\":2,\"c\":3}"));
+  eventsMustBe("{ key:a long:1 key:b");
+}
+
+TEST_F(JsonEventParser_Tests, NestingLimit) {
+  EXPECT_TRUE(whenInputIs("[[]]", 1));
+  EXPECT_FALSE(whenInputIs("[[[]]]", 1));
+}
+
+TEST_F(JsonEventParser_Tests, MissingComma) {
+  EXPECT_FALSE(whenInputIs("[1 2]"));
+}
+
+TEST_F(JsonEventParser_Tests, MissingColon) {
+  EXPECT_FALSE(whenInputIs("{\"a\" 1}"));
+}
+
+TEST_F(JsonEventParser_Tests, MissingClosingBracket) {
+  EXPECT_FALSE(whenInputIs("[1,2"));
+}
+
+TEST_F(JsonEventParser_Tests, NotAnArrayOrObject) {
+  EXPECT_FALSE(whenInputIs("42"));
+  EXPECT_FALSE(whenInputIs(""));
+}
@@ -0,0 +1,184 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include <stdio.h>
+#include <gtest/gtest.h>
+#include <ArduinoJson.h>
+
+#if ARDUINOJSON_OBJECT_INDEX_THRESHOLD
+
+// enough keys for the table to grow a few times
+const int COUNT = 200;
+
+class JsonObject_Index_Tests : public ::testing::Test {
+ public:
+  JsonObject_Index_Tests() : _object(_jsonBuffer.createObject()) {}
+
+ protected:
+  const char* keyOf(int i) {
+    sprintf(_keys[i], "key%d", i);
+    return _keys[i];
+  }
+
+  void addKeys(int count) {
+    for (int i = 0; i < count; i++) _object[keyOf(i)] = i;
+  }
+
+  DynamicJsonBuffer _jsonBuffer;
+  JsonObject& _object;
+  char _keys[COUNT][8];
+};
+
+TEST_F(JsonObject_Index_Tests, SmallObjectUsesNoMoreMemory) {
+  addKeys(ARDUINOJSON_OBJECT_INDEX_THRESHOLD);
+
+  EXPECT_EQ(JSON_OBJECT_SIZE(ARDUINOJSON_OBJECT_INDEX_THRESHOLD),
+            _jsonBuffer.size());
+}
+
+TEST_F(JsonObject_Index_Tests, LookupsUseNoMemory) {
+  addKeys(ARDUINOJSON_OBJECT_INDEX_THRESHOLD);
+  size_t size = _jsonBuffer.size();
+
+  for (int i = 0; i < COUNT; i++) _object.containsKey(keyOf(i));
+  EXPECT_FALSE(_object.containsKey("missing"));
+
+  EXPECT_EQ(size, _jsonBuffer.size());
+}
+
+TEST_F(JsonObject_Index_Tests, NextKeyDoesntGrowTheIndex) {
+  addKeys(ARDUINOJSON_OBJECT_INDEX_THRESHOLD + 1);
+  size_t size = _jsonBuffer.size();
+
+  _object["new"] = 42;
+
+  EXPECT_EQ(size + JSON_OBJECT_SIZE(1) - JSON_OBJECT_SIZE(0),
+            _jsonBuffer.size());
+}
+
+TEST_F(JsonObject_Index_Tests, MemoryStaysWithinTheDocumentedBound) {
+  for (int i = 1; i <= COUNT; i++) {
+    _object[keyOf(i - 1)] = i;
+    size_t bound = JSON_OBJECT_SIZE(i) + (5 + 8 * (i + 1)) * sizeof(void*);
+    ASSERT_GE(bound, _jsonBuffer.size()) << i;
+  }
+}
+
+TEST_F(JsonObject_Index_Tests, StaticJsonBufferHasNoIndex) {
+  StaticJsonBuffer<JSON_OBJECT_SIZE(COUNT)> buffer;
+  JsonObject& object = buffer.createObject();
+
+  for (int i = 0; i < COUNT; i++) ASSERT_TRUE(object.set(keyOf(i), i));
+
+  EXPECT_EQ(buffer.capacity(), buffer.size());
+  for (int i = 0; i < COUNT; i++) EXPECT_EQ(i, object[keyOf(i)].as<int>());
+}
+
+TEST_F(JsonObject_Index_Tests, FindsEveryKey) {
+  addKeys(COUNT);
+
+  EXPECT_EQ(COUNT, _object.size());
+  for (int i = 0; i < COUNT; i++) EXPECT_EQ(i, _object[keyOf(i)].as<int>());
+  EXPECT_FALSE(_object.containsKey("missing"));
+}
+
+TEST_F(JsonObject_Index_Tests, ReplacesValues) {
+  addKeys(COUNT);
+  for (int i = 0; i < COUNT; i++) _object[keyOf(i)] = -i;
+
+  EXPECT_EQ(COUNT, _object.size());
+  for (int i = 0; i < COUNT; i++) EXPECT_EQ(-i, _object[keyOf(i)].as<int>());
+}
+
+TEST_F(JsonObject_Index_Tests, KeepsTheOrder) {
+  addKeys(COUNT);
+
+  int i = 0;
+  for (JsonObject::iterator it = _object.begin(); it != _object.end(); ++it)
+    EXPECT_STREQ(keyOf(i++), it->key);
+  EXPECT_EQ(COUNT, i);
+}
+
+TEST_F(JsonObject_Index_Tests, Remove) {
+  addKeys(COUNT);
+  for (int i = 0; i < COUNT; i += 2) _object.remove(keyOf(i));
+
+  EXPECT_EQ(COUNT / 2, _object.size());
+  for (int i = 0; i < COUNT; i++)
+    EXPECT_EQ(i % 2 == 1, _object.containsKey(keyOf(i)));
+}
+
+TEST_F(JsonObject_Index_Tests, RemoveLastThenAdd) {
+  addKeys(COUNT);
+  _object.remove(keyOf(COUNT - 1));
+  _object["new"] = 42;
+
+  EXPECT_EQ(COUNT, _object.size());
+  EXPECT_FALSE(_object.containsKey(keyOf(COUNT - 1)));
+  EXPECT_EQ(42, _object["new"]);
+  const char* lastKey = NULL;
+  for (JsonObject::iterator it = _object.begin(); it != _object.end(); ++it)
+    lastKey = it->key;
+  EXPECT_STREQ("new", lastKey);
+}
+
+TEST_F(JsonObject_Index_Tests, RemoveAllThenAdd) {
+  addKeys(COUNT);
+  for (int i = 0; i < COUNT; i++) _object.remove(keyOf(i));
+  EXPECT_EQ(0, _object.size());
+
+  _object["new"] = 42;
+  EXPECT_EQ(1, _object.size());
+  EXPECT_EQ(42, _object["new"]);
+}
+
+TEST_F(JsonObject_Index_Tests, ParsedObject) {
+  char json[] =
+      "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8,\"i\":9,"
+      "\"j\":10,\"k\":11,\"l\":12,\"m\":13,\"n\":14,\"o\":15,\"p\":16,"
+      "\"q\":17,\"r\":18,\"s\":19,\"t\":20,\"a\":21}";
+
+  JsonObject& object = _jsonBuffer.parseObject(json);
+
+  ASSERT_TRUE(object.success());
+  EXPECT_EQ(20, object.size());
+  EXPECT_EQ(21, object["a"]);
+  EXPECT_EQ(20, object["t"]);
+}
+
+// Gives a single block of memory
+class SingleBlockAllocator {
+ public:
+  SingleBlockAllocator() : _given(false) {}
+
+  void* allocate(size_t size) {
+    if (_given) return NULL;
+    _given = true;
+    return malloc(size);
+  }
+  void deallocate(void* pointer) { free(pointer); }
+
+ private:
+  bool _given;
+};
+
+TEST_F(JsonObject_Index_Tests, NoRoomForTheIndex) {
+  const int count = ARDUINOJSON_OBJECT_INDEX_THRESHOLD + 1;
+  Internals::BlockJsonBuffer<SingleBlockAllocator> buffer(
+      JSON_OBJECT_SIZE(count));
+  JsonObject& object = buffer.createObject();
+
+  // the nodes fit in the only block, the index doesn't
+  int added = 0;
+  while (added < COUNT && object.set(keyOf(added), added)) added++;
+
+  EXPECT_EQ(count, added);
+  EXPECT_EQ(JSON_OBJECT_SIZE(added), buffer.size());
+  for (int i = 0; i < added; i++) EXPECT_EQ(i, object[keyOf(i)].as<int>());
+}
+
+#endif
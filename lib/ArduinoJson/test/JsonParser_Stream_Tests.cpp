@@ -0,0 +1,196 @@
+// Copyright Benoit Blanchon 2014-2016
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+// If you like this project, please add a star!
+
+#include <sstream>
+#include <gtest/gtest.h>
+#include <ArduinoJson.h>
+
+class JsonParser_Stream_Tests : public testing::Test {
+ protected:
+  void whenInputIs(const char *json) { _stream.str(json); }
+
+  JsonObject &parseObject(JsonBuffer &buffer, uint8_t nesting = 10) {
+    return buffer.parseObject(_stream, nesting);
+  }
+
+  JsonArray &parseArray(JsonBuffer &buffer, uint8_t nesting = 10) {
+    return buffer.parseArray(_stream, nesting);
+  }
+
+  std::string remainingInput() {
+    return _stream.str().substr(static_cast<size_t>(_stream.tellg()));
+  }
+
+  std::istringstream _stream;
+};
+
+// A Stream that counts the bytes read
+class CountingStream : public Stream {
+ public:
+  explicit CountingStream(const char *json) : _json(json), _read(0) {}
+
+  virtual int read() {
+    if (!_json[_read]) return -1;
+    return _json[_read++];
+  }
+
+  size_t bytesRead() const { return _read; }
+
+ private:
+  const char *_json;
+  size_t _read;
+};
+
+TEST_F(JsonParser_Stream_Tests, Object) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("{\"key1\":\"value1\",\"key2\":42,\"key3\":true}");
+
+  JsonObject &object = parseObject(jsonBuffer);
+
+  ASSERT_TRUE(object.success());
+  EXPECT_EQ(3, object.size());
+  EXPECT_STREQ("value1", object["key1"]);
+  EXPECT_EQ(42, object["key2"].as<int>());
+  EXPECT_TRUE(object["key3"].as<bool>());
+}
+
+TEST_F(JsonParser_Stream_Tests, Array) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("[1, 2.5, 'three', null]");
+
+  JsonArray &array = parseArray(jsonBuffer);
+
+  ASSERT_TRUE(array.success());
+  EXPECT_EQ(4, array.size());
+  EXPECT_EQ(1, array[0].as<int>());
+  EXPECT_DOUBLE_EQ(2.5, array[1].as<double>());
+  EXPECT_STREQ("three", array[2]);
+  EXPECT_EQ(NULL, array[3].as<const char *>());
+}
+
+TEST_F(JsonParser_Stream_Tests, NestedWithSpacesAndComments) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs(
+      " /* a */ {\n"
+      "  \"a\" : [ 1 , { \"b\" : 2 } ], // c\n"
+      "  \"d\" : { }\n"
+      "}");
+
+  JsonObject &object = parseObject(jsonBuffer);
+
+  ASSERT_TRUE(object.success());
+  EXPECT_EQ(2, object["a"][1]["b"].as<int>());
+  EXPECT_EQ(0, object["d"].asObject().size());
+}
+
+TEST_F(JsonParser_Stream_Tests, EscapedChars) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("[\"1\\\"2\\\\3\\/4\\b5\\f6\\n7\\r8\\t9\"]");
+
+  JsonArray &array = parseArray(jsonBuffer);
+
+  ASSERT_TRUE(array.success());
+  EXPECT_STREQ("1\"2\\3/4\b5\f6\n7\r8\t9", array[0]);
+}
+
+TEST_F(JsonParser_Stream_Tests, LongString) {
+  DynamicJsonBuffer jsonBuffer;
+  std::string value(1000, 'x');
+  std::string json = "{\"key\":\"" + value + "\"}";
+  whenInputIs(json.c_str());
+
+  JsonObject &object = parseObject(jsonBuffer);
+
+  ASSERT_TRUE(object.success());
+  EXPECT_EQ(value, object["key"].as<const char *>());
+}
+
+TEST_F(JsonParser_Stream_Tests, DoesntReadPastTheEnd) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("{\"a\":1} [2]");
+
+  ASSERT_TRUE(parseObject(jsonBuffer).success());
+  EXPECT_EQ(" [2]", remainingInput());
+  ASSERT_TRUE(parseArray(jsonBuffer).success());
+}
+
+TEST_F(JsonParser_Stream_Tests, ArduinoStream) {
+  DynamicJsonBuffer jsonBuffer;
+  CountingStream stream("{\"hello\":\"world\"}garbage");
+
+  JsonObject &object = jsonBuffer.parseObject(stream);
+
+  ASSERT_TRUE(object.success());
+  EXPECT_STREQ("world", object["hello"]);
+  EXPECT_EQ(17, stream.bytesRead());
+}
+
+TEST_F(JsonParser_Stream_Tests, OnlyStringsAreCopied) {
+  std::string value(1000, 'x');
+  std::string json = "{\"key\":\"" + value + "\"}";
+  whenInputIs(json.c_str());
+  StaticJsonBuffer<2000> fromStream;
+  StaticJsonBuffer<2000> fromString;
+
+  ASSERT_TRUE(parseObject(fromStream).success());
+  ASSERT_TRUE(fromString.parseObject(json.c_str()).success());
+
+  // no more than parsing a copy of the input, which isn't needed at all
+  EXPECT_LE(fromStream.size(), fromString.size());
+}
+
+TEST_F(JsonParser_Stream_Tests, TooSmallBuffer) {
+  StaticJsonBuffer<JSON_OBJECT_SIZE(1)> jsonBuffer;
+  whenInputIs("{\"key\":\"value\"}");
+
+  EXPECT_FALSE(parseObject(jsonBuffer).success());
+}
+
+TEST_F(JsonParser_Stream_Tests, NestingLimit) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("[[[]]]");
+  EXPECT_FALSE(parseArray(jsonBuffer, 1).success());
+
+  whenInputIs("[[[]]]");
+  _stream.clear();
+  EXPECT_TRUE(parseArray(jsonBuffer, 2).success());
+}
+
+TEST_F(JsonParser_Stream_Tests, Invalid) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("{\"key\" / 1}");
+  EXPECT_FALSE(parseObject(jsonBuffer).success());
+
+  whenInputIs("[1,2");
+  _stream.clear();
+  EXPECT_FALSE(parseArray(jsonBuffer).success());
+
+  whenInputIs("");
+  _stream.clear();
+  EXPECT_FALSE(parseObject(jsonBuffer).success());
+}
+
+TEST_F(JsonParser_Stream_Tests, LoneSlash) {
+  DynamicJsonBuffer jsonBuffer;
+  whenInputIs("[/]");
+  EXPECT_FALSE(parseArray(jsonBuffer).success());
+}
+
+TEST_F(JsonParser_Stream_Tests, SameResultAsString) {
+  const char *inputs[] = {"[1,/*a*/2]", "[,]", "{a:b}", "[\"a\" 1]",
+                          "{\"a\":}", "[[]", "['\\u']", "[1]//x"};
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    DynamicJsonBuffer jsonBuffer;
+    char json[32];
+    strcpy(json, inputs[i]);
+    whenInputIs(inputs[i]);
+    _stream.clear();
+    EXPECT_EQ(jsonBuffer.parseArray(json).success(),
+              parseArray(jsonBuffer).success())
+        << inputs[i];
+  }
+}
@@ -0,0 +1,205 @@
+/*
+ MQTTOutboundQueue.cpp - Holds encoded PUBLISH packets while the client is
+ disconnected.
+*/
+
+#include "MQTTOutboundQueue.h"
+#include "MQTTVarint.h"
+#include "PubSubClient.h"
+
+#if MQTT_VERSION == MQTT_VERSION_5
+// An empty property list follows the topic
+#define MQTT_QUEUE_PROPERTIES 1
+#else
+#define MQTT_QUEUE_PROPERTIES 0
+#endif
+
+MQTTOutboundQueue::MQTTOutboundQueue(uint8_t* storage, uint16_t size) {
+    this->storage = storage;
+    this->capacity = size;
+    this->_dropped = 0;
+    this->_coalesced = 0;
+    clear();
+}
+
+void MQTTOutboundQueue::clear() {
+    this->head = 0;
+    this->tail = 0;
+    this->first = 0;
+    this->count = 0;
+    this->live = 0;
+}
+
+boolean MQTTOutboundQueue::push(uint8_t header, const char* topic, const uint8_t* payload, unsigned int plength, boolean latestOnly) {
+    if (header & 0x06) {
+        // Only QoS 0 packets can be queued; others need a session packet id
+        return false;
+    }
+    uint16_t tlen = strlen(topic);
+    uint8_t lenBuf[MQTT_VARINT_MAX_BYTES];
+    uint8_t llen = MQTTVarint::encode(2 + (uint32_t)tlen + MQTT_QUEUE_PROPERTIES + plength,lenBuf);
+    uint32_t total = 1 + llen + 2 + (uint32_t)tlen + MQTT_QUEUE_PROPERTIES + plength;
+    if (llen == 0 || total > this->capacity) {
+        this->_dropped++;
+        return false;
+    }
+
+    uint8_t* p = NULL;
+    MQTTQueuedPacket* old = latestOnly?findLatest(topic,tlen):NULL;
+    if (old) {
+        this->_coalesced++;
+        if (old->length == total) {
+            p = this->storage+old->start;
+        } else {
+            old->flags |= MQTT_QUEUE_DEAD;
+            this->live--;
+        }
+    }
+    if (!p) {
+        p = reserve(total);
+        if (!p) {
+            this->_dropped++;
+            return false;
+        }
+        if (latestOnly) {
+            this->entries[(this->first+this->count-1)%MQTT_OUTBOUND_QUEUE_ENTRIES].flags = MQTT_QUEUE_LATEST_ONLY;
+        }
+    }
+
+    *p++ = header;
+    for (uint8_t i=0;i<llen;i++) {
+        *p++ = lenBuf[i];
+    }
+    *p++ = (tlen >> 8);
+    *p++ = (tlen & 0xFF);
+    memcpy(p,topic,tlen);
+    p += tlen;
+#if MQTT_VERSION == MQTT_VERSION_5
+    *p++ = 0;
+#endif
+    memcpy(p,payload,plength);
+    return true;
+}
+
+// Finds room for length bytes at the tail, dropping the oldest packets
+// until it fits, and records a new entry for it.
+uint8_t* MQTTOutboundQueue::reserve(uint16_t length) {
+    while (true) {
+        if (this->count < MQTT_OUTBOUND_QUEUE_ENTRIES) {
+            uint16_t at = this->capacity;
+            if (this->count == 0) {
+                this->head = this->tail = 0;
+                at = 0;
+            } else if (this->tail > this->head) {
+                if (this->capacity - this->tail >= length) {
+                    at = this->tail;
+                } else if (this->head >= length) {
+                    // Wrap, leaving the end of the storage unused
+                    at = 0;
+                }
+            } else if (this->tail < this->head) {
+                if (this->head - this->tail >= length) {
+                    at = this->tail;
+                }
+            }
+            if (at != this->capacity) {
+                MQTTQueuedPacket* entry = &this->entries[(this->first+this->count)%MQTT_OUTBOUND_QUEUE_ENTRIES];
+                entry->start = at;
+                entry->length = length;
+                entry->flags = 0;
+                this->count++;
+                this->live++;
+                this->tail = at+length;
+                return this->storage+at;
+            }
+        }
+        if (this->count == 0) {
+            return NULL;
+        }
+        if (!(this->entries[this->first].flags & MQTT_QUEUE_DEAD)) {
+            this->_dropped++;
+        }
+        popFirst();
+    }
+}
+
+MQTTQueuedPacket* MQTTOutboundQueue::findLatest(const char* topic, uint16_t tlen) {
+    for (uint8_t i=0;i<this->count;i++) {
+        MQTTQueuedPacket* entry = &this->entries[(this->first+i)%MQTT_OUTBOUND_QUEUE_ENTRIES];
+        if (entry->flags != MQTT_QUEUE_LATEST_ONLY) {
+            continue;
+        }
+        const uint8_t* p = this->storage+entry->start+1;
+        while (*p++ & 0x80) {
+        }
+        if ((p[0]<<8)+p[1] == tlen && memcmp(p+2,topic,tlen) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void MQTTOutboundQueue::popFirst() {
+    if (!(this->entries[this->first].flags & MQTT_QUEUE_DEAD)) {
+        this->live--;
+    }
+    this->first = (this->first+1)%MQTT_OUTBOUND_QUEUE_ENTRIES;
+    this->count--;
+    if (this->count == 0) {
+        this->head = this->tail = 0;
+    } else {
+        this->head = this->entries[this->first].start;
+    }
+}
+
+uint16_t MQTTOutboundQueue::peek(const uint8_t** data) {
+    while (this->count > 0 && (this->entries[this->first].flags & MQTT_QUEUE_DEAD)) {
+        popFirst();
+    }
+    if (this->count == 0) {
+        return 0;
+    }
+    uint16_t start = this->entries[this->first].start;
+    uint16_t length = this->entries[this->first].length;
+    for (uint8_t i=1;i<this->count;i++) {
+        MQTTQueuedPacket* entry = &this->entries[(this->first+i)%MQTT_OUTBOUND_QUEUE_ENTRIES];
+        if ((entry->flags & MQTT_QUEUE_DEAD) || entry->start != start+length) {
+            break;
+        }
+        length += entry->length;
+    }
+    *data = this->storage+start;
+    return length;
+}
+
+void MQTTOutboundQueue::pop(uint16_t length) {
+    while (this->count > 0 && length > 0) {
+        uint16_t entryLength = this->entries[this->first].length;
+        length -= (entryLength < length)?entryLength:length;
+        popFirst();
+    }
+}
+
+boolean MQTTOutboundQueue::empty() {
+    return this->live == 0;
+}
+
+uint8_t MQTTOutboundQueue::depth() {
+    return this->live;
+}
+
+uint16_t MQTTOutboundQueue::size() {
+    uint16_t used = 0;
+    for (uint8_t i=0;i<this->count;i++) {
+        used += this->entries[(this->first+i)%MQTT_OUTBOUND_QUEUE_ENTRIES].length;
+    }
+    return used;
+}
+
+uint32_t MQTTOutboundQueue::dropped() {
+    return this->_dropped;
+}
+
+uint32_t MQTTOutboundQueue::coalesced() {
+    return this->_coalesced;
+}
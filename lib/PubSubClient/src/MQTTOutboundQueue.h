@@ -0,0 +1,66 @@
+/*
+ MQTTOutboundQueue.h - Holds encoded PUBLISH packets while the client is
+ disconnected.
+*/
+
+#ifndef MQTTOutboundQueue_h
+#define MQTTOutboundQueue_h
+
+#include <Arduino.h>
+
+// MQTT_OUTBOUND_QUEUE_ENTRIES : Maximum number of packets held by a queue,
+//  whatever the size of its storage. Each entry costs 6 bytes of RAM.
+#ifndef MQTT_OUTBOUND_QUEUE_ENTRIES
+#define MQTT_OUTBOUND_QUEUE_ENTRIES 16
+#endif
+
+#define MQTT_QUEUE_LATEST_ONLY 0x01
+#define MQTT_QUEUE_DEAD        0x02
+
+typedef struct {
+   uint16_t start;
+   uint16_t length;
+   uint8_t flags;
+} MQTTQueuedPacket;
+
+// A ring of encoded QoS 0 PUBLISH packets kept in caller supplied storage.
+// Packets are never split across the end of the storage, so consecutive
+// packets can be written out with a single call. When space runs out the
+// oldest packets are dropped.
+class MQTTOutboundQueue {
+private:
+   uint8_t* storage;
+   uint16_t capacity;
+   uint16_t head;
+   uint16_t tail;
+   MQTTQueuedPacket entries[MQTT_OUTBOUND_QUEUE_ENTRIES];
+   uint8_t first;
+   uint8_t count;
+   uint8_t live;
+   uint32_t _dropped;
+   uint32_t _coalesced;
+   uint8_t* reserve(uint16_t length);
+   MQTTQueuedPacket* findLatest(const char* topic, uint16_t tlen);
+   void popFirst();
+public:
+   MQTTOutboundQueue(uint8_t* storage, uint16_t size);
+
+   // Encodes and stores a PUBLISH packet. With latestOnly set, a queued
+   // latest-only packet for the same topic is replaced; the copy is made in
+   // place when the new packet has the same size.
+   boolean push(uint8_t header, const char* topic, const uint8_t* payload, unsigned int plength, boolean latestOnly);
+
+   // Returns the oldest run of packets stored back to back and their total
+   // length; the run is removed once it has been written with pop().
+   uint16_t peek(const uint8_t** data);
+   void pop(uint16_t length);
+   void clear();
+
+   boolean empty();
+   uint8_t depth();
+   uint16_t size();
+   uint32_t dropped();
+   uint32_t coalesced();
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ MQTTPacketDecoder.cpp - Splits a stream of MQTT bytes into packets, however
+ the bytes arrive.
+*/
+
+#include "MQTTPacketDecoder.h"
+
+#define MQTT_DECODER_HEADER    0
+#define MQTT_DECODER_LENGTH    1
+#define MQTT_DECODER_BODY      2
+#define MQTT_DECODER_READY     3
+#define MQTT_DECODER_MALFORMED 4
+
+MQTTPacketDecoder::MQTTPacketDecoder(uint8_t* buffer, uint32_t size) {
+    this->buffer = buffer;
+    this->size = size;
+    this->_dropped = 0;
+    reset();
+}
+
+void MQTTPacketDecoder::reset() {
+    state = MQTT_DECODER_HEADER;
+    varint.reset();
+    received = 0;
+    remaining = 0;
+    skipping = false;
+}
+
+uint32_t MQTTPacketDecoder::push(const uint8_t* data, uint32_t length) {
+    uint32_t used = 0;
+    if (state == MQTT_DECODER_READY) {
+        reset();
+    }
+    while (used < length) {
+        if (state == MQTT_DECODER_HEADER) {
+            // Keep the header even when skipping, so needed() stays small
+            buffer[0] = data[used++];
+            received = 1;
+            state = MQTT_DECODER_LENGTH;
+        } else if (state == MQTT_DECODER_LENGTH) {
+            uint8_t digit = data[used++];
+            if (received < size) {
+                buffer[received] = digit;
+            }
+            received++;
+            int8_t rc = varint.push(digit);
+            if (rc == MQTT_VARINT_MALFORMED) {
+                state = MQTT_DECODER_MALFORMED;
+                return used;
+            }
+            if (rc > 0) {
+                remaining = varint.value();
+                headerLength = received;
+                skipping = (received+remaining > size);
+                state = MQTT_DECODER_BODY;
+                if (remaining == 0) {
+                    if (complete()) {
+                        return used;
+                    }
+                }
+            }
+        } else if (state == MQTT_DECODER_BODY) {
+            uint32_t n = length-used;
+            if (n > remaining) {
+                n = remaining;
+            }
+            if (!skipping) {
+                memcpy(buffer+received,data+used,n);
+            }
+            received += n;
+            remaining -= n;
+            used += n;
+            if (remaining == 0) {
+                if (complete()) {
+                    return used;
+                }
+            }
+        } else {
+            return used;
+        }
+    }
+    return used;
+}
+
+// Finishes the packet in the buffer. Returns true if it is ready, or false
+// if it was skipped or malformed.
+boolean MQTTPacketDecoder::complete() {
+    if (skipping) {
+        _dropped++;
+        reset();
+        return false;
+    }
+    _packet.type = buffer[0]&0xF0;
+    _packet.flags = buffer[0]&0x0F;
+    _packet.data = buffer;
+    _packet.length = received;
+    _packet.headerLength = headerLength;
+    _packet.topic = NULL;
+    _packet.topicLength = 0;
+    _packet.msgId = 0;
+    _packet.payload = NULL;
+    _packet.payloadLength = 0;
+    if (_packet.type == 0x30) { // PUBLISH
+        uint32_t pos = _packet.headerLength;
+        if (received < pos+2) {
+            state = MQTT_DECODER_MALFORMED;
+            return false;
+        }
+        _packet.topicLength = (buffer[pos]<<8)+buffer[pos+1];
+        _packet.topic = (const char*)buffer+pos+2;
+        pos += 2+_packet.topicLength;
+        if (_packet.flags&0x06) {
+            if (received >= pos+2) {
+                _packet.msgId = (buffer[pos]<<8)+buffer[pos+1];
+            }
+            pos += 2;
+        }
+        if (pos > received) {
+            state = MQTT_DECODER_MALFORMED;
+            return false;
+        }
+        _packet.payload = buffer+pos;
+        _packet.payloadLength = received-pos;
+    }
+    state = MQTT_DECODER_READY;
+    return true;
+}
+
+uint32_t MQTTPacketDecoder::needed() {
+    switch (state) {
+    case MQTT_DECODER_BODY:
+        return remaining;
+    case MQTT_DECODER_MALFORMED:
+        return 0;
+    }
+    return 1;
+}
+
+boolean MQTTPacketDecoder::ready() {
+    return state == MQTT_DECODER_READY;
+}
+
+const MQTTPacket& MQTTPacketDecoder::packet() {
+    return _packet;
+}
+
+boolean MQTTPacketDecoder::malformed() {
+    return state == MQTT_DECODER_MALFORMED;
+}
+
+uint32_t MQTTPacketDecoder::dropped() {
+    return _dropped;
+}
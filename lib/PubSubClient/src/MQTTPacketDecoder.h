@@ -0,0 +1,65 @@
+/*
+ MQTTPacketDecoder.h - Splits a stream of MQTT bytes into packets, however
+ the bytes arrive.
+*/
+
+#ifndef MQTTPacketDecoder_h
+#define MQTTPacketDecoder_h
+
+#include <Arduino.h>
+#include "MQTTVarint.h"
+
+// A complete packet. Everything points into the decoder's buffer and is
+// only valid until the next call to push().
+typedef struct {
+   uint8_t type;
+   uint8_t flags;
+   // The whole packet, fixed header included
+   const uint8_t* data;
+   uint32_t length;
+   uint8_t headerLength;
+   // PUBLISH only. The topic is not null-terminated. With MQTT 5 the
+   // payload starts with the properties.
+   const char* topic;
+   uint16_t topicLength;
+   uint16_t msgId;
+   const uint8_t* payload;
+   uint32_t payloadLength;
+} MQTTPacket;
+
+// Decodes packets from byte slices of any size, keeping its place between
+// calls, so it never has to wait for the rest of a packet. Packets that
+// don't fit in the buffer are skipped and counted.
+class MQTTPacketDecoder {
+private:
+   uint8_t* buffer;
+   uint32_t size;
+   uint8_t state;
+   MQTTVarint varint;
+   uint32_t received;
+   uint32_t remaining;
+   uint8_t headerLength;
+   boolean skipping;
+   uint32_t _dropped;
+   MQTTPacket _packet;
+   boolean complete();
+public:
+   MQTTPacketDecoder(uint8_t* buffer, uint32_t size);
+
+   // Takes up to length bytes and returns how many were used. It stops at
+   // the end of each packet, so that the packet can be handled before the
+   // rest is pushed.
+   uint32_t push(const uint8_t* data, uint32_t length);
+   // Bytes still needed to finish the field or packet being decoded.
+   // Pushing no more than this never reads past the end of a packet.
+   uint32_t needed();
+   void reset();
+
+   boolean ready();
+   const MQTTPacket& packet();
+   // True once the stream is beyond decoding; reset() starts again
+   boolean malformed();
+   uint32_t dropped();
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ MQTTPacketIdWindow.cpp - Remembers recently seen message ids, to recognise
+ redelivered messages.
+*/
+
+#include "MQTTPacketIdWindow.h"
+
+#if MQTT_DEDUP_WINDOW > 0
+
+// Bit n of the window stands for the id n below the newest one
+#define MQTT_DEDUP_BITS (MQTT_DEDUP_WORDS*32)
+
+MQTTPacketIdWindow::MQTTPacketIdWindow() {
+    reset();
+}
+
+void MQTTPacketIdWindow::reset() {
+    memset(this->bits,0,sizeof(this->bits));
+    this->newest = 0;
+    this->empty = true;
+}
+
+boolean MQTTPacketIdWindow::contains(uint16_t msgId) {
+    uint16_t behind = this->newest-msgId;
+    if (this->empty || behind >= MQTT_DEDUP_BITS) {
+        return false;
+    }
+    return (this->bits[behind/32] >> (behind%32)) & 1;
+}
+
+void MQTTPacketIdWindow::add(uint16_t msgId) {
+    uint16_t ahead = msgId-this->newest;
+    if (this->empty) {
+        this->empty = false;
+        this->newest = msgId;
+    } else if (ahead != 0 && ahead < 0x8000) {
+        // Ids wrap, so anything less than half the id space ahead is newer
+        slide(ahead);
+        this->newest = msgId;
+    }
+    uint16_t behind = this->newest-msgId;
+    if (behind < MQTT_DEDUP_BITS) {
+        this->bits[behind/32] |= 1UL << (behind%32);
+    }
+}
+
+// Moves every bit count places further back, dropping the oldest
+void MQTTPacketIdWindow::slide(uint16_t count) {
+    if (count >= MQTT_DEDUP_BITS) {
+        memset(this->bits,0,sizeof(this->bits));
+        return;
+    }
+    uint8_t words = count/32;
+    uint8_t shift = count%32;
+    for (int8_t i = MQTT_DEDUP_WORDS-1; i >= 0; i--) {
+        uint32_t value = 0;
+        if (i >= words) {
+            value = this->bits[i-words] << shift;
+            if (shift && i > words) {
+                value |= this->bits[i-words-1] >> (32-shift);
+            }
+        }
+        this->bits[i] = value;
+    }
+}
+#endif
@@ -0,0 +1,39 @@
+/*
+ MQTTPacketIdWindow.h - Remembers recently seen message ids, to recognise
+ redelivered messages.
+*/
+
+#ifndef MQTTPacketIdWindow_h
+#define MQTTPacketIdWindow_h
+
+#include <Arduino.h>
+
+// MQTT_DEDUP_WINDOW : Number of inbound QoS 1 message ids, counting back from
+//  the newest, that are remembered to drop redelivered messages. Rounded up
+//  to a multiple of 32; each 32 costs 4 bytes of RAM. 0 turns it off.
+#ifndef MQTT_DEDUP_WINDOW
+#define MQTT_DEDUP_WINDOW 32
+#endif
+
+#if MQTT_DEDUP_WINDOW > 0
+#define MQTT_DEDUP_WORDS ((MQTT_DEDUP_WINDOW+31)/32)
+
+// A sliding bitmap of the ids just below the newest one seen. Servers hand
+// out message ids in sequence, so a window a few dozen ids wide covers the
+// messages that can still be in flight; ids that have slid out of it are
+// never reported as seen. Lookups and additions take constant time.
+class MQTTPacketIdWindow {
+private:
+   uint32_t bits[MQTT_DEDUP_WORDS];
+   uint16_t newest;
+   boolean empty;
+   void slide(uint16_t count);
+public:
+   MQTTPacketIdWindow();
+   void reset();
+   boolean contains(uint16_t msgId);
+   void add(uint16_t msgId);
+};
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ MQTTProperties.cpp - Reads and writes MQTT 5 properties.
+*/
+
+#include "MQTTProperties.h"
+#include "MQTTVarint.h"
+
+MQTTProperties::MQTTProperties(const uint8_t* buf, uint32_t length) {
+    this->buf = buf;
+    this->length = length;
+    this->pos = 0;
+    this->_id = 0;
+    this->_value = 0;
+    this->_data = NULL;
+    this->_dataLength = 0;
+    this->_malformed = false;
+}
+
+boolean MQTTProperties::readString(const uint8_t** data, uint16_t* length) {
+    if (this->pos+2 > this->length) {
+        return false;
+    }
+    *length = (this->buf[this->pos]<<8)+this->buf[this->pos+1];
+    this->pos += 2;
+    if (this->pos+*length > this->length) {
+        return false;
+    }
+    *data = this->buf+this->pos;
+    this->pos += *length;
+    return true;
+}
+
+boolean MQTTProperties::next() {
+    if (this->_malformed || this->pos >= this->length) {
+        return false;
+    }
+    this->_id = this->buf[this->pos++];
+    this->_value = 0;
+    this->_data = NULL;
+    this->_dataLength = 0;
+    uint32_t left = this->length-this->pos;
+    const uint8_t* p = this->buf+this->pos;
+    boolean ok = true;
+    switch (this->_id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+        ok = left >= 1;
+        if (ok) {
+            this->_value = p[0];
+            this->pos += 1;
+        }
+        break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+        ok = left >= 2;
+        if (ok) {
+            this->_value = (p[0]<<8)+p[1];
+            this->pos += 2;
+        }
+        break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+        ok = left >= 4;
+        if (ok) {
+            this->_value = ((uint32_t)p[0]<<24)+((uint32_t)p[1]<<16)+(p[2]<<8)+p[3];
+            this->pos += 4;
+        }
+        break;
+    case 0x0B: {
+        int8_t rc = MQTTVarint::decode(p,left>MQTT_VARINT_MAX_BYTES?MQTT_VARINT_MAX_BYTES:left,&this->_value);
+        ok = rc > 0;
+        if (ok) {
+            this->pos += rc;
+        }
+        break;
+    }
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+        ok = readString(&this->_data,&this->_dataLength);
+        break;
+    case 0x26: {
+        // User property: a name and a value
+        const uint8_t* value;
+        uint16_t valueLength;
+        ok = readString(&this->_data,&this->_dataLength) && readString(&value,&valueLength);
+        break;
+    }
+    default:
+        ok = false;
+    }
+    if (!ok) {
+        this->_malformed = true;
+    }
+    return ok;
+}
+
+boolean MQTTProperties::malformed() {
+    return this->_malformed;
+}
+
+uint8_t MQTTProperties::id() {
+    return this->_id;
+}
+
+uint32_t MQTTProperties::value() {
+    return this->_value;
+}
+
+const uint8_t* MQTTProperties::data() {
+    return this->_data;
+}
+
+uint16_t MQTTProperties::dataLength() {
+    return this->_dataLength;
+}
+
+uint16_t MQTTProperties::writeByte(uint8_t* buf, uint16_t pos, uint8_t id, uint8_t value) {
+    buf[pos++] = id;
+    buf[pos++] = value;
+    return pos;
+}
+
+uint16_t MQTTProperties::writeUint16(uint8_t* buf, uint16_t pos, uint8_t id, uint16_t value) {
+    buf[pos++] = id;
+    buf[pos++] = (value >> 8);
+    buf[pos++] = (value & 0xFF);
+    return pos;
+}
+
+uint16_t MQTTProperties::writeUint32(uint8_t* buf, uint16_t pos, uint8_t id, uint32_t value) {
+    buf[pos++] = id;
+    buf[pos++] = (value >> 24);
+    buf[pos++] = (value >> 16) & 0xFF;
+    buf[pos++] = (value >> 8) & 0xFF;
+    buf[pos++] = (value & 0xFF);
+    return pos;
+}
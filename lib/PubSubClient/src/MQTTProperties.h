@@ -0,0 +1,54 @@
+/*
+ MQTTProperties.h - Reads and writes MQTT 5 properties.
+*/
+
+#ifndef MQTTProperties_h
+#define MQTTProperties_h
+
+#include <Arduino.h>
+
+// Property identifiers used by the client
+#define MQTT_PROP_SESSION_EXPIRY      0x11
+#define MQTT_PROP_RECEIVE_MAXIMUM     0x21
+#define MQTT_PROP_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTT_PROP_TOPIC_ALIAS         0x23
+#define MQTT_PROP_MAXIMUM_PACKET_SIZE 0x27
+#define MQTT_PROP_REASON_STRING       0x1F
+
+// Reason codes sent by the client
+#define MQTT_REASON_QUOTA_EXCEEDED    0x97
+
+// Walks the properties of a packet. Call next() before reading the first
+// property; integer properties are read with value(), strings and binary
+// data with data() and dataLength(). For a user property, data() is the
+// name and the value follows it in the packet.
+class MQTTProperties {
+private:
+   const uint8_t* buf;
+   uint32_t length;
+   uint32_t pos;
+   uint8_t _id;
+   uint32_t _value;
+   const uint8_t* _data;
+   uint16_t _dataLength;
+   boolean _malformed;
+   boolean readString(const uint8_t** data, uint16_t* length);
+public:
+   MQTTProperties(const uint8_t* buf, uint32_t length);
+
+   // Moves to the next property. Returns false at the end of the
+   // properties or if they are malformed.
+   boolean next();
+   boolean malformed();
+   uint8_t id();
+   uint32_t value();
+   const uint8_t* data();
+   uint16_t dataLength();
+
+   // Append a property to buf at pos and return the new position
+   static uint16_t writeByte(uint8_t* buf, uint16_t pos, uint8_t id, uint8_t value);
+   static uint16_t writeUint16(uint8_t* buf, uint16_t pos, uint8_t id, uint16_t value);
+   static uint16_t writeUint32(uint8_t* buf, uint16_t pos, uint8_t id, uint32_t value);
+};
+
+#endif
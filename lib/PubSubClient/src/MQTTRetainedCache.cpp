@@ -0,0 +1,124 @@
+/*
+ MQTTRetainedCache.cpp - Keeps the last retained message on each topic, so
+ ones that have not changed are not delivered again.
+*/
+
+#include "MQTTRetainedCache.h"
+
+MQTTRetainedCache::MQTTRetainedCache(uint8_t* storage, uint16_t size) {
+    this->storage = storage;
+    this->capacity = size;
+    this->_unchanged = 0;
+    clear();
+}
+
+void MQTTRetainedCache::clear() {
+    this->used = 0;
+    this->count = 0;
+}
+
+boolean MQTTRetainedCache::update(const char* topic, uint16_t tlen, const uint8_t* payload, unsigned int plength) {
+    uint32_t topicHash = hash((const uint8_t*)topic,tlen);
+    uint32_t contentHash = hash(payload,plength);
+    int8_t index = find(topic,tlen,topicHash);
+    if (index >= 0) {
+        MQTTRetainedEntry* entry = &this->entries[index];
+        if (entry->contentHash == contentHash && entry->length == plength &&
+            memcmp(this->storage+entry->start+tlen,payload,plength) == 0) {
+            this->_unchanged++;
+            return false;
+        }
+        remove(index);
+    }
+    if (plength == 0 || (uint32_t)tlen+plength > this->capacity) {
+        return true;
+    }
+    uint16_t total = tlen+plength;
+    while (this->count == MQTT_RETAINED_CACHE_ENTRIES || this->capacity-this->used < total) {
+        remove(0);
+    }
+    compact();
+
+    MQTTRetainedEntry* entry = &this->entries[this->count++];
+    entry->topicHash = topicHash;
+    entry->contentHash = contentHash;
+    entry->start = this->used;
+    entry->topicLength = tlen;
+    entry->length = plength;
+    memcpy(this->storage+this->used,topic,tlen);
+    memcpy(this->storage+this->used+tlen,payload,plength);
+    this->used += total;
+    return true;
+}
+
+void MQTTRetainedCache::forget(const char* topic, uint16_t tlen) {
+    int8_t index = find(topic,tlen,hash((const uint8_t*)topic,tlen));
+    if (index >= 0) {
+        remove(index);
+    }
+}
+
+const uint8_t* MQTTRetainedCache::get(const char* topic, unsigned int* plength) {
+    uint16_t tlen = strlen(topic);
+    int8_t index = find(topic,tlen,hash((const uint8_t*)topic,tlen));
+    if (index < 0) {
+        return NULL;
+    }
+    *plength = this->entries[index].length;
+    return this->storage+this->entries[index].start+tlen;
+}
+
+int8_t MQTTRetainedCache::find(const char* topic, uint16_t tlen, uint32_t topicHash) {
+    for (uint8_t i=0;i<this->count;i++) {
+        MQTTRetainedEntry* entry = &this->entries[i];
+        if (entry->topicHash == topicHash && entry->topicLength == tlen &&
+            memcmp(this->storage+entry->start,topic,tlen) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Removes an entry; its space is reclaimed by the next compact()
+void MQTTRetainedCache::remove(uint8_t index) {
+    this->used -= this->entries[index].topicLength+this->entries[index].length;
+    this->count--;
+    for (uint8_t i=index;i<this->count;i++) {
+        this->entries[i] = this->entries[i+1];
+    }
+}
+
+// Moves the entries down over the gaps left by removed ones, so the free
+// space is all after the last
+void MQTTRetainedCache::compact() {
+    uint16_t at = 0;
+    for (uint8_t i=0;i<this->count;i++) {
+        MQTTRetainedEntry* entry = &this->entries[i];
+        uint16_t length = entry->topicLength+entry->length;
+        if (entry->start != at) {
+            memmove(this->storage+at,this->storage+entry->start,length);
+            entry->start = at;
+        }
+        at += length;
+    }
+}
+
+uint8_t MQTTRetainedCache::depth() {
+    return this->count;
+}
+
+uint16_t MQTTRetainedCache::size() {
+    return this->used;
+}
+
+uint32_t MQTTRetainedCache::unchanged() {
+    return this->_unchanged;
+}
+
+uint32_t MQTTRetainedCache::hash(const uint8_t* data, unsigned int length) {
+    uint32_t h = 2166136261UL;
+    for (unsigned int i=0;i<length;i++) {
+        h = (h ^ data[i])*16777619UL;
+    }
+    return h;
+}
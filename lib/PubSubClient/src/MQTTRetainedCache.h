@@ -0,0 +1,62 @@
+/*
+ MQTTRetainedCache.h - Keeps the last retained message on each topic, so
+ ones that have not changed are not delivered again.
+*/
+
+#ifndef MQTTRetainedCache_h
+#define MQTTRetainedCache_h
+
+#include <Arduino.h>
+
+// MQTT_RETAINED_CACHE_ENTRIES : Maximum number of topics a cache holds,
+//  whatever the size of its storage. Each entry costs 16 bytes of RAM.
+#ifndef MQTT_RETAINED_CACHE_ENTRIES
+#define MQTT_RETAINED_CACHE_ENTRIES 16
+#endif
+
+typedef struct {
+   uint32_t topicHash;
+   uint32_t contentHash;
+   uint16_t start;
+   uint16_t topicLength;
+   uint16_t length;
+} MQTTRetainedEntry;
+
+// Topics and payloads of retained messages, kept back to back in caller
+// supplied storage with a hash of each. Entries are kept oldest first, in
+// the same order as their data; when space runs out the oldest are dropped.
+class MQTTRetainedCache {
+private:
+   uint8_t* storage;
+   uint16_t capacity;
+   uint16_t used;
+   MQTTRetainedEntry entries[MQTT_RETAINED_CACHE_ENTRIES];
+   uint8_t count;
+   uint32_t _unchanged;
+   int8_t find(const char* topic, uint16_t tlen, uint32_t topicHash);
+   void remove(uint8_t index);
+   void compact();
+public:
+   MQTTRetainedCache(uint8_t* storage, uint16_t size);
+
+   // Stores a retained message. Returns false, leaving the cache as it was,
+   // if the topic already holds the same payload. An empty payload, which
+   // clears a retained message, removes the topic.
+   boolean update(const char* topic, uint16_t tlen, const uint8_t* payload, unsigned int plength);
+   // Drops whatever is stored for topic, for a live message that has
+   // superseded it
+   void forget(const char* topic, uint16_t tlen);
+   // The payload last stored for topic, or NULL if there is none
+   const uint8_t* get(const char* topic, unsigned int* plength);
+   void clear();
+
+   uint8_t depth();
+   uint16_t size();
+   // Number of messages update() found unchanged
+   uint32_t unchanged();
+
+   // 32 bit FNV-1a
+   static uint32_t hash(const uint8_t* data, unsigned int length);
+};
+
+#endif
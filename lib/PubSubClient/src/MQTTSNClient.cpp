@@ -0,0 +1,601 @@
+/*
+ MQTTSNClient.cpp - An MQTT-SN client over UDP with the same interface as
+ PubSubClient.
+*/
+
+#include "MQTTSNClient.h"
+#include "Arduino.h"
+
+static unsigned long defaultClock() {
+    return millis();
+}
+
+void MQTTSNClient::init() {
+    this->_state = MQTT_DISCONNECTED;
+    this->_udp = NULL;
+    this->_clock = defaultClock;
+    this->inType = 0;
+    this->inBody = NULL;
+    this->inLength = 0;
+    this->nextMsgId = 0;
+    this->lastOutActivity = 0;
+    this->pingOutstanding = false;
+    this->pingSentAt = 0;
+    this->pingAttempts = 0;
+    this->keepAlive = MQTT_KEEPALIVE;
+    setRetry(MQTTSN_RETRY_INTERVAL,MQTTSN_RETRIES);
+    forgetTopics(true);
+    this->callback = NULL;
+#if !MQTT_STD_FUNCTION_CALLBACK
+    this->handler = NULL;
+    this->handlerContext = NULL;
+#endif
+    this->domain = NULL;
+    this->port = 0;
+}
+
+MQTTSNClient::MQTTSNClient(UDP& udp) {
+    init();
+    this->_udp = &udp;
+}
+
+MQTTSNClient::MQTTSNClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, UDP& udp) {
+    init();
+    this->_udp = &udp;
+    setServer(addr,port);
+    setCallback(callback);
+}
+
+MQTTSNClient::MQTTSNClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, UDP& udp) {
+    init();
+    this->_udp = &udp;
+    setServer(ip,port);
+    setCallback(callback);
+}
+
+MQTTSNClient::MQTTSNClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, UDP& udp) {
+    init();
+    this->_udp = &udp;
+    setServer(domain,port);
+    setCallback(callback);
+}
+
+boolean MQTTSNClient::connect(const char *id) {
+    uint16_t length = strlen(id);
+    if (4+length > MQTTSN_MAX_PACKET_SIZE-MQTTSN_HEADER_SIZE) {
+        return false;
+    }
+    _udp->begin(MQTTSN_LOCAL_PORT);
+
+    uint8_t* body = buffer+MQTTSN_HEADER_SIZE;
+    body[0] = MQTTSN_FLAG_CLEAN;
+    body[1] = 0x01; // Protocol id
+    body[2] = (keepAlive >> 8);
+    body[3] = (keepAlive & 0xFF);
+    memcpy(body+4,id,length);
+
+    // A clean session drops the gateway's registrations, and with them ours
+    forgetTopics(false);
+    pingOutstanding = false;
+    if (!sendAndWait(MQTTSN_CONNECT,4+length,MQTTSN_CONNACK,0)) {
+        return false;
+    }
+    if (inLength < 1) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    switch (inBody[0]) {
+    case MQTTSN_ACCEPTED:
+        _state = MQTT_CONNECTED;
+        return true;
+    case MQTTSN_CONGESTION:
+        _state = MQTT_CONNECT_UNAVAILABLE;
+        break;
+    case MQTTSN_NOT_SUPPORTED:
+        _state = MQTT_CONNECT_BAD_PROTOCOL;
+        break;
+    default:
+        _state = MQTT_CONNECT_FAILED;
+    }
+    return false;
+}
+
+void MQTTSNClient::disconnect() {
+    uint8_t packet[] = {0x02,MQTTSN_DISCONNECT};
+    if (connected()) {
+        sendRaw(packet,2);
+    }
+    _state = MQTT_DISCONNECTED;
+    _udp->stop();
+}
+
+// Sends the message built at buffer+MQTTSN_HEADER_SIZE, putting the length
+// and type in front of it.
+boolean MQTTSNClient::send(uint8_t type, uint16_t length) {
+    uint16_t start = 2;
+    buffer[3] = type;
+    if (length+2 <= 255) {
+        buffer[2] = length+2;
+    } else {
+        start = 0;
+        buffer[0] = 0x01;
+        buffer[1] = ((length+4) >> 8);
+        buffer[2] = ((length+4) & 0xFF);
+    }
+    return sendRaw(buffer+start,length+MQTTSN_HEADER_SIZE-start);
+}
+
+boolean MQTTSNClient::sendRaw(const uint8_t* buf, uint16_t length) {
+    int rc;
+    if (domain != NULL) {
+        rc = _udp->beginPacket(domain,port);
+    } else {
+        rc = _udp->beginPacket(ip,port);
+    }
+    if (!rc || _udp->write(buf,length) != length) {
+        return false;
+    }
+    lastOutActivity = _clock();
+    return _udp->endPacket();
+}
+
+// Acknowledges with a local buffer, as the outbound one may be holding a
+// message waiting to be sent again.
+boolean MQTTSNClient::sendAck(uint8_t type, uint16_t topicId, uint16_t msgId, uint8_t rc) {
+    uint8_t ack[7];
+    ack[0] = 7;
+    ack[1] = type;
+    ack[2] = (topicId >> 8);
+    ack[3] = (topicId & 0xFF);
+    ack[4] = (msgId >> 8);
+    ack[5] = (msgId & 0xFF);
+    ack[6] = rc;
+    return sendRaw(ack,7);
+}
+
+// Sends a message until its acknowledgement arrives, handling anything else
+// received meanwhile. The acknowledgement is left in inBody.
+boolean MQTTSNClient::sendAndWait(uint8_t type, uint16_t length, uint8_t responseType, uint16_t msgId) {
+    for (uint8_t attempt = 0; attempt <= retries; attempt++) {
+        if (attempt > 0 && (type == MQTTSN_PUBLISH || type == MQTTSN_SUBSCRIBE)) {
+            buffer[MQTTSN_HEADER_SIZE] |= MQTTSN_FLAG_DUP;
+        }
+        if (!send(type,length)) {
+            return false;
+        }
+        unsigned long start = _clock();
+        while (_clock() - start < retryInterval) {
+            if (readPacket()) {
+                if (inType == responseType && ackMsgId() == msgId) {
+                    return true;
+                }
+                handlePacket();
+            }
+        }
+    }
+    _state = MQTT_CONNECTION_TIMEOUT;
+    return false;
+}
+
+// Reads the next datagram into inbound. Datagrams that are too big or
+// whose length field doesn't match are dropped.
+boolean MQTTSNClient::readPacket() {
+    int size = _udp->parsePacket();
+    if (size <= 0) {
+        return false;
+    }
+    if (size > MQTTSN_MAX_PACKET_SIZE || size < 2) {
+        return false;
+    }
+    _udp->read(inbound,size);
+    uint16_t length;
+    uint8_t headerLength;
+    if (inbound[0] == 0x01) {
+        if (size < 4) {
+            return false;
+        }
+        length = (inbound[1] << 8) | inbound[2];
+        headerLength = 4;
+    } else {
+        length = inbound[0];
+        headerLength = 2;
+    }
+    if (length != size) {
+        return false;
+    }
+    inType = inbound[headerLength-1];
+    inBody = inbound+headerLength;
+    inLength = length-headerLength;
+    return true;
+}
+
+uint16_t MQTTSNClient::ackMsgId() {
+    switch (inType) {
+    case MQTTSN_REGACK:
+    case MQTTSN_PUBACK:
+        return (inLength < 4) ? 0 : (inBody[2] << 8) | inBody[3];
+    case MQTTSN_SUBACK:
+        return (inLength < 5) ? 0 : (inBody[3] << 8) | inBody[4];
+    case MQTTSN_UNSUBACK:
+        return (inLength < 2) ? 0 : (inBody[0] << 8) | inBody[1];
+    }
+    return 0;
+}
+
+void MQTTSNClient::handlePacket() {
+    if (inType == MQTTSN_PUBLISH && inLength >= 5) {
+        uint8_t qos = (inBody[0] >> 5) & 0x03;
+        uint8_t type = inBody[0] & 0x03;
+        uint16_t topicId = (inBody[1] << 8) | inBody[2];
+        uint16_t msgId = (inBody[3] << 8) | inBody[4];
+        char shortTopic[3];
+        char* topic = NULL;
+        if (type == MQTTSN_TOPIC_SHORT) {
+            shortTopic[0] = inBody[1];
+            shortTopic[1] = inBody[2];
+            shortTopic[2] = '\0';
+            topic = shortTopic;
+        } else {
+            MQTTSNTopic* entry = findTopic(topicId,type);
+            if (entry) {
+                topic = entry->name;
+            }
+        }
+        if (topic == NULL) {
+            if (qos == 1) {
+                sendAck(MQTTSN_PUBACK,topicId,msgId,MQTTSN_INVALID_TOPIC_ID);
+            }
+            return;
+        }
+#if !MQTT_STD_FUNCTION_CALLBACK
+        if (handler) {
+            handler(topic,inBody+5,inLength-5,handlerContext);
+        } else
+#endif
+        if (callback) {
+            callback(topic,inBody+5,inLength-5);
+        }
+        if (qos == 1) {
+            sendAck(MQTTSN_PUBACK,topicId,msgId,MQTTSN_ACCEPTED);
+        }
+    } else if (inType == MQTTSN_REGISTER && inLength >= 4) {
+        uint16_t topicId = (inBody[0] << 8) | inBody[1];
+        uint16_t msgId = (inBody[2] << 8) | inBody[3];
+        uint16_t tlen = inLength-4;
+        uint8_t rc = MQTTSN_CONGESTION;
+        if (tlen < MQTTSN_MAX_TOPIC_LENGTH) {
+            char topic[MQTTSN_MAX_TOPIC_LENGTH];
+            memcpy(topic,inBody+4,tlen);
+            topic[tlen] = '\0';
+            if (addTopic(topicId,MQTTSN_TOPIC_NORMAL,topic)) {
+                rc = MQTTSN_ACCEPTED;
+            }
+        }
+        sendAck(MQTTSN_REGACK,topicId,msgId,rc);
+    } else if (inType == MQTTSN_PINGREQ) {
+        uint8_t resp[] = {0x02,MQTTSN_PINGRESP};
+        sendRaw(resp,2);
+    } else if (inType == MQTTSN_PINGRESP) {
+        pingOutstanding = false;
+        pingAttempts = 0;
+    } else if (inType == MQTTSN_DISCONNECT) {
+        _state = MQTT_CONNECTION_LOST;
+        _udp->stop();
+    }
+}
+
+boolean MQTTSNClient::loop() {
+    if (!connected()) {
+        return false;
+    }
+    while (readPacket()) {
+        handlePacket();
+        if (!connected()) {
+            return false;
+        }
+    }
+    unsigned long t = _clock();
+    if (keepAlive) {
+        boolean ping = false;
+        if (pingOutstanding) {
+            if (t - pingSentAt >= retryInterval) {
+                if (pingAttempts > retries) {
+                    _state = MQTT_CONNECTION_TIMEOUT;
+                    _udp->stop();
+                    return false;
+                }
+                ping = true;
+            }
+        } else if (t - lastOutActivity >= keepAlive*1000UL) {
+            pingAttempts = 0;
+            ping = true;
+        }
+        if (ping) {
+            uint8_t req[] = {0x02,MQTTSN_PINGREQ};
+            sendRaw(req,2);
+            pingOutstanding = true;
+            pingSentAt = t;
+            pingAttempts++;
+        }
+    }
+    return true;
+}
+
+boolean MQTTSNClient::publish(const char* topic, const char* payload) {
+    return publish(topic,(const uint8_t*)payload,strlen(payload),0,false);
+}
+
+boolean MQTTSNClient::publish(const char* topic, const char* payload, boolean retained) {
+    return publish(topic,(const uint8_t*)payload,strlen(payload),0,retained);
+}
+
+boolean MQTTSNClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+    return publish(topic,payload,plength,0,false);
+}
+
+boolean MQTTSNClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publish(topic,payload,plength,0,retained);
+}
+
+boolean MQTTSNClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, int8_t qos, boolean retained) {
+    MQTTSNTopic* entry = findTopic(topic);
+    if (entry) {
+        return publish(entry->id,entry->type,payload,plength,qos,retained);
+    }
+    if (strlen(topic) == 2) {
+        return publish(((uint8_t)topic[0] << 8) | (uint8_t)topic[1],MQTTSN_TOPIC_SHORT,payload,plength,qos,retained);
+    }
+    if (qos == -1 || !connected()) {
+        return false;
+    }
+    entry = registerTopic(topic);
+    if (!entry) {
+        return false;
+    }
+    return publish(entry->id,entry->type,payload,plength,qos,retained);
+}
+
+boolean MQTTSNClient::publish(uint16_t topicId, const uint8_t* payload, unsigned int plength, int8_t qos, boolean retained) {
+    return publish(topicId,MQTTSN_TOPIC_PREDEFINED,payload,plength,qos,retained);
+}
+
+boolean MQTTSNClient::publish(uint16_t topicId, uint8_t type, const uint8_t* payload, unsigned int plength, int8_t qos, boolean retained) {
+    if (qos < -1 || qos > 1) {
+        return false;
+    }
+    if (qos == -1 ? type == MQTTSN_TOPIC_NORMAL : !connected()) {
+        return false;
+    }
+    if (MQTTSN_HEADER_SIZE+5+plength > MQTTSN_MAX_PACKET_SIZE) {
+        return false;
+    }
+    uint8_t* body = buffer+MQTTSN_HEADER_SIZE;
+    uint16_t msgId = (qos == 1) ? nextMessageId() : 0;
+    body[0] = ((qos & 0x03) << 5) | type;
+    if (retained) {
+        body[0] |= MQTTSN_FLAG_RETAIN;
+    }
+    body[1] = (topicId >> 8);
+    body[2] = (topicId & 0xFF);
+    body[3] = (msgId >> 8);
+    body[4] = (msgId & 0xFF);
+    memcpy(body+5,payload,plength);
+    if (qos != 1) {
+        return send(MQTTSN_PUBLISH,5+plength);
+    }
+    if (!sendAndWait(MQTTSN_PUBLISH,5+plength,MQTTSN_PUBACK,msgId) || inLength < 5) {
+        return false;
+    }
+    if (inBody[4] == MQTTSN_INVALID_TOPIC_ID) {
+        // The gateway lost the registration; register again on next publish
+        MQTTSNTopic* entry = findTopic(topicId,MQTTSN_TOPIC_NORMAL);
+        if (type == MQTTSN_TOPIC_NORMAL && entry) {
+            entry->id = 0;
+        }
+    }
+    return (inBody[4] == MQTTSN_ACCEPTED);
+}
+
+MQTTSNTopic* MQTTSNClient::registerTopic(const char* topic) {
+    uint16_t tlen = strlen(topic);
+    if (tlen >= MQTTSN_MAX_TOPIC_LENGTH || MQTTSN_HEADER_SIZE+4+tlen > MQTTSN_MAX_PACKET_SIZE) {
+        return NULL;
+    }
+    uint8_t* body = buffer+MQTTSN_HEADER_SIZE;
+    uint16_t msgId = nextMessageId();
+    body[0] = 0;
+    body[1] = 0;
+    body[2] = (msgId >> 8);
+    body[3] = (msgId & 0xFF);
+    memcpy(body+4,topic,tlen);
+    if (!sendAndWait(MQTTSN_REGISTER,4+tlen,MQTTSN_REGACK,msgId) || inLength < 5 || inBody[4] != MQTTSN_ACCEPTED) {
+        return NULL;
+    }
+    return addTopic((inBody[0] << 8) | inBody[1],MQTTSN_TOPIC_NORMAL,topic);
+}
+
+boolean MQTTSNClient::subscribe(const char* topic) {
+    return subscribe(topic,0);
+}
+
+boolean MQTTSNClient::subscribe(const char* topic, uint8_t qos) {
+    if (strlen(topic) == 2) {
+        return subscribe(((uint8_t)topic[0] << 8) | (uint8_t)topic[1],MQTTSN_TOPIC_SHORT,NULL,qos);
+    }
+    return subscribe(0,MQTTSN_TOPIC_NORMAL,topic,qos);
+}
+
+boolean MQTTSNClient::subscribe(uint16_t topicId, uint8_t qos) {
+    return subscribe(topicId,MQTTSN_TOPIC_PREDEFINED,NULL,qos);
+}
+
+boolean MQTTSNClient::subscribe(uint16_t topicId, uint8_t type, const char* topic, uint8_t qos) {
+    if (qos > 1 || !connected()) {
+        return false;
+    }
+    uint8_t* body = buffer+MQTTSN_HEADER_SIZE;
+    uint16_t length = 5;
+    uint16_t msgId = nextMessageId();
+    body[0] = (qos << 5) | type;
+    body[1] = (msgId >> 8);
+    body[2] = (msgId & 0xFF);
+    if (topic) {
+        length = 3+strlen(topic);
+        if (MQTTSN_HEADER_SIZE+length > MQTTSN_MAX_PACKET_SIZE) {
+            return false;
+        }
+        memcpy(body+3,topic,length-3);
+    } else {
+        body[3] = (topicId >> 8);
+        body[4] = (topicId & 0xFF);
+    }
+    if (!sendAndWait(MQTTSN_SUBSCRIBE,length,MQTTSN_SUBACK,msgId) || inLength < 6 || inBody[5] != MQTTSN_ACCEPTED) {
+        return false;
+    }
+    // Topics with wildcards get id 0; the gateway registers each matching
+    // topic before its first PUBLISH instead.
+    uint16_t grantedId = (inBody[1] << 8) | inBody[2];
+    if (topic && grantedId != 0 && !findTopic(topic)) {
+        addTopic(grantedId,MQTTSN_TOPIC_NORMAL,topic);
+    }
+    return true;
+}
+
+boolean MQTTSNClient::unsubscribe(const char* topic) {
+    if (!connected()) {
+        return false;
+    }
+    uint8_t* body = buffer+MQTTSN_HEADER_SIZE;
+    uint16_t length = 3+strlen(topic);
+    uint16_t msgId = nextMessageId();
+    if (MQTTSN_HEADER_SIZE+length > MQTTSN_MAX_PACKET_SIZE) {
+        return false;
+    }
+    body[0] = (length == 5) ? MQTTSN_TOPIC_SHORT : MQTTSN_TOPIC_NORMAL;
+    body[1] = (msgId >> 8);
+    body[2] = (msgId & 0xFF);
+    memcpy(body+3,topic,length-3);
+    return sendAndWait(MQTTSN_UNSUBSCRIBE,length,MQTTSN_UNSUBACK,msgId);
+}
+
+uint16_t MQTTSNClient::nextMessageId() {
+    nextMsgId++;
+    if (nextMsgId == 0) {
+        nextMsgId = 1;
+    }
+    return nextMsgId;
+}
+
+MQTTSNTopic* MQTTSNClient::findTopic(const char* name) {
+    for (uint8_t i = 0; i < MQTTSN_MAX_TOPICS; i++) {
+        if (topics[i].id != 0 && strcmp(topics[i].name,name) == 0) {
+            return &topics[i];
+        }
+    }
+    return NULL;
+}
+
+MQTTSNTopic* MQTTSNClient::findTopic(uint16_t id, uint8_t type) {
+    for (uint8_t i = 0; i < MQTTSN_MAX_TOPICS; i++) {
+        if (topics[i].id == id && topics[i].type == type) {
+            return &topics[i];
+        }
+    }
+    return NULL;
+}
+
+MQTTSNTopic* MQTTSNClient::addTopic(uint16_t id, uint8_t type, const char* name) {
+    if (id == 0 || strlen(name) >= MQTTSN_MAX_TOPIC_LENGTH) {
+        return NULL;
+    }
+    MQTTSNTopic* entry = findTopic(id,type);
+    if (!entry) {
+        entry = findTopic(0,MQTTSN_TOPIC_NORMAL);
+    }
+    if (!entry) {
+        return NULL;
+    }
+    entry->id = id;
+    entry->type = type;
+    strcpy(entry->name,name);
+    return entry;
+}
+
+void MQTTSNClient::forgetTopics(boolean predefined) {
+    for (uint8_t i = 0; i < MQTTSN_MAX_TOPICS; i++) {
+        if (predefined || topics[i].type == MQTTSN_TOPIC_NORMAL) {
+            topics[i].id = 0;
+            topics[i].type = MQTTSN_TOPIC_NORMAL;
+        }
+    }
+}
+
+boolean MQTTSNClient::setPredefinedTopic(uint16_t topicId, const char* topic) {
+    return addTopic(topicId,MQTTSN_TOPIC_PREDEFINED,topic) != NULL;
+}
+
+boolean MQTTSNClient::connected() {
+    return _state == MQTT_CONNECTED;
+}
+
+MQTTSNClient& MQTTSNClient::setServer(uint8_t * ip, uint16_t port) {
+    IPAddress addr(ip[0],ip[1],ip[2],ip[3]);
+    return setServer(addr,port);
+}
+
+MQTTSNClient& MQTTSNClient::setServer(IPAddress ip, uint16_t port) {
+    this->ip = ip;
+    this->port = port;
+    this->domain = NULL;
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setServer(const char * domain, uint16_t port) {
+    this->domain = domain;
+    this->port = port;
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+#if !MQTT_STD_FUNCTION_CALLBACK
+    this->handler = NULL;
+#endif
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setCallback(MQTTMessageHandler handler, void* context) {
+    this->callback = NULL;
+#if MQTT_STD_FUNCTION_CALLBACK
+    if (handler) {
+        // Two pointers fit in a std::function without a heap allocation
+        this->callback = [handler,context](char* topic, uint8_t* payload, unsigned int length) {
+            handler(topic,payload,length,context);
+        };
+    }
+#else
+    this->handler = handler;
+    this->handlerContext = context;
+#endif
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setKeepAlive(uint16_t keepAlive) {
+    this->keepAlive = keepAlive;
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setClock(MQTTClock clock) {
+    this->_clock = clock;
+    return *this;
+}
+
+MQTTSNClient& MQTTSNClient::setRetry(uint16_t interval, uint8_t retries) {
+    this->retryInterval = interval;
+    this->retries = retries;
+    return *this;
+}
+
+int MQTTSNClient::state() {
+    return this->_state;
+}
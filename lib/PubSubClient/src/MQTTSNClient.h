@@ -0,0 +1,177 @@
+/*
+ MQTTSNClient.h - An MQTT-SN client over UDP with the same interface as
+ PubSubClient.
+*/
+
+#ifndef MQTTSNClient_h
+#define MQTTSNClient_h
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "Udp.h"
+#include "PubSubClient.h"
+
+// MQTTSN_MAX_PACKET_SIZE : Maximum datagram size, sent or received
+#ifndef MQTTSN_MAX_PACKET_SIZE
+#define MQTTSN_MAX_PACKET_SIZE 128
+#endif
+
+// MQTTSN_MAX_TOPICS : Number of topic ids the client remembers, whether
+//  registered, learnt from a SUBACK or predefined. Each costs
+//  MQTTSN_MAX_TOPIC_LENGTH + 3 bytes of RAM.
+#ifndef MQTTSN_MAX_TOPICS
+#define MQTTSN_MAX_TOPICS 8
+#endif
+
+// MQTTSN_MAX_TOPIC_LENGTH : Longest topic name, including the terminator,
+//  that can be mapped to a topic id
+#ifndef MQTTSN_MAX_TOPIC_LENGTH
+#define MQTTSN_MAX_TOPIC_LENGTH 32
+#endif
+
+// MQTTSN_RETRY_INTERVAL : default time in milliseconds to wait for an
+//  acknowledgement before sending again. Override with setRetry()
+#ifndef MQTTSN_RETRY_INTERVAL
+#define MQTTSN_RETRY_INTERVAL 2000
+#endif
+
+// MQTTSN_RETRIES : default number of times a message is sent again before
+//  the gateway is considered lost. Override with setRetry()
+#ifndef MQTTSN_RETRIES
+#define MQTTSN_RETRIES 3
+#endif
+
+// MQTTSN_LOCAL_PORT : UDP port the client listens on for replies
+#ifndef MQTTSN_LOCAL_PORT
+#define MQTTSN_LOCAL_PORT 10000
+#endif
+
+#define MQTTSN_CONNECT     0x04
+#define MQTTSN_CONNACK     0x05
+#define MQTTSN_REGISTER    0x0A
+#define MQTTSN_REGACK      0x0B
+#define MQTTSN_PUBLISH     0x0C
+#define MQTTSN_PUBACK      0x0D
+#define MQTTSN_SUBSCRIBE   0x12
+#define MQTTSN_SUBACK      0x13
+#define MQTTSN_UNSUBSCRIBE 0x14
+#define MQTTSN_UNSUBACK    0x15
+#define MQTTSN_PINGREQ     0x16
+#define MQTTSN_PINGRESP    0x17
+#define MQTTSN_DISCONNECT  0x18
+
+#define MQTTSN_FLAG_DUP    0x80
+#define MQTTSN_FLAG_RETAIN 0x10
+#define MQTTSN_FLAG_CLEAN  0x04
+
+// Topic id types, as carried in the low bits of the flags
+#define MQTTSN_TOPIC_NORMAL     0x00
+#define MQTTSN_TOPIC_PREDEFINED 0x01
+#define MQTTSN_TOPIC_SHORT      0x02
+
+#define MQTTSN_ACCEPTED         0x00
+#define MQTTSN_CONGESTION       0x01
+#define MQTTSN_INVALID_TOPIC_ID 0x02
+#define MQTTSN_NOT_SUPPORTED    0x03
+
+// Room kept in front of each outbound message for the 3 byte length form
+// and the message type
+#define MQTTSN_HEADER_SIZE 4
+
+typedef struct {
+   uint16_t id;
+   uint8_t type;
+   char name[MQTTSN_MAX_TOPIC_LENGTH];
+} MQTTSNTopic;
+
+class MQTTSNClient {
+private:
+   UDP* _udp;
+   MQTTClock _clock;
+   uint8_t buffer[MQTTSN_MAX_PACKET_SIZE];
+   uint8_t inbound[MQTTSN_MAX_PACKET_SIZE];
+   uint8_t inType;
+   uint8_t* inBody;
+   uint16_t inLength;
+   MQTTSNTopic topics[MQTTSN_MAX_TOPICS];
+   uint16_t nextMsgId;
+   unsigned long lastOutActivity;
+   bool pingOutstanding;
+   unsigned long pingSentAt;
+   uint8_t pingAttempts;
+   uint16_t keepAlive;
+   uint16_t retryInterval;
+   uint8_t retries;
+   MQTT_CALLBACK_SIGNATURE;
+#if !MQTT_STD_FUNCTION_CALLBACK
+   // A std::function holds the handler and its context itself
+   MQTTMessageHandler handler;
+   void* handlerContext;
+#endif
+   void init();
+   boolean send(uint8_t type, uint16_t length);
+   boolean sendRaw(const uint8_t* buf, uint16_t length);
+   boolean sendAck(uint8_t type, uint16_t topicId, uint16_t msgId, uint8_t rc);
+   boolean sendAndWait(uint8_t type, uint16_t length, uint8_t responseType, uint16_t msgId);
+   boolean readPacket();
+   void handlePacket();
+   uint16_t ackMsgId();
+   uint16_t nextMessageId();
+   MQTTSNTopic* findTopic(const char* name);
+   MQTTSNTopic* findTopic(uint16_t id, uint8_t type);
+   MQTTSNTopic* addTopic(uint16_t id, uint8_t type, const char* name);
+   void forgetTopics(boolean predefined);
+   MQTTSNTopic* registerTopic(const char* topic);
+   boolean publish(uint16_t topicId, uint8_t type, const uint8_t* payload, unsigned int plength, int8_t qos, boolean retained);
+   boolean subscribe(uint16_t topicId, uint8_t type, const char* topic, uint8_t qos);
+   IPAddress ip;
+   const char* domain;
+   uint16_t port;
+   int _state;
+public:
+   MQTTSNClient(UDP& udp);
+   MQTTSNClient(IPAddress, uint16_t, MQTT_CALLBACK_SIGNATURE, UDP& udp);
+   MQTTSNClient(uint8_t *, uint16_t, MQTT_CALLBACK_SIGNATURE, UDP& udp);
+   MQTTSNClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE, UDP& udp);
+
+   MQTTSNClient& setServer(IPAddress ip, uint16_t port);
+   MQTTSNClient& setServer(uint8_t * ip, uint16_t port);
+   MQTTSNClient& setServer(const char * domain, uint16_t port);
+   MQTTSNClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+   MQTTSNClient& setCallback(MQTTMessageHandler handler, void* context);
+   // In seconds, used from the next connect()
+   MQTTSNClient& setKeepAlive(uint16_t keepAlive);
+   // How long to wait for an acknowledgement, in milliseconds, and how many
+   // times to send a message again before giving up on the gateway
+   MQTTSNClient& setRetry(uint16_t interval, uint8_t retries);
+   // Replaces millis() for the keepalive and retries, as with PubSubClient.
+   // Waiting for an acknowledgement reads the clock until it has moved on
+   // by the retry interval.
+   MQTTSNClient& setClock(MQTTClock clock);
+   // Maps a topic name to an id agreed with the gateway beforehand. The name
+   // is copied. Predefined topics need no registration and can be published
+   // at QoS -1 without connecting.
+   boolean setPredefinedTopic(uint16_t topicId, const char* topic);
+
+   boolean connect(const char* id);
+   void disconnect();
+   // Topics with two character names are sent as short topics; other
+   // topics are registered with the gateway on their first publish.
+   boolean publish(const char* topic, const char* payload);
+   boolean publish(const char* topic, const char* payload, boolean retained);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // qos is -1, 0 or 1. QoS 1 waits for the PUBACK; QoS -1 needs a
+   // predefined or short topic and no connection.
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, int8_t qos, boolean retained);
+   boolean publish(uint16_t topicId, const uint8_t * payload, unsigned int plength, int8_t qos, boolean retained);
+   boolean subscribe(const char* topic);
+   boolean subscribe(const char* topic, uint8_t qos);
+   boolean subscribe(uint16_t topicId, uint8_t qos);
+   boolean unsubscribe(const char* topic);
+   boolean loop();
+   boolean connected();
+   int state();
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ MQTTTopicRouter.cpp - Routes incoming topics to per-filter handlers.
+
+ Filters are stored as a trie with one node per topic level. Children of a
+ node are kept in a sibling list, so matching a topic walks one list per
+ level and its cost depends on the topic depth, not on the number of
+ registered filters. Each node also keeps a one byte hash of its level so
+ most siblings are rejected without comparing strings.
+*/
+
+#include "MQTTTopicRouter.h"
+
+#define MQTT_ROUTER_HASH(h,c) ((uint8_t)(((h) << 1) ^ ((h) >> 7) ^ (uint8_t)(c)))
+
+MQTTTopicRouter::MQTTTopicRouter() {
+    clear();
+}
+
+void MQTTTopicRouter::clear() {
+    this->nodes[0].level = NULL;
+    this->nodes[0].levelLength = 0;
+    this->nodes[0].levelHash = 0;
+    this->nodes[0].firstChild = MQTT_ROUTER_NONE;
+    this->nodes[0].nextSibling = MQTT_ROUTER_NONE;
+    this->nodes[0].handler = MQTT_ROUTER_NONE;
+    this->nodeCount = 1;
+    this->routeCount = 0;
+}
+
+boolean MQTTTopicRouter::on(const char* filter, MQTTTopicHandler handler) {
+    return on(filter, handler, NULL);
+}
+
+boolean MQTTTopicRouter::on(const char* filter, MQTTTopicHandler handler, void* context) {
+    uint8_t node = 0;
+    const char* level = filter;
+    while (true) {
+        const char* end = level;
+        uint8_t hash = 0;
+        while (*end && *end != '/') {
+            hash = MQTT_ROUTER_HASH(hash,*end);
+            end++;
+        }
+        uint16_t length = end-level;
+        if (length > 255) {
+            return false;
+        }
+        for (uint16_t i=0;i<length;i++) {
+            // Wildcards must occupy a whole level, and # must be the last one
+            if ((level[i] == '+' || level[i] == '#') && length != 1) {
+                return false;
+            }
+        }
+        if (level[0] == '#' && *end) {
+            return false;
+        }
+        uint8_t child = findChild(node,level,length,hash);
+        if (child == MQTT_ROUTER_NONE) {
+            child = addChild(node,level,length,hash);
+            if (child == MQTT_ROUTER_NONE) {
+                return false;
+            }
+        }
+        node = child;
+        if (!*end) {
+            break;
+        }
+        level = end+1;
+    }
+    if (this->nodes[node].handler == MQTT_ROUTER_NONE) {
+        if (this->routeCount == MQTT_ROUTER_MAX_HANDLERS) {
+            return false;
+        }
+        this->nodes[node].handler = this->routeCount++;
+    }
+    this->routes[this->nodes[node].handler].handler = handler;
+    this->routes[this->nodes[node].handler].context = context;
+    return true;
+}
+
+uint8_t MQTTTopicRouter::dispatch(const MQTTTopic& topic, uint8_t* payload, unsigned int length) {
+    if (topic.length == 0) {
+        return 0;
+    }
+    return match(0,topic,0,payload,length);
+}
+
+uint8_t MQTTTopicRouter::findChild(uint8_t parent, const char* level, uint8_t length, uint8_t hash) {
+    uint8_t child = this->nodes[parent].firstChild;
+    while (child != MQTT_ROUTER_NONE) {
+        MQTTTopicNode* n = &this->nodes[child];
+        if (n->levelHash == hash && n->levelLength == length && memcmp(n->level,level,length) == 0) {
+            return child;
+        }
+        child = n->nextSibling;
+    }
+    return MQTT_ROUTER_NONE;
+}
+
+uint8_t MQTTTopicRouter::addChild(uint8_t parent, const char* level, uint8_t length, uint8_t hash) {
+    if (this->nodeCount == MQTT_ROUTER_MAX_NODES) {
+        return MQTT_ROUTER_NONE;
+    }
+    uint8_t child = this->nodeCount++;
+    this->nodes[child].level = level;
+    this->nodes[child].levelLength = length;
+    this->nodes[child].levelHash = hash;
+    this->nodes[child].firstChild = MQTT_ROUTER_NONE;
+    this->nodes[child].nextSibling = this->nodes[parent].firstChild;
+    this->nodes[child].handler = MQTT_ROUTER_NONE;
+    this->nodes[parent].firstChild = child;
+    return child;
+}
+
+// Matches the topic level starting at pos against the children of node
+uint8_t MQTTTopicRouter::match(uint8_t node, const MQTTTopic& topic, uint16_t pos, uint8_t* payload, unsigned int plength) {
+    uint8_t called = 0;
+    const char* name = topic.name;
+    uint16_t end = pos;
+    uint8_t hash = 0;
+    while (end < topic.length && name[end] != '/') {
+        hash = MQTT_ROUTER_HASH(hash,name[end]);
+        end++;
+    }
+    uint16_t length = end-pos;
+    boolean last = (end == topic.length);
+    // Wildcards at the first level do not match topics starting with $
+    boolean wildcards = !(node == 0 && topic.name[0] == '$');
+
+    uint8_t child = this->nodes[node].firstChild;
+    while (child != MQTT_ROUTER_NONE) {
+        MQTTTopicNode* n = &this->nodes[child];
+        boolean matched = false;
+        if (n->levelHash == hash && n->levelLength == length) {
+            matched = (memcmp(n->level,name+pos,length) == 0);
+        }
+        if (!matched && n->levelLength == 1 && wildcards) {
+            if (n->level[0] == '#') {
+                called += call(child,topic,payload,plength);
+            } else if (n->level[0] == '+') {
+                matched = true;
+            }
+        }
+        if (matched) {
+            if (last) {
+                called += call(child,topic,payload,plength);
+                // "a/#" also matches "a"
+                uint8_t grandchild = n->firstChild;
+                while (grandchild != MQTT_ROUTER_NONE) {
+                    MQTTTopicNode* g = &this->nodes[grandchild];
+                    if (g->levelLength == 1 && g->level[0] == '#') {
+                        called += call(grandchild,topic,payload,plength);
+                    }
+                    grandchild = g->nextSibling;
+                }
+            } else {
+                called += match(child,topic,end+1,payload,plength);
+            }
+        }
+        child = n->nextSibling;
+    }
+    return called;
+}
+
+uint8_t MQTTTopicRouter::call(uint8_t node, const MQTTTopic& topic, uint8_t* payload, unsigned int length) {
+    uint8_t handler = this->nodes[node].handler;
+    if (handler == MQTT_ROUTER_NONE) {
+        return 0;
+    }
+    this->routes[handler].handler(topic,payload,length,this->routes[handler].context);
+    return 1;
+}
@@ -0,0 +1,73 @@
+/*
+ MQTTTopicRouter.h - Routes incoming topics to per-filter handlers.
+*/
+
+#ifndef MQTTTopicRouter_h
+#define MQTTTopicRouter_h
+
+#include <Arduino.h>
+
+// MQTT_ROUTER_MAX_NODES : Maximum number of topic levels held by a router.
+//  Each level of each registered filter that is not shared with another
+//  filter uses one node. Must be below 255.
+#ifndef MQTT_ROUTER_MAX_NODES
+#define MQTT_ROUTER_MAX_NODES 64
+#endif
+
+// MQTT_ROUTER_MAX_HANDLERS : Maximum number of registered filters
+#ifndef MQTT_ROUTER_MAX_HANDLERS
+#define MQTT_ROUTER_MAX_HANDLERS 16
+#endif
+
+#define MQTT_ROUTER_NONE 0xFF
+
+// A topic as received: name is null-terminated and points into the client's
+// packet buffer, so it is only valid until the handler returns.
+typedef struct {
+   const char* name;
+   uint16_t length;
+} MQTTTopic;
+
+typedef void (*MQTTTopicHandler)(const MQTTTopic& topic, uint8_t* payload, unsigned int length, void* context);
+
+typedef struct {
+   const char* level;
+   uint8_t levelLength;
+   uint8_t levelHash;
+   uint8_t firstChild;
+   uint8_t nextSibling;
+   uint8_t handler;
+} MQTTTopicNode;
+
+typedef struct {
+   MQTTTopicHandler handler;
+   void* context;
+} MQTTTopicRoute;
+
+class MQTTTopicRouter {
+private:
+   MQTTTopicNode nodes[MQTT_ROUTER_MAX_NODES];
+   MQTTTopicRoute routes[MQTT_ROUTER_MAX_HANDLERS];
+   uint8_t nodeCount;
+   uint8_t routeCount;
+   uint8_t findChild(uint8_t parent, const char* level, uint8_t length, uint8_t hash);
+   uint8_t addChild(uint8_t parent, const char* level, uint8_t length, uint8_t hash);
+   uint8_t match(uint8_t node, const MQTTTopic& topic, uint16_t pos, uint8_t* payload, unsigned int plength);
+   uint8_t call(uint8_t node, const MQTTTopic& topic, uint8_t* payload, unsigned int length);
+public:
+   MQTTTopicRouter();
+
+   // Registers handler for a topic filter, which may use the + and #
+   // wildcards. The filter string is referenced, not copied, so it must
+   // outlive the router. Registering the same filter again replaces its
+   // handler.
+   boolean on(const char* filter, MQTTTopicHandler handler);
+   boolean on(const char* filter, MQTTTopicHandler handler, void* context);
+   void clear();
+
+   // Calls every handler whose filter matches topic and returns how many
+   // were called.
+   uint8_t dispatch(const MQTTTopic& topic, uint8_t* payload, unsigned int length);
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ MQTTVarint.cpp - Encodes and decodes the MQTT remaining length field.
+*/
+
+#include "MQTTVarint.h"
+
+MQTTVarint::MQTTVarint() {
+    reset();
+}
+
+void MQTTVarint::reset() {
+    this->_value = 0;
+    this->shift = 0;
+    this->count = 0;
+}
+
+int8_t MQTTVarint::push(uint8_t digit) {
+    if (this->count == MQTT_VARINT_MAX_BYTES) {
+        return MQTT_VARINT_MALFORMED;
+    }
+    this->_value |= (uint32_t)(digit & 0x7F) << this->shift;
+    this->shift += 7;
+    this->count++;
+    if (digit & 0x80) {
+        return this->count == MQTT_VARINT_MAX_BYTES ? MQTT_VARINT_MALFORMED : MQTT_VARINT_MORE;
+    }
+    return this->count;
+}
+
+uint32_t MQTTVarint::value() {
+    return this->_value;
+}
+
+uint8_t MQTTVarint::length(uint32_t value) {
+    if (value < 128) {
+        return 1;
+    } else if (value < 16384) {
+        return 2;
+    } else if (value < 2097152) {
+        return 3;
+    } else if (value <= MQTT_VARINT_MAX) {
+        return 4;
+    }
+    return 0;
+}
+
+uint8_t MQTTVarint::encode(uint32_t value, uint8_t* buf) {
+    if (value > MQTT_VARINT_MAX) {
+        return 0;
+    }
+    uint8_t pos = 0;
+    do {
+        uint8_t digit = value & 0x7F;
+        value >>= 7;
+        if (value > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (value > 0);
+    return pos;
+}
+
+int8_t MQTTVarint::decode(const uint8_t* buf, uint16_t available, uint32_t* value) {
+    MQTTVarint varint;
+    int8_t rc = MQTT_VARINT_MORE;
+    for (uint16_t i = 0; i < available && rc == MQTT_VARINT_MORE; i++) {
+        rc = varint.push(buf[i]);
+    }
+    if (rc > 0) {
+        *value = varint.value();
+    }
+    return rc;
+}
@@ -0,0 +1,43 @@
+/*
+ MQTTVarint.h - Encodes and decodes the MQTT remaining length field.
+*/
+
+#ifndef MQTTVarint_h
+#define MQTTVarint_h
+
+#include <Arduino.h>
+
+// Largest value that fits in the four bytes of a remaining length
+#define MQTT_VARINT_MAX 268435455UL
+#define MQTT_VARINT_MAX_BYTES 4
+
+// Results of push() and decode()
+#define MQTT_VARINT_MORE       0
+#define MQTT_VARINT_MALFORMED -1
+
+// Decodes a remaining length one byte at a time, as it arrives from the
+// network.
+class MQTTVarint {
+private:
+   uint32_t _value;
+   uint8_t shift;
+   uint8_t count;
+public:
+   MQTTVarint();
+   void reset();
+   // Adds the next byte. Returns the number of bytes the field used once it
+   // is complete, MQTT_VARINT_MORE if another byte is needed or
+   // MQTT_VARINT_MALFORMED if the field is longer than four bytes.
+   int8_t push(uint8_t digit);
+   uint32_t value();
+
+   // Number of bytes needed to encode value, or 0 if it is too large
+   static uint8_t length(uint32_t value);
+   // Writes value to buf and returns the number of bytes written, or 0 if
+   // value is too large
+   static uint8_t encode(uint32_t value, uint8_t* buf);
+   // Reads a field from the first available bytes of buf. Returns as push().
+   static int8_t decode(const uint8_t* buf, uint16_t available, uint32_t* value);
+};
+
+#endif
@@ -7,40 +7,139 @@
 #include "PubSubClient.h"
 #include "Arduino.h"
 
-PubSubClient::PubSubClient() {
+static unsigned long defaultClock() {
+    return millis();
+}
+
+// Metrics are counted through these, which do nothing and are inlined away
+// unless MQTT_METRICS is set
+#if MQTT_METRICS
+inline void PubSubClient::countIn(uint8_t header, uint32_t bytes) {
+    _metrics.packetsIn[header >> 4]++;
+    _metrics.bytesIn[header >> 4] += bytes;
+}
+
+inline void PubSubClient::countOut(uint8_t header, uint32_t bytes, uint16_t packets) {
+    _metrics.packetsOut[header >> 4] += packets;
+    _metrics.bytesOut[header >> 4] += bytes;
+}
+
+inline void PubSubClient::countDropped(uint32_t packets) {
+    _metrics.oversizeDropped += packets;
+}
+
+inline void PubSubClient::countConnect(unsigned long latency) {
+    if (_metrics.connects++ > 0) {
+        _metrics.reconnects++;
+    }
+    _metrics.connackLatency = latency;
+}
+
+inline void PubSubClient::countPing(unsigned long rtt) {
+    if (_metrics.pings++ == 0 || rtt < _metrics.pingRttMin) {
+        _metrics.pingRttMin = rtt;
+    }
+    if (rtt > _metrics.pingRttMax) {
+        _metrics.pingRttMax = rtt;
+    }
+    _metrics.pingRttTotal += rtt;
+}
+
+inline unsigned long PubSubClient::blockStart() {
+    return micros();
+}
+
+inline void PubSubClient::countBlocked(unsigned long start) {
+    _metrics.blockedMicros += micros()-start;
+}
+
+inline void PubSubClient::countWrite() {
+    _metrics.writes++;
+}
+
+inline void PubSubClient::countRejected() {
+    _metrics.inflightInRejected++;
+}
+
+inline void PubSubClient::countLost() {
+    _metrics.inflightOutLost++;
+}
+#else
+inline void PubSubClient::countIn(uint8_t, uint32_t) {}
+inline void PubSubClient::countOut(uint8_t, uint32_t, uint16_t) {}
+inline void PubSubClient::countDropped(uint32_t) {}
+inline void PubSubClient::countConnect(unsigned long) {}
+inline void PubSubClient::countPing(unsigned long) {}
+inline unsigned long PubSubClient::blockStart() { return 0; }
+inline void PubSubClient::countBlocked(unsigned long) {}
+inline void PubSubClient::countWrite() {}
+inline void PubSubClient::countRejected() {}
+inline void PubSubClient::countLost() {}
+#endif
+
+inline void PubSubClient::countOut(uint8_t header, uint32_t bytes) {
+    countOut(header,bytes,1);
+}
+
+// State shared by every constructor
+void PubSubClient::init() {
     this->_state = MQTT_DISCONNECTED;
+    this->router = NULL;
+    this->queue = NULL;
+    this->decoder = NULL;
+    this->retained = NULL;
+    this->staging = NULL;
+    this->stagingSize = 0;
+    this->staged = 0;
+    this->connecting = false;
+    this->_duplicates = 0;
+    this->chunkCallback = NULL;
+    this->callback = NULL;
+#if !MQTT_STD_FUNCTION_CALLBACK
+    this->handler = NULL;
+    this->handlerContext = NULL;
+#endif
+    this->cleanSession = true;
+    this->_sessionPresent = false;
+    this->keepAlive = MQTT_KEEPALIVE;
+    this->socketTimeout = MQTT_SOCKET_TIMEOUT;
+    this->_pingRtt = 0;
+    this->_clock = defaultClock;
+    setLoopBudget(MQTT_LOOP_MAX_PACKETS,MQTT_LOOP_MAX_MICROS);
+    resetInflight();
     this->_client = NULL;
     this->stream = NULL;
-    setCallback(NULL);
+    this->domain = NULL;
+}
+
+PubSubClient::PubSubClient() {
+    init();
 }
 
 PubSubClient::PubSubClient(Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setClient(client);
-    this->stream = NULL;
 }
 
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr, port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr, port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr,port);
     setCallback(callback);
     setClient(client);
@@ -48,26 +147,24 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
 }
 
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip, port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip, port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip,port);
     setCallback(callback);
     setClient(client);
@@ -75,26 +172,24 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
 }
 
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
@@ -114,6 +209,17 @@ boolean PubSubClient::connect(const char *id, const char* willTopic, uint8_t wil
 }
 
 boolean PubSubClient::connect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
+    return beginConnect(id,user,pass,willTopic,willQos,willRetain,willMessage) && endConnect();
+}
+
+boolean PubSubClient::beginConnect(const char *id) {
+    return beginConnect(id,NULL,NULL,0,0,0,0);
+}
+
+// Sends CONNECT and returns without waiting for the CONNACK. The server
+// must ignore whatever follows a CONNECT it refuses, so packets sent before
+// endConnect() can be dropped along with the client side state they created.
+boolean PubSubClient::beginConnect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
     if (!connected()) {
         int result = 0;
 
@@ -123,7 +229,25 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
             result = _client->connect(this->ip, this->port);
         }
         if (result == 1) {
-            nextMsgId = 1;
+            if (cleanSession) {
+                resetInflight();
+            } else {
+                // Keep message ids and in-flight messages; only the
+                // SUBACKs that were lost with the connection are dropped
+                for (uint8_t i=0;i<MQTT_MAX_PENDING_SUBACKS;i++) {
+                    pendingAcks[i].msgId = 0;
+                }
+            }
+            _sessionPresent = false;
+#if MQTT_VERSION == MQTT_VERSION_5
+            // Topic aliases only last for one connection
+            memset(aliasOut,0,sizeof(aliasOut));
+            memset(aliasIn,0,sizeof(aliasIn));
+            nextAlias = 0;
+            serverAliasMax = 0;
+            serverReceiveMax = 0xFFFF;
+            _reasonCode = 0;
+#endif
             // Leave room in the buffer for header and variable length field
             uint16_t length = 5;
             unsigned int j;
@@ -131,7 +255,7 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 #if MQTT_VERSION == MQTT_VERSION_3_1
             uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 9
-#elif MQTT_VERSION == MQTT_VERSION_3_1_1
+#elif MQTT_VERSION == MQTT_VERSION_3_1_1 || MQTT_VERSION == MQTT_VERSION_5
             uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 7
 #endif
@@ -141,9 +265,12 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 
             uint8_t v;
             if (willTopic) {
-                v = 0x06|(willQos<<3)|(willRetain<<5);
+                v = 0x04|(willQos<<3)|(willRetain<<5);
             } else {
-                v = 0x02;
+                v = 0x00;
+            }
+            if (cleanSession) {
+                v = v|0x02;
             }
 
             if(user != NULL) {
@@ -156,10 +283,23 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 
             buffer[length++] = v;
 
-            buffer[length++] = ((MQTT_KEEPALIVE) >> 8);
-            buffer[length++] = ((MQTT_KEEPALIVE) & 0xFF);
+            buffer[length++] = ((this->keepAlive) >> 8);
+            buffer[length++] = ((this->keepAlive) & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+            // The properties are short enough for a one byte length
+            uint16_t properties = length++;
+            length = MQTTProperties::writeUint16(buffer,length,MQTT_PROP_RECEIVE_MAXIMUM,MQTT_MAX_INFLIGHT_IN);
+            length = MQTTProperties::writeUint16(buffer,length,MQTT_PROP_TOPIC_ALIAS_MAXIMUM,MQTT5_TOPIC_ALIAS_IN);
+            if (!cleanSession) {
+                length = MQTTProperties::writeUint32(buffer,length,MQTT_PROP_SESSION_EXPIRY,MQTT5_SESSION_EXPIRY);
+            }
+            buffer[properties] = length-properties-1;
+#endif
             length = writeString(id,buffer,length);
             if (willTopic) {
+#if MQTT_VERSION == MQTT_VERSION_5
+                buffer[length++] = 0; // no will properties
+#endif
                 length = writeString(willTopic,buffer,length);
                 length = writeString(willMessage,buffer,length);
             }
@@ -171,56 +311,115 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
                 }
             }
 
-            write(MQTTCONNECT,buffer,length-5);
-
-            lastInActivity = lastOutActivity = millis();
-
-            while (!_client->available()) {
-                unsigned long t = millis();
-                if (t-lastInActivity >= ((int32_t) MQTT_SOCKET_TIMEOUT*1000UL)) {
-                    _state = MQTT_CONNECTION_TIMEOUT;
-                    _client->stop();
-                    return false;
-                }
+            saveSession(pipelined);
+            this->connecting = true;
+            // Anything left from the last connection is of no use now
+            this->staged = 0;
+            if (!write(MQTTCONNECT,buffer,length-5)) {
+                this->connecting = false;
+                _state = MQTT_CONNECT_FAILED;
+                abandonConnect();
+                return false;
             }
-            uint8_t llen;
-            uint16_t len = readPacket(&llen);
 
-            if (len == 4) {
-                if (buffer[3] == 0) {
-                    lastInActivity = millis();
-                    pingOutstanding = false;
-                    _state = MQTT_CONNECTED;
-                    return true;
-                } else {
-                    _state = buffer[3];
-                }
+            lastInActivity = lastOutActivity = _clock();
+            if (decoder) {
+                decoder->reset();
             }
-            _client->stop();
-        } else {
-            _state = MQTT_CONNECT_FAILED;
+            return true;
         }
+        _state = MQTT_CONNECT_FAILED;
         return false;
     }
     return true;
 }
 
+boolean PubSubClient::endConnect() {
+    if (!this->connecting) {
+        // Already connected; what was sent since beginConnect() still goes
+        // out now
+        return flush() && connected();
+    }
+    this->connecting = false;
+    if (!flush()) {
+        _state = MQTT_CONNECT_FAILED;
+        abandonConnect();
+        return false;
+    }
+
+    unsigned long since = blockStart();
+    while (!_client->available()) {
+        unsigned long t = _clock();
+        if (t-lastInActivity >= this->socketTimeout*1000UL) {
+            countBlocked(since);
+            _state = MQTT_CONNECTION_TIMEOUT;
+            abandonConnect();
+            return false;
+        }
+    }
+    countBlocked(since);
+    uint8_t llen;
+    uint32_t len = readPacket(&llen);
+    if (len > 0) {
+        countIn(buffer[0],len);
+    }
+
+#if MQTT_VERSION == MQTT_VERSION_5
+    if (len >= 4 && (buffer[0]&0xF0) == MQTTCONNACK) {
+        readConnack(llen,len);
+#else
+    if (len == 4) {
+#endif
+        if (buffer[3] == 0) {
+            unsigned long t = _clock();
+            countConnect(t-lastInActivity);
+            lastInActivity = t;
+            pingOutstanding = false;
+            _state = MQTT_CONNECTED;
+            if (!cleanSession) {
+                resumeSession(buffer[2]&0x01);
+            }
+            flushQueue();
+            return true;
+        } else {
+            _state = buffer[3];
+        }
+    }
+    abandonConnect();
+    return false;
+}
+
+// Undoes what was sent after the CONNECT of a connection that failed
+void PubSubClient::abandonConnect() {
+    this->staged = 0;
+    restoreSession(pipelined);
+    for (uint8_t i=0;i<MQTT_MAX_PENDING_SUBACKS;i++) {
+        pendingAcks[i].msgId = 0;
+    }
+    _client->stop();
+}
+
 // reads a byte into result
 boolean PubSubClient::readByte(uint8_t * result) {
-   uint32_t previousMillis = millis();
-   while(!_client->available()) {
-     uint32_t currentMillis = millis();
-     if(currentMillis - previousMillis >= ((int32_t) MQTT_SOCKET_TIMEOUT * 1000)){
-       return false;
+   if (!_client->available()) {
+     uint32_t previousMillis = _clock();
+     unsigned long since = blockStart();
+     while(!_client->available()) {
+       uint32_t currentMillis = _clock();
+       if(currentMillis - previousMillis >= this->socketTimeout*1000UL){
+         countBlocked(since);
+         return false;
+       }
      }
+     countBlocked(since);
    }
    *result = _client->read();
    return true;
 }
 
 // reads a byte into result[*index] and increments index
-boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
-  uint16_t current_index = *index;
+boolean PubSubClient::readByte(uint8_t * result, uint32_t * index){
+  uint32_t current_index = *index;
   uint8_t * write_address = &(result[current_index]);
   if(readByte(write_address)){
     *index = current_index + 1;
@@ -229,22 +428,33 @@ boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
   return false;
 }
 
-uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
-    uint16_t len = 0;
+uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
+    uint32_t len = 0;
     if(!readByte(buffer, &len)) return 0;
     bool isPublish = (buffer[0]&0xF0) == MQTTPUBLISH;
-    uint32_t multiplier = 1;
-    uint16_t length = 0;
+    MQTTVarint varint;
+    int8_t rc;
+    uint32_t length = 0;
     uint8_t digit = 0;
     uint16_t skip = 0;
     uint8_t start = 0;
+    this->pendingPayload = 0;
+#if MQTT_VERSION == MQTT_VERSION_5
+    MQTTVarint properties;
+    int8_t propertiesRc = MQTT_VARINT_MORE;
+#endif
 
     do {
         if(!readByte(&digit)) return 0;
         buffer[len++] = digit;
-        length += (digit & 127) * multiplier;
-        multiplier *= 128;
-    } while ((digit & 128) != 0);
+        rc = varint.push(digit);
+    } while (rc == MQTT_VARINT_MORE);
+    if (rc == MQTT_VARINT_MALFORMED) {
+        // The packet boundaries are lost
+        _client->stop();
+        return 0;
+    }
+    length = varint.value();
     *lengthLength = len-1;
 
     if (isPublish) {
@@ -253,15 +463,53 @@ uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
         if(!readByte(buffer, &len)) return 0;
         skip = (buffer[*lengthLength+1]<<8)+buffer[*lengthLength+2];
         start = 2;
-        if (buffer[0]&MQTTQOS1) {
+        if (buffer[0]&0x06) {
             // skip message id
             skip += 2;
         }
+        if (this->chunkCallback && len+length-2 > MQTT_MAX_PACKET_SIZE && len+skip < MQTT_MAX_PACKET_SIZE) {
+            // Too big for the buffer: read only the topic and message id.
+            // The payload is left on the client for deliver() to hand out
+            // a window at a time.
+            for (uint16_t i = 0;i<skip;i++) {
+                if(!readByte(buffer, &len)) return 0;
+            }
+#if MQTT_VERSION == MQTT_VERSION_5
+            // The properties are kept in the buffer for handlePacket()
+            do {
+                if(!readByte(buffer, &len)) return 0;
+                skip++;
+                propertiesRc = properties.push(buffer[len-1]);
+            } while (propertiesRc == MQTT_VARINT_MORE && len < MQTT_MAX_PACKET_SIZE);
+            if (propertiesRc < 0 || len+properties.value() >= MQTT_MAX_PACKET_SIZE) {
+                // No room left for the payload; drop the packet
+                countDropped(1);
+                this->pendingPayload = length-2-skip;
+                skipPending();
+                return 0;
+            }
+            for (uint32_t i = 0;i<properties.value();i++) {
+                if(!readByte(buffer, &len)) return 0;
+            }
+            skip += properties.value();
+#endif
+            this->pendingPayload = length-2-skip;
+            return len;
+        }
     }
 
-    for (uint16_t i = start;i<length;i++) {
+    for (uint32_t i = start;i<length;i++) {
         if(!readByte(&digit)) return 0;
         if (this->stream) {
+#if MQTT_VERSION == MQTT_VERSION_5
+            if (isPublish && len-*lengthLength-2>skip && propertiesRc == MQTT_VARINT_MORE) {
+                // Move skip past the properties, which come before the payload
+                propertiesRc = properties.push(digit);
+                if (propertiesRc > 0) {
+                    skip += propertiesRc+properties.value();
+                }
+            } else
+#endif
             if (isPublish && len-*lengthLength-2>skip) {
                 this->stream->write(digit);
             }
@@ -273,6 +521,7 @@ uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
     }
 
     if (!this->stream && len > MQTT_MAX_PACKET_SIZE) {
+        countDropped(1);
         len = 0; // This will cause the packet to be ignored.
     }
 
@@ -280,68 +529,366 @@ uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
 }
 
 boolean PubSubClient::loop() {
+    return loop(loopMaxPackets,loopMaxMicros) >= 0;
+}
+
+int PubSubClient::loop(uint16_t maxPackets, unsigned long maxMicros) {
     if (connected()) {
-        unsigned long t = millis();
-        if ((t - lastInActivity > MQTT_KEEPALIVE*1000UL) || (t - lastOutActivity > MQTT_KEEPALIVE*1000UL)) {
-            if (pingOutstanding) {
+        if (this->connecting) {
+            // The CONNACK is endConnect()'s to read, and no ping may go out
+            // before it
+            return 0;
+        }
+        if (queue && !queue->empty()) {
+            flushQueue();
+        }
+        unsigned long t = _clock();
+        if (pingOutstanding) {
+            // A live server answers well within the socket timeout, so
+            // there's no need to wait for another keepalive interval
+            if (t - pingSentAt >= this->socketTimeout*1000UL) {
                 this->_state = MQTT_CONNECTION_TIMEOUT;
                 _client->stop();
+                return -1;
+            }
+        } else if (this->keepAlive && (t - lastOutActivity > this->keepAlive*1000UL ||
+                                       t - lastInActivity > this->keepAlive*1000UL)) {
+            // The server needs to hear from us once per keepalive interval.
+            // A server that has been silent as long may be gone without the
+            // connection noticing, so it is asked too, even while we publish
+            buffer[0] = MQTTPINGREQ;
+            buffer[1] = 0;
+            writeChunked(buffer,2);
+            countOut(MQTTPINGREQ,2);
+            // Sent now, along with anything else waiting, so the round trip
+            // is timed from when it leaves
+            flush();
+            lastOutActivity = t;
+            pingSentAt = t;
+            pingOutstanding = true;
+        }
+        int count = 0;
+        unsigned long start = micros();
+        boolean decode = decoder && !stream && !chunkCallback;
+        while (_client->available()) {
+            if (decode ? decodePacket(t) : handlePacket(t)) {
+                count++;
+            }
+            if ((maxPackets && count >= maxPackets) || (maxMicros && micros()-start >= maxMicros)) {
+                break;
+            }
+            if (!connected()) {
+                // The callback may have disconnected
+                break;
+            }
+        }
+        // Acknowledgements and whatever was published since the last call
+        // go out together
+        flush();
+        return count;
+    }
+    return -1;
+}
+
+// Reads one packet and acts on it. Returns false if nothing was read.
+boolean PubSubClient::handlePacket(unsigned long t) {
+    uint8_t llen;
+    uint32_t len = readPacket(&llen);
+    return handlePacket(t,len,llen);
+}
+
+// Feeds the decoder what is available, stopping at the end of a packet,
+// and acts on the packet once it is complete. Returns false if no packet
+// was completed.
+boolean PubSubClient::decodePacket(unsigned long t) {
+    uint8_t chunk[32];
+    while (_client->available()) {
+        uint32_t n = decoder->needed();
+        uint32_t available = _client->available();
+        if (n > available) {
+            n = available;
+        }
+        if (n > sizeof(chunk)) {
+            n = sizeof(chunk);
+        }
+        int rc = _client->read(chunk,n);
+        if (rc <= 0) {
+            return false;
+        }
+        uint32_t dropped = decoder->dropped();
+        decoder->push(chunk,rc);
+        countDropped(decoder->dropped()-dropped);
+        if (decoder->malformed()) {
+            // The packet boundaries are lost
+            decoder->reset();
+            _client->stop();
+            return false;
+        }
+        if (decoder->ready()) {
+            const MQTTPacket& packet = decoder->packet();
+            if (packet.length > MQTT_MAX_PACKET_SIZE) {
+                countDropped(1);
                 return false;
+            }
+            memcpy(buffer,packet.data,packet.length);
+            this->pendingPayload = 0;
+            return handlePacket(t,packet.length,packet.headerLength-1);
+        }
+    }
+    return false;
+}
+
+boolean PubSubClient::handlePacket(unsigned long t, uint32_t len, uint8_t llen) {
+    uint16_t msgId = 0;
+    uint8_t *payload;
+    if (len > 0) {
+        lastInActivity = t;
+        countIn(buffer[0],len+this->pendingPayload);
+        uint8_t type = buffer[0]&0xF0;
+        if (type == MQTTPUBLISH) {
+            uint8_t qos = buffer[0]&0x06;
+            uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2];
+            uint32_t end = (uint32_t)llen+3+tl+(qos?2:0);
+            if (end > len || end > MQTT_MAX_PACKET_SIZE) {
+                // The topic and message id run past the end of the packet
+                this->pendingPayload = 0;
+                _client->stop();
+                return true;
+            }
+            // Move the topic down over its length field to make room
+            // for a null terminator, so it is handed out without a copy
+            memmove(buffer+llen+2,buffer+llen+3,tl);
+            buffer[llen+2+tl] = 0;
+            char *topic = (char*) buffer+llen+2;
+            payload = buffer+llen+3+tl;
+            unsigned int plength = len-llen-3-tl;
+            // msgId only present for QOS>0
+            if (qos) {
+                msgId = (payload[0]<<8)+payload[1];
+                payload += 2;
+                plength -= 2;
+            }
+#if MQTT_VERSION == MQTT_VERSION_5
+            uint32_t propertiesLength;
+            int8_t n = MQTTVarint::decode(payload,plength,&propertiesLength);
+            if (n <= 0 || propertiesLength > plength-n) {
+                _client->stop();
+                return true;
+            }
+            uint16_t alias = 0;
+            MQTTProperties properties(payload+n,propertiesLength);
+            while (properties.next()) {
+                if (properties.id() == MQTT_PROP_TOPIC_ALIAS) {
+                    alias = properties.value();
+                }
+            }
+            payload += n+propertiesLength;
+            plength -= n+propertiesLength;
+            if (alias) {
+                topic = resolveAlias(alias,topic,&tl);
+                if (!topic) {
+                    // An alias the server never set up
+                    skipPending();
+                    _client->stop();
+                    return true;
+                }
+            }
+#endif
+            if (qos == MQTTQOS2) {
+                if (isInflightIn(msgId)) {
+                    // Already delivered; the server missed our PUBREC
+                    if (skipPending()) {
+                        writeAck(MQTTPUBREC,msgId);
+                    }
+                } else if (addInflightIn(msgId)) {
+                    if (deliver(topic,tl,payload,plength)) {
+                        writeAck(MQTTPUBREC,msgId);
+                    }
+                } else {
+                    // With no free slot the message is refused. MQTT 3.1.1
+                    // has no way to say so; left unacknowledged, it is sent
+                    // again after the next reconnect.
+                    countRejected();
+                    if (skipPending()) {
+#if MQTT_VERSION == MQTT_VERSION_5
+                        writeAck(MQTTPUBREC,msgId,MQTT_REASON_QUOTA_EXCEEDED);
+#endif
+                    }
+                }
+            } else if (qos == MQTTQOS1 && isDuplicateIn(msgId,buffer[0]&0x08)) {
+                // Already delivered; the server missed our PUBACK
+                if (skipPending()) {
+                    writeAck(MQTTPUBACK,msgId);
+                }
             } else {
-                buffer[0] = MQTTPINGREQ;
-                buffer[1] = 0;
-                _client->write(buffer,2);
-                lastOutActivity = t;
-                lastInActivity = t;
-                pingOutstanding = true;
-            }
-        }
-        if (_client->available()) {
-            uint8_t llen;
-            uint16_t len = readPacket(&llen);
-            uint16_t msgId = 0;
-            uint8_t *payload;
-            if (len > 0) {
-                lastInActivity = t;
-                uint8_t type = buffer[0]&0xF0;
-                if (type == MQTTPUBLISH) {
-                    if (callback) {
-                        uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2];
-                        char topic[tl+1];
-                        for (uint16_t i=0;i<tl;i++) {
-                            topic[i] = buffer[llen+3+i];
-                        }
-                        topic[tl] = 0;
-                        // msgId only present for QOS>0
-                        if ((buffer[0]&0x06) == MQTTQOS1) {
-                            msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
-                            payload = buffer+llen+3+tl+2;
-                            callback(topic,payload,len-llen-3-tl-2);
-
-                            buffer[0] = MQTTPUBACK;
-                            buffer[1] = 2;
-                            buffer[2] = (msgId >> 8);
-                            buffer[3] = (msgId & 0xFF);
-                            _client->write(buffer,4);
-                            lastOutActivity = t;
-
-                        } else {
-                            payload = buffer+llen+3+tl;
-                            callback(topic,payload,len-llen-3-tl);
-                        }
+                if (deliver(topic,tl,payload,plength) && qos == MQTTQOS1) {
+#if MQTT_DEDUP_WINDOW > 0
+                    seenIn.add(msgId);
+#endif
+                    writeAck(MQTTPUBACK,msgId);
+                }
+            }
+#if MQTT_VERSION == MQTT_VERSION_5
+        } else if (type == MQTTPUBACK) {
+            msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+            _reasonCode = (len > (uint32_t)llen+3)?buffer[llen+3]:0;
+            MQTTInflight* inflight = findInflightOut(msgId);
+            if (inflight && inflight->state == MQTT_INFLIGHT_AWAIT_PUBACK) {
+                inflight->state = MQTT_INFLIGHT_FREE;
+                inflight->msgId = 0;
+            }
+#endif
+        } else if (type == MQTTPUBREC) {
+            msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+            MQTTInflight* inflight = findInflightOut(msgId);
+#if MQTT_VERSION == MQTT_VERSION_5
+            _reasonCode = (len > (uint32_t)llen+3)?buffer[llen+3]:0;
+            if (_reasonCode >= 0x80) {
+                // The server refused the message, which ends the exchange
+                if (inflight) {
+                    inflight->state = MQTT_INFLIGHT_FREE;
+                    inflight->msgId = 0;
+                }
+                return true;
+            }
+#endif
+            if (inflight) {
+                inflight->state = MQTT_INFLIGHT_AWAIT_PUBCOMP;
+            }
+            writeAck(MQTTPUBREL|MQTTQOS1,msgId);
+        } else if (type == MQTTPUBREL) {
+            msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+            removeInflightIn(msgId);
+            writeAck(MQTTPUBCOMP,msgId);
+        } else if (type == MQTTPUBCOMP) {
+            msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+#if MQTT_VERSION == MQTT_VERSION_5
+            _reasonCode = (len > (uint32_t)llen+3)?buffer[llen+3]:0;
+#endif
+            MQTTInflight* inflight = findInflightOut(msgId);
+            if (inflight && inflight->state == MQTT_INFLIGHT_AWAIT_PUBCOMP) {
+                inflight->state = MQTT_INFLIGHT_FREE;
+                inflight->msgId = 0;
+            }
+        } else if (type == MQTTSUBACK || type == MQTTUNSUBACK) {
+            msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+            MQTTPendingAck* pending = findPendingAck(msgId);
+            if (pending) {
+                uint32_t codesAt = llen+3;
+#if MQTT_VERSION == MQTT_VERSION_5
+                // Both acks carry reason codes, after the properties
+                codesAt = skipProperties(codesAt,len);
+                uint16_t codes = len-codesAt;
+#else
+                // UNSUBACK carries no return codes
+                uint16_t codes = (type == MQTTSUBACK)?len-llen-3:0;
+#endif
+                for (uint8_t i=0;i<pending->count;i++) {
+                    uint8_t code = 0;
+                    if (codes > 0) {
+                        code = (i < codes)?buffer[codesAt+i]:MQTT_SUBACK_FAILURE;
                     }
-                } else if (type == MQTTPINGREQ) {
-                    buffer[0] = MQTTPINGRESP;
-                    buffer[1] = 0;
-                    _client->write(buffer,2);
-                } else if (type == MQTTPINGRESP) {
-                    pingOutstanding = false;
+                    pending->subscriptions[i].result = code;
                 }
+                pending->msgId = 0;
+            }
+        } else if (type == MQTTPINGREQ) {
+            buffer[0] = MQTTPINGRESP;
+            buffer[1] = 0;
+            writeChunked(buffer,2);
+            countOut(MQTTPINGRESP,2);
+        } else if (type == MQTTPINGRESP) {
+            if (pingOutstanding) {
+                _pingRtt = _clock()-pingSentAt;
+                countPing(_pingRtt);
+            }
+            pingOutstanding = false;
+#if MQTT_VERSION == MQTT_VERSION_5
+        } else if (type == MQTTDISCONNECT) {
+            // The server is closing the connection; its reason code says why
+            _reasonCode = (len > (uint32_t)llen+1)?buffer[llen+1]:0;
+            _state = MQTT_CONNECTION_LOST;
+            _client->stop();
+#endif
+        }
+    }
+    return len > 0;
+}
+
+boolean PubSubClient::deliver(char* topic, uint16_t topicLength, uint8_t* payload, unsigned int plength) {
+    if (retained) {
+        if ((buffer[0]&0x01) && !this->stream && this->pendingPayload == 0) {
+            if (!retained->update(topic,topicLength,payload,plength)) {
+                // The application already has this message
+                return true;
             }
+        } else {
+            // The application has seen something newer than what is kept,
+            // so the kept message is no longer the one it has
+            retained->forget(topic,topicLength);
         }
+    }
+    if (this->pendingPayload == 0) {
+        dispatch(topic,topicLength,payload,plength);
         return true;
     }
-    return false;
+    // The payload is still on the client; read it into the space left in
+    // the buffer after the topic and message id, one window at a time.
+    uint16_t window = MQTT_MAX_PACKET_SIZE-(payload-buffer);
+    uint32_t total = this->pendingPayload;
+    uint32_t offset = 0;
+    while (this->pendingPayload > 0) {
+        uint16_t chunk = window;
+        if (chunk > this->pendingPayload) {
+            chunk = this->pendingPayload;
+        }
+        for (uint16_t i = 0;i<chunk;i++) {
+            if (!readByte(payload+i)) {
+                // The rest of the packet is lost; the stream can't be resynced
+                this->pendingPayload = 0;
+                _client->stop();
+                return false;
+            }
+        }
+        this->pendingPayload -= chunk;
+        chunkCallback(topic,total,offset,payload,chunk);
+        offset += chunk;
+    }
+    return true;
+}
+
+boolean PubSubClient::skipPending() {
+    uint8_t digit;
+    while (this->pendingPayload > 0) {
+        if (!readByte(&digit)) {
+            this->pendingPayload = 0;
+            _client->stop();
+            return false;
+        }
+        this->pendingPayload--;
+    }
+    return true;
+}
+
+void PubSubClient::dispatch(char* topic, uint16_t topicLength, uint8_t* payload, unsigned int plength) {
+    if (router) {
+        MQTTTopic t;
+        t.name = topic;
+        t.length = topicLength;
+        if (router->dispatch(t,payload,plength) > 0) {
+            return;
+        }
+    }
+    // Messages no handler matched go to the callback
+#if !MQTT_STD_FUNCTION_CALLBACK
+    if (handler) {
+        handler(topic,payload,plength,handlerContext);
+        return;
+    }
+#endif
+    if (callback) {
+        callback(topic,payload,plength);
+    }
 }
 
 boolean PubSubClient::publish(const char* topic, const char* payload) {
@@ -357,135 +904,269 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
 }
 
 boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publish(topic, payload, plength, 0, retained);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, uint8_t qos, boolean retained) {
+    return publish(topic, payload, plength, qos, retained, false);
+}
+
+boolean PubSubClient::publishLatest(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publish(topic, payload, plength, 0, retained, true);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, uint8_t qos, boolean retained, boolean latestOnly) {
+    if (qos > 2) {
+        return false;
+    }
+    if (queue && qos == 0) {
+        // Keep order with anything still queued from while disconnected
+        if (!connected() || this->connecting || !flushQueue()) {
+            return queue->push(MQTTPUBLISH | (retained?1:0), topic, payload, plength, latestOnly);
+        }
+    }
     if (connected()) {
-        if (MQTT_MAX_PACKET_SIZE < 5 + 2+strlen(topic) + plength) {
+        if (MQTT_MAX_PACKET_SIZE < 5 + 2+strlen(topic) + (qos?2:0) + MQTT_PUBLISH_PROPERTIES + plength) {
             // Too long
             return false;
         }
+        MQTTInflight* inflight = NULL;
+#if MQTT_VERSION == MQTT_VERSION_5
+        if (qos > 0) {
+            // QoS 1 and 2 messages both count towards the server's receive
+            // maximum
+            inflight = findInflightOut(0);
+            if (!inflight || inflightCount() >= serverReceiveMax) {
+                return false;
+            }
+        }
+#else
+        if (qos == 2) {
+            inflight = findInflightOut(0);
+            if (!inflight) {
+                // No free slot for another QoS 2 message
+                return false;
+            }
+        }
+#endif
         // Leave room in the buffer for header and variable length field
         uint16_t length = 5;
+#if MQTT_VERSION == MQTT_VERSION_5
+        boolean aliasKnown;
+        uint16_t alias = topicAlias(topic,&aliasKnown);
+        // Once the server knows the alias the topic can be left out
+        length = writeString(aliasKnown?"":topic,buffer,length);
+#else
         length = writeString(topic,buffer,length);
+#endif
+        uint16_t msgId = 0;
+        if (qos > 0) {
+            msgId = nextMessageId();
+            buffer[length++] = (msgId >> 8);
+            buffer[length++] = (msgId & 0xFF);
+        }
+#if MQTT_VERSION == MQTT_VERSION_5
+        length = writeProperties(buffer,length,alias);
+#endif
         uint16_t i;
         for (i=0;i<plength;i++) {
             buffer[length++] = payload[i];
         }
-        uint8_t header = MQTTPUBLISH;
+        uint8_t header = MQTTPUBLISH | (qos << 1);
         if (retained) {
             header |= 1;
         }
-        return write(header,buffer,length-5);
+        if (!write(header,buffer,length-5)) {
+            return false;
+        }
+        if (inflight) {
+            inflight->msgId = msgId;
+#if MQTT_VERSION == MQTT_VERSION_5
+            inflight->state = (qos == 2)?MQTT_INFLIGHT_AWAIT_PUBREC:MQTT_INFLIGHT_AWAIT_PUBACK;
+#else
+            inflight->state = MQTT_INFLIGHT_AWAIT_PUBREC;
+#endif
+        }
+        return true;
     }
     return false;
 }
 
 boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
-    uint8_t llen = 0;
-    uint8_t digit;
-    unsigned int rc = 0;
     uint16_t tlen;
     unsigned int pos = 0;
     unsigned int i;
     uint8_t header;
-    unsigned int len;
 
     if (!connected()) {
         return false;
     }
 
     tlen = strlen(topic);
+    if (MQTT_MAX_PACKET_SIZE < 5 + 2 + tlen + MQTT_NO_PROPERTIES) {
+        // Too long
+        return false;
+    }
 
     header = MQTTPUBLISH;
     if (retained) {
         header |= 1;
     }
     buffer[pos++] = header;
-    len = plength + 2 + tlen;
+    pos += MQTTVarint::encode((uint32_t)plength+2+tlen+MQTT_NO_PROPERTIES,buffer+pos);
+    pos = writeString(topic,buffer,pos);
+    pos = writeProperties(buffer,pos,0);
+    countOut(header,pos+plength);
+
+    // Copy the payload out of PROGMEM a buffer-full at a time, the first
+    // chunk going out together with the header and topic
+    i = 0;
     do {
-        digit = len % 128;
-        len = len / 128;
-        if (len > 0) {
-            digit |= 0x80;
+        while (i < plength && pos < MQTT_MAX_PACKET_SIZE) {
+            buffer[pos++] = pgm_read_byte_near(payload + i++);
+        }
+        if (!writeChunked(buffer,pos)) {
+            return false;
         }
-        buffer[pos++] = digit;
-        llen++;
-    } while(len>0);
+        pos = 0;
+    } while (i < plength);
 
-    pos = writeString(topic,buffer,pos);
+    lastOutActivity = _clock();
 
-    rc += _client->write(buffer,pos);
+    return true;
+}
 
-    for (i=0;i<plength;i++) {
-        rc += _client->write((char)pgm_read_byte_near(payload + i));
+boolean PubSubClient::beginPublish(const char* topic, uint32_t plength, boolean retained) {
+    if (!connected()) {
+        return false;
+    }
+    uint16_t tlen = strlen(topic);
+    if (MQTT_MAX_PACKET_SIZE < 5 + 2 + tlen + MQTT_NO_PROPERTIES || plength > MQTT_VARINT_MAX - 2 - tlen - MQTT_NO_PROPERTIES) {
+        // Too long
+        return false;
     }
+    uint16_t pos = 0;
+    buffer[pos++] = retained?(MQTTPUBLISH|1):MQTTPUBLISH;
+    pos += MQTTVarint::encode(plength+2+tlen+MQTT_NO_PROPERTIES,buffer+pos);
+    pos = writeString(topic,buffer,pos);
+    pos = writeProperties(buffer,pos,0);
+    countOut(buffer[0],pos+plength);
+    lastOutActivity = _clock();
+    return writeChunked(buffer,pos);
+}
 
-    lastOutActivity = millis();
+size_t PubSubClient::write(uint8_t data) {
+    lastOutActivity = _clock();
+    return writeChunked(&data,1)?1:0;
+}
 
-    return rc == tlen + 4 + plength;
+size_t PubSubClient::write(const uint8_t* buf, size_t size) {
+    lastOutActivity = _clock();
+    return writeChunked(buf,size)?size:0;
 }
 
-boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
-    uint8_t lenBuf[4];
-    uint8_t llen = 0;
-    uint8_t digit;
-    uint8_t pos = 0;
-    uint16_t rc;
-    uint16_t len = length;
-    do {
-        digit = len % 128;
-        len = len / 128;
-        if (len > 0) {
-            digit |= 0x80;
-        }
-        lenBuf[pos++] = digit;
-        llen++;
-    } while(len>0);
+boolean PubSubClient::endPublish() {
+    return flush() && connected();
+}
 
+boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint32_t length) {
+    uint8_t llen = MQTTVarint::length(length);
+    if (llen == 0) {
+        return false;
+    }
     buf[4-llen] = header;
-    for (int i=0;i<llen;i++) {
-        buf[5-llen+i] = lenBuf[i];
+    MQTTVarint::encode(length,buf+5-llen);
+
+    boolean result = writeChunked(buf+(4-llen),length+1+llen);
+    countOut(header,length+1+llen);
+    lastOutActivity = _clock();
+    return result;
+}
+
+// Passes buf to the network client, split into pieces of at most
+// MQTT_MAX_TRANSFER_SIZE bytes when that is defined.
+boolean PubSubClient::writeChunked(const uint8_t* buf, uint32_t length) {
+    if (this->staging) {
+        if ((uint32_t)(this->stagingSize-this->staged) < length && !flush()) {
+            return false;
+        }
+        if ((uint32_t)(this->stagingSize-this->staged) >= length) {
+            memcpy(this->staging+this->staged,buf,length);
+            this->staged += length;
+            return true;
+        }
     }
+    return writeDirect(buf,length);
+}
 
+boolean PubSubClient::flush() {
+    uint16_t length = this->staged;
+    this->staged = 0;
+    return length == 0 || writeDirect(this->staging,length);
+}
+
+boolean PubSubClient::writeDirect(const uint8_t* buf, uint32_t length) {
+    unsigned long since = blockStart();
+    countWrite();
 #ifdef MQTT_MAX_TRANSFER_SIZE
-    uint8_t* writeBuf = buf+(4-llen);
-    uint16_t bytesRemaining = length+1+llen;  //Match the length type
-    uint8_t bytesToWrite;
-    boolean result = true;
-    while((bytesRemaining > 0) && result) {
-        bytesToWrite = (bytesRemaining > MQTT_MAX_TRANSFER_SIZE)?MQTT_MAX_TRANSFER_SIZE:bytesRemaining;
-        rc = _client->write(writeBuf,bytesToWrite);
-        result = (rc == bytesToWrite);
-        bytesRemaining -= rc;
-        writeBuf += rc;
+    while (length > 0) {
+        uint16_t bytesToWrite = (length > MQTT_MAX_TRANSFER_SIZE)?MQTT_MAX_TRANSFER_SIZE:length;
+        uint16_t rc = _client->write(buf,bytesToWrite);
+        if (rc != bytesToWrite) {
+            countBlocked(since);
+            return false;
+        }
+        length -= rc;
+        buf += rc;
     }
-    return result;
+    countBlocked(since);
+    return true;
 #else
-    rc = _client->write(buf+(4-llen),length+1+llen);
-    lastOutActivity = millis();
-    return (rc == 1+llen+length);
+    boolean result = (_client->write(buf,length) == length);
+    countBlocked(since);
+    return result;
 #endif
 }
 
+// Writes queued packets in runs that are stored back to back, one write call
+// per run. Returns true once the queue is empty.
+boolean PubSubClient::flushQueue() {
+    if (!queue) {
+        return true;
+    }
+    const uint8_t* data;
+    uint16_t length;
+    while ((length = queue->peek(&data)) > 0) {
+        if (!writeChunked(data,length)) {
+            return false;
+        }
+        lastOutActivity = _clock();
+        uint8_t depth = queue->depth();
+        queue->pop(length);
+        countOut(MQTTPUBLISH,length,depth-queue->depth());
+    }
+    return true;
+}
+
 boolean PubSubClient::subscribe(const char* topic) {
     return subscribe(topic, 0);
 }
 
 boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
-    if (qos < 0 || qos > 1) {
+    if (qos > 2) {
         return false;
     }
-    if (MQTT_MAX_PACKET_SIZE < 9 + strlen(topic)) {
+    if (MQTT_MAX_PACKET_SIZE < 9 + MQTT_NO_PROPERTIES + strlen(topic)) {
         // Too long
         return false;
     }
     if (connected()) {
         // Leave room in the buffer for header and variable length field
         uint16_t length = 5;
-        nextMsgId++;
-        if (nextMsgId == 0) {
-            nextMsgId = 1;
-        }
-        buffer[length++] = (nextMsgId >> 8);
-        buffer[length++] = (nextMsgId & 0xFF);
+        uint16_t msgId = nextMessageId();
+        buffer[length++] = (msgId >> 8);
+        buffer[length++] = (msgId & 0xFF);
+        length = writeProperties(buffer,length,0);
         length = writeString((char*)topic, buffer,length);
         buffer[length++] = qos;
         return write(MQTTSUBSCRIBE|MQTTQOS1,buffer,length-5);
@@ -494,31 +1175,101 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
 }
 
 boolean PubSubClient::unsubscribe(const char* topic) {
-    if (MQTT_MAX_PACKET_SIZE < 9 + strlen(topic)) {
+    if (MQTT_MAX_PACKET_SIZE < 9 + MQTT_NO_PROPERTIES + strlen(topic)) {
         // Too long
         return false;
     }
     if (connected()) {
         uint16_t length = 5;
-        nextMsgId++;
-        if (nextMsgId == 0) {
-            nextMsgId = 1;
-        }
-        buffer[length++] = (nextMsgId >> 8);
-        buffer[length++] = (nextMsgId & 0xFF);
+        uint16_t msgId = nextMessageId();
+        buffer[length++] = (msgId >> 8);
+        buffer[length++] = (msgId & 0xFF);
+        length = writeProperties(buffer,length,0);
         length = writeString(topic, buffer,length);
         return write(MQTTUNSUBSCRIBE|MQTTQOS1,buffer,length-5);
     }
     return false;
 }
 
+boolean PubSubClient::subscribe(MQTTSubscription* subscriptions, uint8_t count) {
+    return writeSubscriptions(MQTTSUBSCRIBE|MQTTQOS1,subscriptions,count);
+}
+
+boolean PubSubClient::unsubscribe(MQTTSubscription* subscriptions, uint8_t count) {
+    return writeSubscriptions(MQTTUNSUBSCRIBE|MQTTQOS1,subscriptions,count);
+}
+
+// Packs as many consecutive topics as fit into each SUBSCRIBE/UNSUBSCRIBE
+// packet. The return code of each topic is stored in its result field once
+// the acknowledgement arrives in loop(); topics that could not be sent keep
+// MQTT_SUBACK_NOT_SENT and topics too long for any packet, or with an
+// invalid qos, are marked MQTT_SUBACK_FAILURE.
+boolean PubSubClient::writeSubscriptions(uint8_t header, MQTTSubscription* subscriptions, uint8_t count) {
+    boolean withQos = (header&0xF0) == MQTTSUBSCRIBE;
+    boolean rc = true;
+    uint8_t i;
+    for (i=0;i<count;i++) {
+        subscriptions[i].result = MQTT_SUBACK_NOT_SENT;
+        if (withQos && subscriptions[i].qos > 2) {
+            subscriptions[i].result = MQTT_SUBACK_FAILURE;
+            rc = false;
+        }
+    }
+    if (!rc || !connected()) {
+        return false;
+    }
+    i = 0;
+    while (i < count) {
+        MQTTPendingAck* pending = findPendingAck(0);
+        if (!pending) {
+            return false;
+        }
+        // Leave room in the buffer for header and variable length field
+        uint16_t length = 7;
+        length = writeProperties(buffer,length,0);
+        uint8_t first = i;
+        while (i < count) {
+            uint16_t needed = 2 + strlen(subscriptions[i].topic) + (withQos?1:0);
+            if (length + needed > MQTT_MAX_PACKET_SIZE) {
+                break;
+            }
+            length = writeString(subscriptions[i].topic,buffer,length);
+            if (withQos) {
+                buffer[length++] = subscriptions[i].qos;
+            }
+            i++;
+        }
+        if (i == first) {
+            // This topic will never fit
+            subscriptions[i++].result = MQTT_SUBACK_FAILURE;
+            rc = false;
+            continue;
+        }
+        uint16_t msgId = nextMessageId();
+        buffer[5] = (msgId >> 8);
+        buffer[6] = (msgId & 0xFF);
+        if (!write(header,buffer,length-5)) {
+            return false;
+        }
+        for (uint8_t j=first;j<i;j++) {
+            subscriptions[j].result = MQTT_SUBACK_PENDING;
+        }
+        pending->msgId = msgId;
+        pending->count = i-first;
+        pending->subscriptions = subscriptions+first;
+    }
+    return rc;
+}
+
 void PubSubClient::disconnect() {
     buffer[0] = MQTTDISCONNECT;
     buffer[1] = 0;
-    _client->write(buffer,2);
+    writeChunked(buffer,2);
+    countOut(MQTTDISCONNECT,2);
+    flush();
     _state = MQTT_DISCONNECTED;
     _client->stop();
-    lastInActivity = lastOutActivity = millis();
+    lastInActivity = lastOutActivity = _clock();
 }
 
 uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t pos) {
@@ -534,6 +1285,271 @@ uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t po
     return pos;
 }
 
+#if MQTT_VERSION == MQTT_VERSION_5
+// Writes the properties of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE: a topic
+// alias if one is given, otherwise an empty list
+uint16_t PubSubClient::writeProperties(uint8_t* buf, uint16_t pos, uint16_t alias) {
+    if (alias) {
+        buf[pos++] = 3;
+        return MQTTProperties::writeUint16(buf,pos,MQTT_PROP_TOPIC_ALIAS,alias);
+    }
+    buf[pos++] = 0;
+    return pos;
+}
+#else
+// MQTT 3.1.1 packets have no properties
+uint16_t PubSubClient::writeProperties(uint8_t*, uint16_t pos, uint16_t) {
+    return pos;
+}
+#endif
+
+boolean PubSubClient::writeAck(uint8_t header, uint16_t msgId) {
+    uint8_t ack[4];
+    ack[0] = header;
+    ack[1] = 2;
+    ack[2] = (msgId >> 8);
+    ack[3] = (msgId & 0xFF);
+    boolean rc = writeChunked(ack,4);
+    countOut(header,4);
+    lastOutActivity = _clock();
+    return rc;
+}
+
+uint16_t PubSubClient::nextMessageId() {
+    nextMsgId++;
+    if (nextMsgId == 0) {
+        nextMsgId = 1;
+    }
+    return nextMsgId;
+}
+
+// Picks up in-flight messages after a reconnect without clean session.
+// If the server kept the session, PUBRELs that may have been lost are sent
+// again. PUBLISH packets still waiting for a PUBREC (or PUBACK with MQTT 5)
+// can't be, as their payload isn't kept, so those slots are freed.
+void PubSubClient::resumeSession(boolean present) {
+    _sessionPresent = present;
+    if (!present) {
+        resetInflight();
+        return;
+    }
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_OUT;i++) {
+        if (inflightOut[i].state == MQTT_INFLIGHT_AWAIT_PUBCOMP) {
+            writeAck(MQTTPUBREL|MQTTQOS1,inflightOut[i].msgId);
+        } else if (inflightOut[i].state != MQTT_INFLIGHT_FREE) {
+            countLost();
+            inflightOut[i].state = MQTT_INFLIGHT_FREE;
+            inflightOut[i].msgId = 0;
+        }
+    }
+}
+
+#if MQTT_VERSION == MQTT_VERSION_5
+// Reads the properties of a CONNACK, and moves its flags and reason code to
+// where a 3.1.1 CONNACK has them
+void PubSubClient::readConnack(uint8_t llen, uint32_t len) {
+    buffer[2] = buffer[llen+1];
+    buffer[3] = buffer[llen+2];
+    _reasonCode = buffer[3];
+    uint32_t pos = llen+3;
+    uint32_t propertiesLength;
+    int8_t n = MQTTVarint::decode(buffer+pos,len-pos,&propertiesLength);
+    if (n <= 0 || propertiesLength > len-pos-n) {
+        return;
+    }
+    MQTTProperties properties(buffer+pos+n,propertiesLength);
+    while (properties.next()) {
+        if (properties.id() == MQTT_PROP_RECEIVE_MAXIMUM) {
+            serverReceiveMax = properties.value();
+        } else if (properties.id() == MQTT_PROP_TOPIC_ALIAS_MAXIMUM) {
+            serverAliasMax = properties.value();
+        }
+    }
+}
+
+// Returns the position just past the properties starting at pos
+uint32_t PubSubClient::skipProperties(uint32_t pos, uint32_t end) {
+    uint32_t propertiesLength;
+    int8_t n = MQTTVarint::decode(buffer+pos,end-pos,&propertiesLength);
+    if (n <= 0 || propertiesLength > end-pos-n) {
+        return end;
+    }
+    return pos+n+propertiesLength;
+}
+
+// Returns the alias to publish topic with, or 0 for none. known is set if
+// the server already has the alias, so the topic can be left out.
+uint16_t PubSubClient::topicAlias(const char* topic, boolean* known) {
+    *known = false;
+    uint8_t count = (serverAliasMax < MQTT5_TOPIC_ALIAS_OUT)?serverAliasMax:MQTT5_TOPIC_ALIAS_OUT;
+    if (count == 0 || strlen(topic) >= MQTT5_TOPIC_ALIAS_LENGTH) {
+        return 0;
+    }
+    uint8_t i;
+    for (i=0;i<count;i++) {
+        if (strcmp(aliasOut[i],topic) == 0) {
+            *known = true;
+            return i+1;
+        }
+    }
+    // Take the next alias, reusing the oldest once they are all in use
+    i = nextAlias;
+    nextAlias = (nextAlias+1)%count;
+    strcpy(aliasOut[i],topic);
+    return i+1;
+}
+
+// Returns the topic a PUBLISH from the server is for, remembering it if the
+// server has just set up its alias. Returns NULL for an unknown alias.
+char* PubSubClient::resolveAlias(uint16_t alias, char* topic, uint16_t* topicLength) {
+    if (alias > MQTT5_TOPIC_ALIAS_IN) {
+        return NULL;
+    }
+    char* known = aliasIn[alias-1];
+    if (*topicLength > 0) {
+        if (*topicLength < MQTT5_TOPIC_ALIAS_LENGTH) {
+            memcpy(known,topic,*topicLength+1);
+        } else {
+            // Too long to keep; later messages using the alias are dropped
+            known[0] = 0;
+        }
+        return topic;
+    }
+    if (known[0] == 0) {
+        return NULL;
+    }
+    *topicLength = strlen(known);
+    return known;
+}
+
+uint8_t PubSubClient::inflightCount() {
+    uint8_t count = 0;
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_OUT;i++) {
+        if (inflightOut[i].state != MQTT_INFLIGHT_FREE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+boolean PubSubClient::writeAck(uint8_t header, uint16_t msgId, uint8_t reasonCode) {
+    uint8_t ack[5];
+    ack[0] = header;
+    ack[1] = 3;
+    ack[2] = (msgId >> 8);
+    ack[3] = (msgId & 0xFF);
+    ack[4] = reasonCode;
+    boolean rc = writeChunked(ack,5);
+    countOut(header,5);
+    lastOutActivity = _clock();
+    return rc;
+}
+
+uint8_t PubSubClient::reasonCode() {
+    return _reasonCode;
+}
+#endif
+
+void PubSubClient::saveSession(MQTTSessionState& session) {
+    session.nextMsgId = nextMsgId;
+    memcpy(session.inflightOut,inflightOut,sizeof(inflightOut));
+    memcpy(session.inflightIn,inflightIn,sizeof(inflightIn));
+}
+
+void PubSubClient::restoreSession(const MQTTSessionState& session) {
+    nextMsgId = session.nextMsgId;
+    memcpy(inflightOut,session.inflightOut,sizeof(inflightOut));
+    memcpy(inflightIn,session.inflightIn,sizeof(inflightIn));
+}
+
+boolean PubSubClient::sessionPresent() {
+    return _sessionPresent;
+}
+
+void PubSubClient::resetInflight() {
+    uint8_t i;
+    nextMsgId = 1;
+    for (i=0;i<MQTT_MAX_INFLIGHT_OUT;i++) {
+        inflightOut[i].msgId = 0;
+        inflightOut[i].state = MQTT_INFLIGHT_FREE;
+    }
+    for (i=0;i<MQTT_MAX_INFLIGHT_IN;i++) {
+        inflightIn[i] = 0;
+    }
+#if MQTT_DEDUP_WINDOW > 0
+    seenIn.reset();
+#endif
+    for (i=0;i<MQTT_MAX_PENDING_SUBACKS;i++) {
+        pendingAcks[i].msgId = 0;
+    }
+}
+
+// finds the outbound slot holding msgId; msgId 0 finds a free slot
+MQTTInflight* PubSubClient::findInflightOut(uint16_t msgId) {
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_OUT;i++) {
+        if (msgId == 0) {
+            if (inflightOut[i].state == MQTT_INFLIGHT_FREE) {
+                return &inflightOut[i];
+            }
+        } else if (inflightOut[i].state != MQTT_INFLIGHT_FREE && inflightOut[i].msgId == msgId) {
+            return &inflightOut[i];
+        }
+    }
+    return NULL;
+}
+
+// A redelivery is marked as a duplicate by the server, so a reused id on an
+// unmarked message is a new message
+#if MQTT_DEDUP_WINDOW > 0
+boolean PubSubClient::isDuplicateIn(uint16_t msgId, boolean dup) {
+    if (dup && seenIn.contains(msgId)) {
+        _duplicates++;
+        return true;
+    }
+    return false;
+}
+#else
+boolean PubSubClient::isDuplicateIn(uint16_t, boolean) {
+    return false;
+}
+#endif
+
+boolean PubSubClient::isInflightIn(uint16_t msgId) {
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_IN;i++) {
+        if (inflightIn[i] == msgId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+boolean PubSubClient::addInflightIn(uint16_t msgId) {
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_IN;i++) {
+        if (inflightIn[i] == 0) {
+            inflightIn[i] = msgId;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PubSubClient::removeInflightIn(uint16_t msgId) {
+    for (uint8_t i=0;i<MQTT_MAX_INFLIGHT_IN;i++) {
+        if (inflightIn[i] == msgId) {
+            inflightIn[i] = 0;
+        }
+    }
+}
+
+// finds the pending acknowledgement for msgId; msgId 0 finds a free slot
+MQTTPendingAck* PubSubClient::findPendingAck(uint16_t msgId) {
+    for (uint8_t i=0;i<MQTT_MAX_PENDING_SUBACKS;i++) {
+        if (pendingAcks[i].msgId == msgId) {
+            return &pendingAcks[i];
+        }
+    }
+    return NULL;
+}
 
 boolean PubSubClient::connected() {
     boolean rc;
@@ -572,6 +1588,68 @@ PubSubClient& PubSubClient::setServer(const char * domain, uint16_t port) {
 
 PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
     this->callback = callback;
+#if !MQTT_STD_FUNCTION_CALLBACK
+    this->handler = NULL;
+#endif
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTTMessageHandler handler, void* context) {
+    this->callback = NULL;
+#if MQTT_STD_FUNCTION_CALLBACK
+    if (handler) {
+        // Two pointers fit in a std::function without a heap allocation
+        this->callback = [handler,context](char* topic, uint8_t* payload, unsigned int length) {
+            handler(topic,payload,length,context);
+        };
+    }
+#else
+    this->handler = handler;
+    this->handlerContext = context;
+#endif
+    return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+    this->keepAlive = keepAlive;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+    this->socketTimeout = timeout;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setClock(MQTTClock clock) {
+    this->_clock = clock;
+    return *this;
+}
+
+unsigned long PubSubClient::pingRtt() {
+    return _pingRtt;
+}
+
+uint32_t PubSubClient::duplicates() {
+    return _duplicates;
+}
+
+#if MQTT_METRICS
+const MQTTMetrics& PubSubClient::metrics() {
+    return _metrics;
+}
+
+void PubSubClient::resetMetrics() {
+    _metrics = MQTTMetrics();
+}
+#endif
+
+PubSubClient& PubSubClient::setCleanSession(boolean cleanSession) {
+    this->cleanSession = cleanSession;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setChunkCallback(MQTT_CHUNK_CALLBACK_SIGNATURE) {
+    this->chunkCallback = chunkCallback;
     return *this;
 }
 
@@ -585,6 +1663,39 @@ PubSubClient& PubSubClient::setStream(Stream& stream){
     return *this;
 }
 
+PubSubClient& PubSubClient::setRouter(MQTTTopicRouter& router){
+    this->router = &router;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setOutboundQueue(MQTTOutboundQueue& queue){
+    this->queue = &queue;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setDecoder(MQTTPacketDecoder& decoder) {
+    this->decoder = &decoder;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setWriteBuffer(uint8_t* buffer, uint16_t size) {
+    this->staging = buffer;
+    this->stagingSize = size;
+    this->staged = 0;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setRetainedCache(MQTTRetainedCache& cache) {
+    this->retained = &cache;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setLoopBudget(uint16_t maxPackets, unsigned long maxMicros){
+    this->loopMaxPackets = maxPackets;
+    this->loopMaxMicros = maxMicros;
+    return *this;
+}
+
 int PubSubClient::state() {
     return this->_state;
 }
@@ -11,36 +11,122 @@
 #include "IPAddress.h"
 #include "Client.h"
 #include "Stream.h"
+#include "MQTTTopicRouter.h"
+#include "MQTTOutboundQueue.h"
+#include "MQTTVarint.h"
+#include "MQTTPacketDecoder.h"
+#include "MQTTPacketIdWindow.h"
+#include "MQTTRetainedCache.h"
 
 #define MQTT_VERSION_3_1      3
 #define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
 
 // MQTT_VERSION : Pick the version
 //#define MQTT_VERSION MQTT_VERSION_3_1
+//#define MQTT_VERSION MQTT_VERSION_5
 #ifndef MQTT_VERSION
 #define MQTT_VERSION MQTT_VERSION_3_1_1
 #endif
 
+#if MQTT_VERSION == MQTT_VERSION_5
+#include "MQTTProperties.h"
+
+// MQTT5_TOPIC_ALIAS_OUT : Number of topic aliases the client uses for its own
+//  publishes, if the server allows that many
+#ifndef MQTT5_TOPIC_ALIAS_OUT
+#define MQTT5_TOPIC_ALIAS_OUT 4
+#endif
+
+// MQTT5_TOPIC_ALIAS_IN : Number of topic aliases the server may use for the
+//  messages it sends
+#ifndef MQTT5_TOPIC_ALIAS_IN
+#define MQTT5_TOPIC_ALIAS_IN 4
+#endif
+
+// MQTT5_TOPIC_ALIAS_LENGTH : Longest topic, including the terminator, that can
+//  be aliased. Each alias in either direction costs this many bytes of RAM.
+#ifndef MQTT5_TOPIC_ALIAS_LENGTH
+#define MQTT5_TOPIC_ALIAS_LENGTH 48
+#endif
+
+// MQTT5_SESSION_EXPIRY : Session expiry interval in seconds asked for when
+//  clean session is off. The default never expires, as in MQTT 3.1.1.
+#ifndef MQTT5_SESSION_EXPIRY
+#define MQTT5_SESSION_EXPIRY 0xFFFFFFFF
+#endif
+
+// Most bytes of properties added to a PUBLISH: their length and a topic alias
+#define MQTT_PUBLISH_PROPERTIES 4
+// Bytes taken by an empty property list
+#define MQTT_NO_PROPERTIES 1
+#else
+#define MQTT_PUBLISH_PROPERTIES 0
+#define MQTT_NO_PROPERTIES 0
+#endif
+
 // MQTT_MAX_PACKET_SIZE : Maximum packet size
 #ifndef MQTT_MAX_PACKET_SIZE
 #define MQTT_MAX_PACKET_SIZE 128
 #endif
 
-// MQTT_KEEPALIVE : keepAlive interval in Seconds
+// MQTT_KEEPALIVE : default keepAlive interval in Seconds. Override with setKeepAlive()
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 15
 #endif
 
-// MQTT_SOCKET_TIMEOUT: socket timeout interval in Seconds
+// MQTT_SOCKET_TIMEOUT: default socket timeout interval in Seconds. Override with setSocketTimeout()
 #ifndef MQTT_SOCKET_TIMEOUT
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_LOOP_MAX_PACKETS : Maximum number of inbound packets handled by each
+//  call to loop(). 0 handles everything that is available.
+#ifndef MQTT_LOOP_MAX_PACKETS
+#define MQTT_LOOP_MAX_PACKETS 16
+#endif
+
+// MQTT_LOOP_MAX_MICROS : Time in microseconds after which loop() stops
+//  handling further inbound packets. 0 for no limit.
+#ifndef MQTT_LOOP_MAX_MICROS
+#define MQTT_LOOP_MAX_MICROS 0
+#endif
+
+// MQTT_METRICS : Set to 1 to count packets, bytes and timings per client,
+//  read with metrics(). Costs about 300 bytes of RAM per client. When left
+//  at 0 the counting compiles away.
+#ifndef MQTT_METRICS
+#define MQTT_METRICS 0
+#endif
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
 //#define MQTT_MAX_TRANSFER_SIZE 80
 
+// MQTT_MAX_INFLIGHT_OUT : Maximum number of outbound QoS 2 messages that can be
+//  awaiting PUBREC/PUBCOMP at the same time. Each slot costs 4 bytes of RAM.
+//  With MQTT 5, QoS 1 messages awaiting PUBACK use these slots too. Payloads
+//  are not kept, so a message still awaiting PUBREC when the connection is
+//  lost can't be sent again; it is counted in MQTTMetrics.inflightOutLost.
+#ifndef MQTT_MAX_INFLIGHT_OUT
+#define MQTT_MAX_INFLIGHT_OUT 4
+#endif
+
+// MQTT_MAX_INFLIGHT_IN : Maximum number of inbound QoS 2 messages that can be
+//  awaiting PUBREL at the same time. Each slot costs 2 bytes of RAM. Messages
+//  that find every slot taken are not passed on, and are counted in
+//  MQTTMetrics.inflightInRejected.
+#ifndef MQTT_MAX_INFLIGHT_IN
+#define MQTT_MAX_INFLIGHT_IN 4
+#endif
+
+// MQTT_MAX_PENDING_SUBACKS : Maximum number of batched SUBSCRIBE/UNSUBSCRIBE
+//  packets whose acknowledgement is still being waited for.
+#ifndef MQTT_MAX_PENDING_SUBACKS
+#define MQTT_MAX_PENDING_SUBACKS 4
+#endif
+
 // Possible values for client.state()
 #define MQTT_CONNECTION_TIMEOUT     -4
 #define MQTT_CONNECTION_LOST        -3
@@ -73,32 +159,210 @@
 #define MQTTQOS1        (1 << 1)
 #define MQTTQOS2        (2 << 1)
 
+// Possible values for MQTTSubscription.result; anything below 0x80 is the
+// granted QoS
+#define MQTT_SUBACK_FAILURE   0x80
+#define MQTT_SUBACK_NOT_SENT  0xFE
+#define MQTT_SUBACK_PENDING   0xFF
+
+// States of an outbound in-flight message
+#define MQTT_INFLIGHT_FREE          0
+#define MQTT_INFLIGHT_AWAIT_PUBREC  1
+#define MQTT_INFLIGHT_AWAIT_PUBCOMP 2
+#define MQTT_INFLIGHT_AWAIT_PUBACK  3
+
+// MQTT_STD_FUNCTION_CALLBACK : Hold callbacks in a std::function, so that
+//  they can be capturing lambdas. That costs a heap allocation for larger
+//  captures and an indirect call per message, and the callbacks take 32
+//  bytes of the client on ESP8266 against 16 as function pointers. On by
+//  default for ESP8266; define as 0 to use plain function pointers there too.
+#ifndef MQTT_STD_FUNCTION_CALLBACK
 #ifdef ESP8266
+#define MQTT_STD_FUNCTION_CALLBACK 1
+#else
+#define MQTT_STD_FUNCTION_CALLBACK 0
+#endif
+#endif
+
+// The chunk callback is called with the topic, total payload length, offset
+// and a chunk of a PUBLISH payload that doesn't fit in the buffer
+#if MQTT_STD_FUNCTION_CALLBACK
 #include <functional>
 #define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+#define MQTT_CHUNK_CALLBACK_SIGNATURE std::function<void(char*, uint32_t, uint32_t, uint8_t*, unsigned int)> chunkCallback
 #else
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+#define MQTT_CHUNK_CALLBACK_SIGNATURE void (*chunkCallback)(char*, uint32_t, uint32_t, uint8_t*, unsigned int)
 #endif
 
+// A callback that is always a plain function, called with the context given
+// to setCallback() along with the message
+typedef void (*MQTTMessageHandler)(char* topic, uint8_t* payload, unsigned int length, void* context);
+
+// Returns the time in milliseconds. millis() unless replaced with setClock()
+typedef unsigned long (*MQTTClock)(void);
+
+typedef struct {
+   uint16_t msgId;
+   uint8_t state;
+} MQTTInflight;
+
+typedef struct {
+   const char* topic;
+   uint8_t qos;
+   uint8_t result;
+} MQTTSubscription;
+
+typedef struct {
+   uint16_t msgId;
+   uint8_t count;
+   MQTTSubscription* subscriptions;
+} MQTTPendingAck;
+
+// What a client has done since it was created or resetMetrics() was called.
+// The per type arrays are indexed by packet type, e.g. MQTTPUBLISH >> 4.
+struct MQTTMetrics {
+   uint32_t packetsIn[16];
+   uint32_t packetsOut[16];
+   uint32_t bytesIn[16];
+   uint32_t bytesOut[16];
+   // Inbound packets dropped for not fitting in the buffer
+   uint32_t oversizeDropped;
+   uint32_t connects;
+   uint32_t reconnects;
+   // Milliseconds from sending CONNECT to receiving CONNACK, last connect
+   unsigned long connackLatency;
+   // Ping round trips in milliseconds; the average is pingRttTotal / pings
+   uint32_t pings;
+   unsigned long pingRttMin;
+   unsigned long pingRttMax;
+   unsigned long pingRttTotal;
+   // Microseconds spent waiting for the network client to read or write
+   unsigned long blockedMicros;
+   // Calls made to the network client to write; with a write buffer, each
+   // can carry several packets
+   uint32_t writes;
+   // Inbound QoS 2 messages refused for want of a free in-flight slot
+   uint32_t inflightInRejected;
+   // Outbound messages still awaiting PUBREC (or PUBACK with MQTT 5) when a
+   // session was resumed, which were given up as their payload isn't kept
+   uint32_t inflightOutLost;
+
+   MQTTMetrics() {
+      memset(this,0,sizeof(MQTTMetrics));
+   }
+};
+
+// Client side state of a session, for keeping it across a restart
+typedef struct {
+   uint16_t nextMsgId;
+   MQTTInflight inflightOut[MQTT_MAX_INFLIGHT_OUT];
+   uint16_t inflightIn[MQTT_MAX_INFLIGHT_IN];
+} MQTTSessionState;
+
 class PubSubClient {
 private:
    Client* _client;
+   MQTTClock _clock;
    uint8_t buffer[MQTT_MAX_PACKET_SIZE];
    uint16_t nextMsgId;
    unsigned long lastOutActivity;
    unsigned long lastInActivity;
    bool pingOutstanding;
+   unsigned long pingSentAt;
+   unsigned long _pingRtt;
+   uint16_t keepAlive;
+   uint16_t socketTimeout;
+   MQTTInflight inflightOut[MQTT_MAX_INFLIGHT_OUT];
+   uint16_t inflightIn[MQTT_MAX_INFLIGHT_IN];
+#if MQTT_DEDUP_WINDOW > 0
+   MQTTPacketIdWindow seenIn;
+#endif
+   uint32_t _duplicates;
+   MQTTPendingAck pendingAcks[MQTT_MAX_PENDING_SUBACKS];
    MQTT_CALLBACK_SIGNATURE;
-   uint16_t readPacket(uint8_t*);
+#if !MQTT_STD_FUNCTION_CALLBACK
+   // A std::function holds the handler and its context itself
+   MQTTMessageHandler handler;
+   void* handlerContext;
+#endif
+   MQTT_CHUNK_CALLBACK_SIGNATURE;
+   uint32_t pendingPayload;
+   uint32_t readPacket(uint8_t*);
+   boolean handlePacket(unsigned long t);
+   boolean handlePacket(unsigned long t, uint32_t len, uint8_t llen);
+   boolean decodePacket(unsigned long t);
    boolean readByte(uint8_t * result);
-   boolean readByte(uint8_t * result, uint16_t * index);
-   boolean write(uint8_t header, uint8_t* buf, uint16_t length);
+   boolean readByte(uint8_t * result, uint32_t * index);
+   boolean write(uint8_t header, uint8_t* buf, uint32_t length);
+   boolean writeChunked(const uint8_t* buf, uint32_t length);
+   boolean writeDirect(const uint8_t* buf, uint32_t length);
+   void abandonConnect();
    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
+   uint16_t writeProperties(uint8_t* buf, uint16_t pos, uint16_t alias);
+   boolean writeAck(uint8_t header, uint16_t msgId);
+   uint16_t nextMessageId();
+   void resetInflight();
+   void resumeSession(boolean present);
+#if MQTT_VERSION == MQTT_VERSION_5
+   char aliasOut[MQTT5_TOPIC_ALIAS_OUT][MQTT5_TOPIC_ALIAS_LENGTH];
+   char aliasIn[MQTT5_TOPIC_ALIAS_IN][MQTT5_TOPIC_ALIAS_LENGTH];
+   uint16_t serverAliasMax;
+   uint16_t serverReceiveMax;
+   uint8_t nextAlias;
+   uint8_t _reasonCode;
+   void readConnack(uint8_t llen, uint32_t len);
+   uint32_t skipProperties(uint32_t pos, uint32_t end);
+   uint16_t topicAlias(const char* topic, boolean* known);
+   char* resolveAlias(uint16_t alias, char* topic, uint16_t* topicLength);
+   uint8_t inflightCount();
+   boolean writeAck(uint8_t header, uint16_t msgId, uint8_t reasonCode);
+#endif
+   MQTTInflight* findInflightOut(uint16_t msgId);
+   boolean isInflightIn(uint16_t msgId);
+   boolean isDuplicateIn(uint16_t msgId, boolean dup);
+   boolean addInflightIn(uint16_t msgId);
+   void removeInflightIn(uint16_t msgId);
+   boolean writeSubscriptions(uint8_t header, MQTTSubscription* subscriptions, uint8_t count);
+   MQTTPendingAck* findPendingAck(uint16_t msgId);
+   boolean deliver(char* topic, uint16_t topicLength, uint8_t* payload, unsigned int plength);
+   boolean skipPending();
+   void dispatch(char* topic, uint16_t topicLength, uint8_t* payload, unsigned int plength);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, uint8_t qos, boolean retained, boolean latestOnly);
+   boolean flushQueue();
    IPAddress ip;
    const char* domain;
    uint16_t port;
    Stream* stream;
+   MQTTTopicRouter* router;
+   MQTTOutboundQueue* queue;
+   MQTTPacketDecoder* decoder;
+   MQTTRetainedCache* retained;
+   uint8_t* staging;
+   uint16_t stagingSize;
+   uint16_t staged;
+   boolean connecting;
+   MQTTSessionState pipelined;
+   boolean cleanSession;
+   boolean _sessionPresent;
+   uint16_t loopMaxPackets;
+   unsigned long loopMaxMicros;
    int _state;
+#if MQTT_METRICS
+   MQTTMetrics _metrics;
+#endif
+   void countIn(uint8_t header, uint32_t bytes);
+   void countOut(uint8_t header, uint32_t bytes);
+   void countOut(uint8_t header, uint32_t bytes, uint16_t packets);
+   void countDropped(uint32_t packets);
+   void countConnect(unsigned long latency);
+   void countPing(unsigned long rtt);
+   unsigned long blockStart();
+   void countBlocked(unsigned long start);
+   void init();
+   void countWrite();
+   void countRejected();
+   void countLost();
 public:
    PubSubClient();
    PubSubClient(Client& client);
@@ -119,24 +383,116 @@ public:
    PubSubClient& setServer(uint8_t * ip, uint16_t port);
    PubSubClient& setServer(const char * domain, uint16_t port);
    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+   // Replaces the callback with a function that is also passed context,
+   // which avoids needing a capturing lambda to reach an object.
+   PubSubClient& setCallback(MQTTMessageHandler handler, void* context);
+   // Receives PUBLISH messages too big for the buffer in buffer-sized
+   // chunks instead of dropping them. The router and callback are not
+   // called for these messages.
+   PubSubClient& setChunkCallback(MQTT_CHUNK_CALLBACK_SIGNATURE);
    PubSubClient& setClient(Client& client);
    PubSubClient& setStream(Stream& stream);
+   PubSubClient& setRouter(MQTTTopicRouter& router);
+   PubSubClient& setOutboundQueue(MQTTOutboundQueue& queue);
+   // loop() reads whatever is available into decoder instead of waiting
+   // for the rest of a packet. Not used while a stream or chunk callback is
+   // set. The decoder's buffer should be MQTT_MAX_PACKET_SIZE bytes.
+   PubSubClient& setDecoder(MQTTPacketDecoder& decoder);
+   // Retained messages are stored in cache, and ones whose payload has not
+   // changed since they were last received are acknowledged but not passed
+   // on. Any other message on a topic drops what is kept for it. Retained
+   // messages read into a stream or in chunks are not kept.
+   PubSubClient& setRetainedCache(MQTTRetainedCache& cache);
+   // Outbound packets are gathered in buffer and written out together, by
+   // flush(), at the end of each loop(), when the buffer is full or, for
+   // packets sent between beginConnect() and endConnect(), with the CONNECT.
+   // publish() and the like then only report whether a packet was buffered.
+   PubSubClient& setWriteBuffer(uint8_t* buffer, uint16_t size);
+   PubSubClient& setLoopBudget(uint16_t maxPackets, unsigned long maxMicros);
+   // With cleanSession false the server keeps subscriptions and queued
+   // messages across connections, and message ids and in-flight QoS 2
+   // messages are kept by the client.
+   PubSubClient& setCleanSession(boolean cleanSession);
+   // Both in seconds, and used from the next connect(). A PINGREQ is only
+   // sent when nothing else has been sent, or nothing has been received,
+   // for keepAlive seconds, and the connection is dropped if its PINGRESP
+   // takes longer than timeout.
+   PubSubClient& setKeepAlive(uint16_t keepAlive);
+   PubSubClient& setSocketTimeout(uint16_t timeout);
+   // Replaces millis() for all timing except the loop() budget, so that
+   // tests can drive keepalive and timeouts in virtual time. connect() and
+   // reads of partial packets wait on the clock, so it has to advance while
+   // they wait for data.
+   PubSubClient& setClock(MQTTClock clock);
 
    boolean connect(const char* id);
    boolean connect(const char* id, const char* user, const char* pass);
    boolean connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
    boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   // connect() in two halves: beginConnect() sends the CONNECT, and
+   // publish() and subscribe() can then be called before endConnect() waits
+   // for the CONNACK, saving a round trip. If the connection is refused,
+   // those messages are dropped and their message ids and in-flight slots
+   // are given back. QoS 0 messages for an outbound queue stay queued until
+   // the CONNACK. loop() does nothing until endConnect() has been called.
+   boolean beginConnect(const char* id);
+   boolean beginConnect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   boolean endConnect();
+   // Writes out what has been gathered in the write buffer, for messages
+   // that should not wait for the next loop()
+   boolean flush();
    void disconnect();
    boolean publish(const char* topic, const char* payload);
    boolean publish(const char* topic, const char* payload, boolean retained);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, uint8_t qos, boolean retained);
+   boolean publishLatest(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Starts a QoS 0 PUBLISH whose payload of plength bytes is then passed
+   // to write() in as many pieces as needed, without going through the
+   // buffer. endPublish() returns whether the client is still connected.
+   boolean beginPublish(const char* topic, uint32_t plength, boolean retained);
+   size_t write(uint8_t data);
+   size_t write(const uint8_t* buf, size_t size);
+   boolean endPublish();
    boolean subscribe(const char* topic);
    boolean subscribe(const char* topic, uint8_t qos);
+   // Batch forms. The result of each topic is written back into its
+   // MQTTSubscription when the acknowledgement arrives in loop(), so the
+   // array must stay in place until no result is MQTT_SUBACK_PENDING or the
+   // connection ends; a stack array going out of scope before then is
+   // written to after it is gone. Nothing is sent if any qos is above 2.
+   boolean subscribe(MQTTSubscription* subscriptions, uint8_t count);
    boolean unsubscribe(const char* topic);
+   boolean unsubscribe(MQTTSubscription* subscriptions, uint8_t count);
    boolean loop();
+   // Handles inbound packets until none are available, maxPackets have been
+   // handled or maxMicros have passed (0 for no limit). Returns the number of
+   // packets handled, or -1 if the client is not connected.
+   int loop(uint16_t maxPackets, unsigned long maxMicros);
    boolean connected();
+   // Whether the server resumed a previous session on the last connect, in
+   // which case subscriptions don't need to be made again
+   boolean sessionPresent();
+   // Round trip time of the last PINGREQ in milliseconds, 0 before the first
+   unsigned long pingRtt();
+   // Number of redelivered QoS 1 messages acknowledged without being passed
+   // on again, as remembered for MQTT_DEDUP_WINDOW message ids
+   uint32_t duplicates();
+#if MQTT_VERSION == MQTT_VERSION_5
+   // Reason code of the last CONNACK, PUBACK, PUBREC, PUBCOMP or DISCONNECT
+   // received
+   uint8_t reasonCode();
+#endif
+   // Copies the session state out of and back into the client, so it can
+   // be kept across a deep sleep or restart
+   void saveSession(MQTTSessionState& session);
+   void restoreSession(const MQTTSessionState& session);
+#if MQTT_METRICS
+   const MQTTMetrics& metrics();
+   void resetMetrics();
+#endif
    int state();
 };
 
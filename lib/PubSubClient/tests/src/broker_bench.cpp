@@ -0,0 +1,53 @@
+#include "PubSubClient.h"
+#include "FakeBroker.h"
+#include "trace.h"
+#include <chrono>
+#include <stdio.h>
+
+// Round trip throughput from one PubSubClient through the fake broker to
+// another, at QoS 0 and QoS 1.
+
+#define MESSAGES 200000
+#define BATCH 100
+
+byte server[] = { 172, 16, 0, 2 };
+unsigned long received = 0;
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    received++;
+}
+
+double run(uint8_t qos) {
+    FakeBroker broker;
+    LoopbackClient subLoopback(broker);
+    LoopbackClient pubLoopback(broker);
+    PubSubClient subscriber(server, 1883, callback, subLoopback);
+    PubSubClient publisher(server, 1883, pubLoopback);
+    subscriber.connect("sub");
+    publisher.connect("pub");
+    subscriber.subscribe("hoalong/car1/speed",1);
+    received = 0;
+
+    const char* payload = "{\"speed\":42,\"steer\":-3}";
+    unsigned int plength = strlen(payload);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < MESSAGES; n++) {
+        publisher.publish("hoalong/car1/speed",(const uint8_t*)payload,plength,qos,false);
+        if (n % BATCH == BATCH-1) {
+            while (subscriber.loop(0,0) > 0);
+            publisher.loop(0,0);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return received == MESSAGES ? MESSAGES/seconds : 0;
+}
+
+int main()
+{
+    double qos0 = run(0);
+    double qos1 = run(1);
+    LOG("Fake broker round trip, " << MESSAGES << " messages\n");
+    LOG(" - qos 0: " << (unsigned long)qos0 << " msgs/sec\n");
+    LOG(" - qos 1: " << (unsigned long)qos1 << " msgs/sec\n\n");
+    return (qos0 > 0 && qos1 > 0) ? 0 : 1;
+}
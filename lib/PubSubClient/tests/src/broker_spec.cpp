@@ -0,0 +1,199 @@
+#include "PubSubClient.h"
+#include "FakeBroker.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+int callback_count = 0;
+char lastTopic[1024];
+char lastPayload[1024];
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_count = 0;
+    lastTopic[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_count++;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+unsigned long now = 0;
+
+unsigned long virtualClock() {
+    return now;
+}
+
+int test_broker_connect() {
+    IT("connects to the fake broker and keeps the connection alive");
+    FakeBroker broker;
+    LoopbackClient loopback(broker);
+
+    PubSubClient client(server, 1883, callback, loopback);
+    client.setClock(virtualClock);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.connected());
+
+    for (int i = 0; i < 100; i++) {
+        now += 1000;
+        rc = client.loop();
+        IS_TRUE(rc);
+    }
+    IS_TRUE(client.connected());
+
+    client.disconnect();
+    IS_FALSE(client.connected());
+    IS_FALSE(broker.isOpen(0));
+
+    END_IT
+}
+
+int test_broker_qos0() {
+    IT("passes qos 0 messages between clients");
+    reset_callback();
+    FakeBroker broker;
+    LoopbackClient subLoopback(broker);
+    LoopbackClient pubLoopback(broker);
+
+    PubSubClient subscriber(server, 1883, callback, subLoopback);
+    PubSubClient publisher(server, 1883, pubLoopback);
+    IS_TRUE(subscriber.connect((char*)"sub"));
+    IS_TRUE(publisher.connect((char*)"pub"));
+
+    IS_TRUE(subscriber.subscribe((char*)"car/+/speed"));
+    IS_TRUE(subscriber.loop());
+
+    IS_TRUE(publisher.publish((char*)"car/1/speed",(char*)"42"));
+    IS_TRUE(publisher.publish((char*)"car/1/steer",(char*)"0"));
+    IS_TRUE(subscriber.loop());
+
+    IS_EQUAL(callback_count,1);
+    IS_TRUE(strcmp(lastTopic,"car/1/speed")==0);
+    IS_TRUE(memcmp(lastPayload,"42",2)==0);
+    IS_EQUAL(broker.published(),2);
+    IS_EQUAL(broker.delivered(),1);
+
+    END_IT
+}
+
+int test_broker_parent_level() {
+    IT("matches a multi-level wildcard to its parent level");
+    reset_callback();
+    FakeBroker broker;
+    LoopbackClient loopback(broker);
+
+    PubSubClient client(server, 1883, callback, loopback);
+    IS_TRUE(client.connect((char*)"client_test1"));
+    IS_TRUE(client.subscribe((char*)"car/#"));
+    IS_TRUE(client.loop());
+
+    IS_TRUE(client.publish((char*)"car",(char*)"a"));
+    IS_TRUE(client.publish((char*)"car/1",(char*)"b"));
+    IS_TRUE(client.publish((char*)"cars",(char*)"c"));
+    IS_TRUE(client.loop());
+
+    IS_EQUAL(callback_count,2);
+    IS_TRUE(strcmp(lastTopic,"car/1")==0);
+    IS_EQUAL(broker.delivered(),2);
+
+    END_IT
+}
+
+int test_broker_qos1() {
+    IT("passes and acknowledges qos 1 messages");
+    reset_callback();
+    FakeBroker broker;
+    LoopbackClient subLoopback(broker);
+    LoopbackClient pubLoopback(broker);
+
+    PubSubClient subscriber(server, 1883, callback, subLoopback);
+    PubSubClient publisher(server, 1883, pubLoopback);
+    IS_TRUE(subscriber.connect((char*)"sub"));
+    IS_TRUE(publisher.connect((char*)"pub"));
+
+    IS_TRUE(subscriber.subscribe((char*)"car/#",1));
+    IS_TRUE(subscriber.loop());
+
+    for (int i = 0; i < 10; i++) {
+        IS_TRUE(publisher.publish((char*)"car/1/cmd",(const uint8_t*)"go",2,1,false));
+    }
+    IS_EQUAL(broker.unacked(0),10);
+    while (subscriber.loop(0,0) > 0);
+    IS_TRUE(publisher.loop());
+
+    IS_EQUAL(callback_count,10);
+    IS_EQUAL(broker.unacked(0),0);
+    IS_EQUAL(pubLoopback.available(),0);
+
+    END_IT
+}
+
+int test_broker_unsubscribe() {
+    IT("stops delivering after unsubscribe");
+    reset_callback();
+    FakeBroker broker;
+    LoopbackClient loopback(broker);
+
+    PubSubClient client(server, 1883, callback, loopback);
+    IS_TRUE(client.connect((char*)"client_test1"));
+    IS_TRUE(client.subscribe((char*)"topic"));
+    IS_TRUE(client.publish((char*)"topic",(char*)"a"));
+    IS_TRUE(client.loop());
+    IS_EQUAL(callback_count,1);
+
+    IS_TRUE(client.unsubscribe((char*)"topic"));
+    IS_TRUE(client.publish((char*)"topic",(char*)"b"));
+    IS_TRUE(client.loop());
+    IS_EQUAL(callback_count,1);
+
+    END_IT
+}
+
+int test_broker_volume() {
+    IT("delivers thousands of messages");
+    reset_callback();
+    FakeBroker broker;
+    LoopbackClient subLoopback(broker);
+    LoopbackClient pubLoopback(broker);
+
+    PubSubClient subscriber(server, 1883, callback, subLoopback);
+    PubSubClient publisher(server, 1883, pubLoopback);
+    IS_TRUE(subscriber.connect((char*)"sub"));
+    IS_TRUE(publisher.connect((char*)"pub"));
+    IS_TRUE(subscriber.subscribe((char*)"telemetry",1));
+
+    char payload[16];
+    for (int i = 0; i < 5000; i++) {
+        sprintf(payload,"%d",i);
+        IS_TRUE(publisher.publish((char*)"telemetry",(const uint8_t*)payload,strlen(payload),i%2,false));
+        if (i % 100 == 99) {
+            while (subscriber.loop(0,0) > 0);
+            IS_TRUE(publisher.loop());
+        }
+    }
+    IS_EQUAL(callback_count,5000);
+    IS_TRUE(memcmp(lastPayload,"4999",4)==0);
+    IS_EQUAL(broker.unacked(0),0);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Fake broker");
+    test_broker_connect();
+    test_broker_qos0();
+    test_broker_parent_level();
+    test_broker_qos1();
+    test_broker_unsubscribe();
+    test_broker_volume();
+
+    FINISH
+}
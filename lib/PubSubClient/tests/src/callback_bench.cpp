@@ -0,0 +1,85 @@
+#include "PubSubClient.h"
+#include "trace.h"
+#include <chrono>
+#include <functional>
+
+// Compares the per-message cost of the callback forms PubSubClient can
+// hold: a std::function wrapping a capturing lambda, as used on ESP8266, a
+// plain function pointer, and a function pointer with a context.
+
+#define ITERATIONS 10000000
+
+struct Car {
+    volatile unsigned long messages;
+    void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+        messages += length;
+    }
+};
+
+Car car;
+
+void plain(char* topic, uint8_t* payload, unsigned int length) {
+    car.messages += length;
+}
+
+void withContext(char* topic, uint8_t* payload, unsigned int length, void* context) {
+    ((Car*)context)->onMessage(topic,payload,length);
+}
+
+// Kept out of line so the calls go through the stored callable, as they do
+// in PubSubClient::dispatch()
+__attribute__((noinline)) void callFunction(std::function<void(char*, uint8_t*, unsigned int)>& f, char* topic, uint8_t* payload, unsigned int length) {
+    if (f) {
+        f(topic,payload,length);
+    }
+}
+
+__attribute__((noinline)) void callPointer(void (*f)(char*, uint8_t*, unsigned int), char* topic, uint8_t* payload, unsigned int length) {
+    if (f) {
+        f(topic,payload,length);
+    }
+}
+
+__attribute__((noinline)) void callHandler(MQTTMessageHandler f, void* context, char* topic, uint8_t* payload, unsigned int length) {
+    if (f) {
+        f(topic,payload,length,context);
+    }
+}
+
+double elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main()
+{
+    char topic[] = "hoalong/car1/speed";
+    uint8_t payload[] = "42";
+    Car* target = &car;
+
+    std::function<void(char*, uint8_t*, unsigned int)> lambda = [target](char* t, uint8_t* p, unsigned int l) {
+        target->onMessage(t,p,l);
+    };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < ITERATIONS; n++) {
+        callFunction(lambda,topic,payload,1);
+    }
+    double function = elapsedNs(start)/ITERATIONS;
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < ITERATIONS; n++) {
+        callPointer(plain,topic,payload,1);
+    }
+    double pointer = elapsedNs(start)/ITERATIONS;
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < ITERATIONS; n++) {
+        callHandler(withContext,target,topic,payload,1);
+    }
+    double handler = elapsedNs(start)/ITERATIONS;
+
+    LOG("Callback dispatch\n");
+    LOG(" - std::function:      " << function << " ns/message, " << sizeof(lambda) << " bytes\n");
+    LOG(" - function pointer:   " << pointer << " ns/message, " << sizeof(&plain) << " bytes\n");
+    LOG(" - handler + context:  " << handler << " ns/message, " << sizeof(&withContext)+sizeof(void*) << " bytes\n\n");
+    return car.messages == 3UL*ITERATIONS ? 0 : 1;
+}
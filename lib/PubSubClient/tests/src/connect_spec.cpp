@@ -11,6 +11,13 @@ void callback(char* topic, byte* payload, unsigned int length) {
   // handle message arrived
 }
 
+// Virtual time, moved on by the tests instead of sleeping
+unsigned long now = 0;
+
+unsigned long virtualClock() {
+    return now;
+}
+
 
 int test_connect_fails_no_network() {
     IT("fails to connect if underlying client doesn't connect");
@@ -236,6 +243,110 @@ int test_connect_disconnect_connect() {
     END_IT
 }
 
+int test_connect_pipelined() {
+    IT("sends a subscribe and publish behind the connect in one write");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    byte subscribe[] = { 0x82,0xa,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0 };
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(connect,26);
+    shimClient.expect(subscribe,12);
+    shimClient.expect(publish,16);
+
+    uint8_t writeBuffer[128];
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    int rc = client.beginConnect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.subscribe((char*)"topic"));
+    IS_TRUE(client.publish((char*)"topic",(char*)"payload"));
+    IS_EQUAL(shimClient.writes(),0);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    rc = client.endConnect();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes(),1);
+    IS_TRUE(client.state() == MQTT_CONNECTED);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_connect_pipelined_loop() {
+    IT("leaves the connack to endConnect when loop is called before it");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+
+    uint8_t writeBuffer[128];
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    client.setClock(virtualClock);
+    int rc = client.beginConnect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    // Past the keepalive interval, yet no ping goes out
+    now += 16000;
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes(),0);
+
+    rc = client.endConnect();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes(),1);
+    IS_TRUE(client.state() == MQTT_CONNECTED);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_connect_pipelined_refused() {
+    IT("gives back the message ids used behind a refused connect");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x0,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    byte subscribe[] = { 0x82,0xa,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0 };
+    shimClient.expect(connect,26);
+    shimClient.expect(subscribe,12);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.beginConnect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.subscribe((char*)"topic"));
+    byte refused[] = { 0x20, 0x02, 0x00, 0x05 };
+    shimClient.respond(refused,4);
+    rc = client.endConnect();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECT_UNAUTHORIZED);
+    IS_FALSE(client.connected());
+
+    // The subscribe is sent again with the same message id
+    shimClient.expect(connect,26);
+    shimClient.expect(subscribe,12);
+    rc = client.beginConnect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.subscribe((char*)"topic"));
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    rc = client.endConnect();
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Connect");
@@ -252,5 +363,8 @@ int main()
     test_connect_with_will();
     test_connect_with_will_username_password();
     test_connect_disconnect_connect();
+    test_connect_pipelined();
+    test_connect_pipelined_loop();
+    test_connect_pipelined_refused();
     FINISH
 }
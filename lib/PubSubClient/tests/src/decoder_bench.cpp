@@ -0,0 +1,69 @@
+#include "MQTTPacketDecoder.h"
+#include "trace.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Decodes a stream of PUBLISH packets fed to MQTTPacketDecoder in slices
+// of varying size, as they would arrive from the network.
+
+#define PACKETS 10000
+#define ROUNDS 50
+
+double elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main()
+{
+    static uint8_t stream[PACKETS*64];
+    uint32_t length = 0;
+    for (int i = 0; i < PACKETS; i++) {
+        char payload[32];
+        int plength = sprintf(payload,"{\"speed\":%d}",i);
+        uint8_t* p = stream+length;
+        p[0] = 0x30;
+        p[1] = 2+18+plength;
+        p[2] = 0;
+        p[3] = 18;
+        memcpy(p+4,"hoalong/car1/speed",18);
+        memcpy(p+22,payload,plength);
+        length += 22+plength;
+    }
+
+    uint16_t slices[256];
+    srand(1);
+    for (int i = 0; i < 256; i++) {
+        slices[i] = 1+rand()%64;
+    }
+
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+    unsigned long packets = 0;
+    unsigned long payloadBytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        uint32_t pos = 0;
+        int s = 0;
+        while (pos < length) {
+            uint32_t n = slices[s++ & 0xFF];
+            if (n > length-pos) {
+                n = length-pos;
+            }
+            while (n > 0) {
+                uint32_t used = decoder.push(stream+pos,n);
+                pos += used;
+                n -= used;
+                if (decoder.ready()) {
+                    packets++;
+                    payloadBytes += decoder.packet().payloadLength;
+                }
+            }
+        }
+    }
+    double ns = elapsedNs(start);
+
+    LOG("Packet decoder, " << PACKETS*ROUNDS << " packets in 1-64 byte slices\n");
+    LOG(" - " << ns/packets << " ns/packet, " << (length*(double)ROUNDS)/(ns/1e9)/1e6 << " MB/s\n\n");
+    return (packets == (unsigned long)PACKETS*ROUNDS && payloadBytes > 0) ? 0 : 1;
+}
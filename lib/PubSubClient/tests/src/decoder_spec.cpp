@@ -0,0 +1,149 @@
+#include "MQTTPacketDecoder.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+byte publishQos1[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+byte pingresp[] = {0xD0,0x0};
+
+int test_decoder_whole_packet() {
+    IT("decodes a packet pushed in one piece");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    IS_EQUAL(decoder.push(publish,16),16);
+    IS_TRUE(decoder.ready());
+    const MQTTPacket& packet = decoder.packet();
+    IS_EQUAL(packet.type,0x30);
+    IS_EQUAL(packet.flags,0);
+    IS_EQUAL(packet.length,16);
+    IS_EQUAL(packet.headerLength,2);
+    IS_EQUAL(packet.topicLength,5);
+    IS_TRUE(memcmp(packet.topic,"topic",5)==0);
+    IS_EQUAL(packet.payloadLength,7);
+    IS_TRUE(memcmp(packet.payload,"payload",7)==0);
+
+    END_IT
+}
+
+int test_decoder_byte_at_a_time() {
+    IT("decodes a packet pushed a byte at a time");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    for (int i = 0; i < 17; i++) {
+        IS_FALSE(decoder.ready());
+        IS_EQUAL(decoder.push(publishQos1+i,1),1);
+    }
+    IS_FALSE(decoder.ready());
+    IS_EQUAL(decoder.needed(),1);
+    IS_EQUAL(decoder.push(publishQos1+17,1),1);
+    IS_TRUE(decoder.ready());
+    IS_EQUAL(decoder.packet().flags,0x02);
+    IS_EQUAL(decoder.packet().msgId,0x1234);
+    IS_EQUAL(decoder.packet().payloadLength,7);
+
+    END_IT
+}
+
+int test_decoder_stops_at_packet_end() {
+    IT("stops at the end of each packet");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    byte stream[36];
+    memcpy(stream,pingresp,2);
+    memcpy(stream+2,publish,16);
+    memcpy(stream+18,publishQos1,18);
+
+    IS_EQUAL(decoder.push(stream,36),2);
+    IS_TRUE(decoder.ready());
+    IS_EQUAL(decoder.packet().type,0xD0);
+    IS_EQUAL(decoder.push(stream+2,34),16);
+    IS_EQUAL(decoder.packet().type,0x30);
+    IS_EQUAL(decoder.push(stream+18,18),18);
+    IS_EQUAL(decoder.packet().msgId,0x1234);
+
+    END_IT
+}
+
+int test_decoder_needed() {
+    IT("never asks for bytes past the end of a packet");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    IS_EQUAL(decoder.needed(),1);
+    decoder.push(publish,1);
+    IS_EQUAL(decoder.needed(),1);
+    decoder.push(publish+1,1);
+    IS_EQUAL(decoder.needed(),14);
+    decoder.push(publish+2,4);
+    IS_EQUAL(decoder.needed(),10);
+
+    END_IT
+}
+
+int test_decoder_skips_oversized() {
+    IT("skips packets too big for the buffer");
+    uint8_t buffer[16];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    // Bigger than the buffer by two bytes
+    IS_EQUAL(decoder.push(publishQos1,18),18);
+    IS_FALSE(decoder.ready());
+    IS_FALSE(decoder.malformed());
+    IS_EQUAL(decoder.dropped(),1);
+
+    IS_EQUAL(decoder.push(publish,16),16);
+    IS_TRUE(decoder.ready());
+    IS_EQUAL(decoder.packet().payloadLength,7);
+
+    END_IT
+}
+
+int test_decoder_malformed() {
+    IT("reports a malformed remaining length");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    byte bad[] = {0x30,0xff,0xff,0xff,0xff,0x01};
+    IS_EQUAL(decoder.push(bad,6),5);
+    IS_TRUE(decoder.malformed());
+    IS_EQUAL(decoder.needed(),0);
+    IS_EQUAL(decoder.push(bad+5,1),0);
+
+    decoder.reset();
+    IS_FALSE(decoder.malformed());
+    IS_EQUAL(decoder.push(pingresp,2),2);
+    IS_TRUE(decoder.ready());
+
+    END_IT
+}
+
+int test_decoder_malformed_publish() {
+    IT("reports a publish whose topic overruns the packet");
+    uint8_t buffer[128];
+    MQTTPacketDecoder decoder(buffer,sizeof(buffer));
+
+    byte bad[] = {0x30,0x3,0x0,0x5,0x74};
+    IS_EQUAL(decoder.push(bad,5),5);
+    IS_FALSE(decoder.ready());
+    IS_TRUE(decoder.malformed());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Packet decoder");
+    test_decoder_whole_packet();
+    test_decoder_byte_at_a_time();
+    test_decoder_stops_at_packet_end();
+    test_decoder_needed();
+    test_decoder_skips_oversized();
+    test_decoder_malformed();
+    test_decoder_malformed_publish();
+
+    FINISH
+}
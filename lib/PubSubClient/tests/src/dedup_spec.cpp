@@ -0,0 +1,242 @@
+#include "PubSubClient.h"
+#include "MQTTPacketIdWindow.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+byte server[] = { 172, 16, 0, 2 };
+
+int callback_count = 0;
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_count++;
+}
+
+
+int test_window_remembers_recent_ids() {
+    IT("remembers the ids added within the window");
+
+    MQTTPacketIdWindow window;
+    IS_FALSE(window.contains(1));
+    for (uint16_t id = 1; id <= 10; id++) {
+        window.add(id);
+    }
+    for (uint16_t id = 1; id <= 10; id++) {
+        IS_TRUE(window.contains(id));
+    }
+    IS_FALSE(window.contains(11));
+    IS_FALSE(window.contains(0));
+
+    window.reset();
+    IS_FALSE(window.contains(5));
+
+    END_IT
+}
+
+int test_window_slides() {
+    IT("forgets ids that slide out of the window");
+
+    // The window is rounded up to whole 32 bit words
+    uint16_t width = MQTT_DEDUP_WORDS*32;
+    MQTTPacketIdWindow window;
+    window.add(100);
+    window.add(102);
+    IS_TRUE(window.contains(100));
+    IS_FALSE(window.contains(101));
+
+    window.add(100+width-1);
+    IS_TRUE(window.contains(100));
+    IS_TRUE(window.contains(102));
+
+    window.add(100+width+1);
+    IS_FALSE(window.contains(100));
+    IS_TRUE(window.contains(102));
+
+    window.add(5000);
+    IS_FALSE(window.contains(102));
+    IS_TRUE(window.contains(5000));
+
+    END_IT
+}
+
+int test_window_out_of_order() {
+    IT("takes ids out of order and across the wrap");
+
+    MQTTPacketIdWindow window;
+    window.add(65534);
+    window.add(2);
+    window.add(65535);
+    IS_TRUE(window.contains(65534));
+    IS_TRUE(window.contains(65535));
+    IS_FALSE(window.contains(1));
+    IS_TRUE(window.contains(2));
+
+    END_IT
+}
+
+int test_dedup_drops_redelivery() {
+    IT("acknowledges a redelivered qos 1 message without passing it on again");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,1);
+
+    // The same message again, marked as a duplicate
+    publish[0] |= 0x08;
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,1);
+    IS_EQUAL(client.duplicates(),1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_dedup_reused_id() {
+    IT("passes on a new message that reuses a message id");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,2);
+    IS_EQUAL(client.duplicates(),0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_dedup_forgotten_on_clean_session() {
+    IT("forgets the ids seen when a new clean session starts");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x3a,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    byte disconnect[] = {0xE0,0x00};
+    shimClient.expect(disconnect,2);
+    client.disconnect();
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,2);
+    IS_EQUAL(client.duplicates(),0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_dedup_kept_across_resumed_session() {
+    IT("drops a redelivery after resuming a session");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    // The connection drops before the PUBACK reaches the server
+    shimClient.setConnected(false);
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x0,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    byte resumed[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(resumed,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    publish[0] |= 0x08;
+    shimClient.respond(publish,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,1);
+    IS_EQUAL(client.duplicates(),1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Duplicates");
+    test_window_remembers_recent_ids();
+    test_window_slides();
+    test_window_out_of_order();
+    test_dedup_drops_redelivery();
+    test_dedup_reused_id();
+    test_dedup_forgotten_on_clean_session();
+    test_dedup_kept_across_resumed_session();
+
+    FINISH
+}
@@ -3,7 +3,6 @@
 #include "Buffer.h"
 #include "BDDTest.h"
 #include "trace.h"
-#include <unistd.h>
 
 byte server[] = { 172, 16, 0, 2 };
 
@@ -11,9 +10,20 @@ void callback(char* topic, byte* payload, unsigned int length) {
   // handle message arrived
 }
 
+// Virtual time, moved on by the tests instead of sleeping
+unsigned long now = 0;
+
+unsigned long virtualClock() {
+    return now;
+}
+
+void advance(unsigned int seconds) {
+    now += seconds*1000UL;
+}
+
 
 int test_keepalive_pings_idle() {
-    IT("keeps an idle connection alive (takes 1 minute)");
+    IT("keeps an idle connection alive");
 
     ShimClient shimClient;
     shimClient.setAllowConnect(true);
@@ -22,6 +32,7 @@ int test_keepalive_pings_idle() {
     shimClient.respond(connack,4);
 
     PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
@@ -31,7 +42,7 @@ int test_keepalive_pings_idle() {
     shimClient.respond(pingresp,2);
 
     for (int i = 0; i < 50; i++) {
-        sleep(1);
+        advance(1);
         if ( i == 15 || i == 31 || i == 47) {
             shimClient.expect(pingreq,2);
             shimClient.respond(pingresp,2);
@@ -46,7 +57,7 @@ int test_keepalive_pings_idle() {
 }
 
 int test_keepalive_pings_with_outbound_qos0() {
-    IT("keeps a connection alive that only sends qos0 (takes 1 minute)");
+    IT("keeps a connection alive that only sends qos0");
 
     ShimClient shimClient;
     shimClient.setAllowConnect(true);
@@ -55,6 +66,7 @@ int test_keepalive_pings_with_outbound_qos0() {
     shimClient.respond(connack,4);
 
     PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
@@ -66,7 +78,8 @@ int test_keepalive_pings_with_outbound_qos0() {
         rc = client.publish((char*)"topic",(char*)"payload");
         IS_TRUE(rc);
         IS_FALSE(shimClient.error());
-        sleep(1);
+        advance(1);
+        // The server has said nothing for too long
         if ( i == 15 || i == 31 || i == 47) {
             byte pingreq[] = { 0xC0,0x0 };
             shimClient.expect(pingreq,2);
@@ -82,7 +95,7 @@ int test_keepalive_pings_with_outbound_qos0() {
 }
 
 int test_keepalive_pings_with_inbound_qos0() {
-    IT("keeps a connection alive that only receives qos0 (takes 1 minute)");
+    IT("keeps a connection alive that only receives qos0");
 
     ShimClient shimClient;
     shimClient.setAllowConnect(true);
@@ -91,6 +104,7 @@ int test_keepalive_pings_with_inbound_qos0() {
     shimClient.respond(connack,4);
 
     PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
@@ -98,7 +112,7 @@ int test_keepalive_pings_with_inbound_qos0() {
 
     for (int i = 0; i < 50; i++) {
         TRACE(i<<":");
-        sleep(1);
+        advance(1);
         if ( i == 15 || i == 31 || i == 47) {
             byte pingreq[] = { 0xC0,0x0 };
             shimClient.expect(pingreq,2);
@@ -115,7 +129,7 @@ int test_keepalive_pings_with_inbound_qos0() {
 }
 
 int test_keepalive_no_pings_inbound_qos1() {
-    IT("does not send pings for connections with inbound qos1 (takes 1 minute)");
+    IT("does not send pings for connections with inbound qos1");
 
     ShimClient shimClient;
     shimClient.setAllowConnect(true);
@@ -124,6 +138,7 @@ int test_keepalive_no_pings_inbound_qos1() {
     shimClient.respond(connack,4);
 
     PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
@@ -133,7 +148,7 @@ int test_keepalive_no_pings_inbound_qos1() {
     for (int i = 0; i < 50; i++) {
         shimClient.respond(publish,18);
         shimClient.expect(puback,4);
-        sleep(1);
+        advance(1);
         rc = client.loop();
         IS_TRUE(rc);
         IS_FALSE(shimClient.error());
@@ -143,7 +158,7 @@ int test_keepalive_no_pings_inbound_qos1() {
 }
 
 int test_keepalive_disconnects_hung() {
-    IT("disconnects a hung connection (takes 30 seconds)");
+    IT("disconnects a hung connection");
 
     ShimClient shimClient;
     shimClient.setAllowConnect(true);
@@ -152,6 +167,7 @@ int test_keepalive_disconnects_hung() {
     shimClient.respond(connack,4);
 
     PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
@@ -159,7 +175,7 @@ int test_keepalive_disconnects_hung() {
     shimClient.expect(pingreq,2);
 
     for (int i = 0; i < 32; i++) {
-        sleep(1);
+        advance(1);
         rc = client.loop();
     }
     IS_FALSE(rc);
@@ -172,6 +188,114 @@ int test_keepalive_disconnects_hung() {
     END_IT
 }
 
+int test_keepalive_configured_interval() {
+    IT("uses the configured keepalive and measures the ping round trip");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0x1,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
+    client.setKeepAlive(1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_EQUAL(client.pingRtt(),0);
+
+    byte pingreq[] = { 0xC0,0x0 };
+    shimClient.expect(pingreq,2);
+    advance(2);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte pingresp[] = { 0xD0,0x0 };
+    shimClient.respond(pingresp,2);
+    advance(1);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(client.pingRtt(),1000);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_keepalive_socket_timeout() {
+    IT("disconnects once a ping goes unanswered for the socket timeout");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
+    client.setKeepAlive(1).setSocketTimeout(2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte pingreq[] = { 0xC0,0x0 };
+    shimClient.expect(pingreq,2);
+    advance(2);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    advance(1);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    advance(1);
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTION_TIMEOUT);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_keepalive_idle_hour() {
+    IT("keeps an idle connection alive for an hour");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte pingreq[] = { 0xC0,0x0 };
+    byte pingresp[] = { 0xD0,0x0 };
+
+    // A ping goes out once nothing has been sent for more than 15 seconds,
+    // and is answered a second later
+    for (int i = 1; i <= 3600; i++) {
+        advance(1);
+        if (i % 16 == 0) {
+            shimClient.expect(pingreq,2);
+        }
+        rc = client.loop();
+        IS_TRUE(rc);
+        IS_FALSE(shimClient.error());
+        if (i % 16 == 0) {
+            shimClient.respond(pingresp,2);
+        }
+    }
+    IS_EQUAL(client.pingRtt(),1000);
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Keep-alive");
@@ -180,6 +304,9 @@ int main()
     test_keepalive_pings_with_inbound_qos0();
     test_keepalive_no_pings_inbound_qos1();
     test_keepalive_disconnects_hung();
+    test_keepalive_configured_interval();
+    test_keepalive_socket_timeout();
+    test_keepalive_idle_hour();
 
     FINISH
 }
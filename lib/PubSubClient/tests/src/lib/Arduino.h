@@ -15,6 +15,7 @@ extern "C"{
     extern void setup( void ) ;
     extern void loop( void ) ;
     uint32_t millis( void );
+    uint32_t micros( void );
 }
 
 #define PROGMEM
@@ -2,13 +2,22 @@
 #include "Arduino.h"
 
 Buffer::Buffer() {
+    this->pos = 0;
 }
 
 Buffer::Buffer(uint8_t* buf, size_t size) {
+    this->pos = 0;
     this->add(buf,size);
 }
 bool Buffer::available() {
-    return this->pos < this->length;
+    if (this->pos == this->buffer.size() && this->generator) {
+        this->buffer.clear();
+        this->pos = 0;
+        if (!this->generator(*this)) {
+            this->generator = NULL;
+        }
+    }
+    return this->pos < this->buffer.size();
 }
 
 uint8_t Buffer::next() {
@@ -23,8 +32,9 @@ void Buffer::reset() {
 }
 
 void Buffer::add(uint8_t* buf, size_t size) {
-    uint16_t i = 0;
-    for (;i<size;i++) {
-        this->buffer[this->length++] = buf[i];
-    }
+    this->buffer.insert(this->buffer.end(),buf,buf+size);
+}
+
+void Buffer::generate(BufferGenerator generator) {
+    this->generator = generator;
 }
@@ -2,12 +2,21 @@
 #define buffer_h
 
 #include "Arduino.h"
+#include <functional>
+#include <vector>
+
+class Buffer;
+
+// Called when a buffer has been read to the end, to add() more to it.
+// Returns false once it has nothing more to give; returning true without
+// adding anything leaves the buffer empty until it is next read.
+typedef std::function<bool(Buffer&)> BufferGenerator;
 
 class Buffer {
 private:
-    uint8_t buffer[1024];
-    uint16_t pos;
-    uint16_t length;
+    std::vector<uint8_t> buffer;
+    size_t pos;
+    BufferGenerator generator;
     
 public:
     Buffer();
@@ -18,6 +27,9 @@ public:
     virtual void reset();
     
     virtual void add(uint8_t* buf, size_t size);
+    // Bytes already read are discarded each time the generator is called,
+    // so a generated script can be far longer than fits in memory
+    virtual void generate(BufferGenerator generator);
 };
 
 #endif
@@ -0,0 +1,296 @@
+#include "FakeBroker.h"
+#include "MQTTVarint.h"
+#include "PubSubClient.h"
+#include "trace.h"
+
+FakeBroker::FakeBroker() {
+    this->_published = 0;
+    this->_delivered = 0;
+}
+
+FakeBroker::~FakeBroker() {
+    for (size_t i = 0; i < sessions.size(); i++) {
+        delete sessions[i]->decoder;
+        delete[] sessions[i]->storage;
+        delete sessions[i];
+    }
+}
+
+int FakeBroker::open() {
+    FakeSession* session = new FakeSession();
+    session->open = true;
+    session->connected = false;
+    session->storage = new uint8_t[FAKE_BROKER_MAX_PACKET];
+    session->decoder = new MQTTPacketDecoder(session->storage,FAKE_BROKER_MAX_PACKET);
+    session->nextMsgId = 1;
+    session->unacked = 0;
+    sessions.push_back(session);
+    return sessions.size()-1;
+}
+
+void FakeBroker::close(int session) {
+    FakeSession* s = sessions[session];
+    s->open = false;
+    s->connected = false;
+    s->decoder->reset();
+    s->toClient.clear();
+    s->subscriptions.clear();
+}
+
+bool FakeBroker::isOpen(int session) {
+    return sessions[session]->open;
+}
+
+std::deque<uint8_t>& FakeBroker::output(int session) {
+    return sessions[session]->toClient;
+}
+
+// Handles every packet buf completes; the decoder keeps any partial one
+void FakeBroker::receive(int session, const uint8_t* buf, size_t size) {
+    MQTTPacketDecoder* decoder = sessions[session]->decoder;
+    while (size > 0 && sessions[session]->open) {
+        uint32_t used = decoder->push(buf,size);
+        buf += used;
+        size -= used;
+        if (decoder->malformed() || (decoder->ready() && !process(session,decoder->packet()))) {
+            TRACE("broker: closing session " << session << "\n");
+            close(session);
+            return;
+        }
+    }
+}
+
+void FakeBroker::send(int session, uint8_t header, const uint8_t* body, uint32_t length) {
+    std::deque<uint8_t>& out = sessions[session]->toClient;
+    uint8_t lbuf[MQTT_VARINT_MAX_BYTES];
+    uint8_t llen = MQTTVarint::encode(length,lbuf);
+    out.push_back(header);
+    out.insert(out.end(),lbuf,lbuf+llen);
+    out.insert(out.end(),body,body+length);
+}
+
+bool FakeBroker::process(int session, const MQTTPacket& packet) {
+    FakeSession& s = *sessions[session];
+    uint8_t type = packet.type;
+    const uint8_t* body = packet.data+packet.headerLength;
+    uint32_t length = packet.length-packet.headerLength;
+    if (!s.connected && type != MQTTCONNECT) {
+        return false;
+    }
+    switch (type) {
+    case MQTTCONNECT: {
+        if (s.connected || length < 12) {
+            return false;
+        }
+        // Protocol name, level, flags and keepalive come before the id
+        uint16_t idLength = (body[10] << 8) | body[11];
+        s.clientId.assign((const char*)body+12,idLength);
+        s.connected = true;
+        uint8_t connack[] = {0x00,0x00};
+        send(session,MQTTCONNACK,connack,2);
+        return true;
+    }
+    case MQTTPUBLISH: {
+        uint8_t qos = (packet.flags >> 1) & 0x03;
+        if (qos > 1) {
+            return false;
+        }
+        _published++;
+        if (qos) {
+            uint8_t msgId[] = {(uint8_t)(packet.msgId >> 8),(uint8_t)(packet.msgId & 0xFF)};
+            send(session,MQTTPUBACK,msgId,2);
+        }
+        route(std::string(packet.topic,packet.topicLength),packet.payload,packet.payloadLength,qos);
+        return true;
+    }
+    case MQTTPUBACK:
+        if (s.unacked > 0) {
+            s.unacked--;
+        }
+        return true;
+    case MQTTSUBSCRIBE:
+    case MQTTUNSUBSCRIBE: {
+        if (length < 2) {
+            return false;
+        }
+        std::vector<uint8_t> ack(body,body+2);
+        uint32_t pos = 2;
+        while (pos+2 <= length) {
+            uint16_t tlen = (body[pos] << 8) | body[pos+1];
+            std::string filter((const char*)body+pos+2,tlen);
+            pos += 2+tlen;
+            for (size_t i = 0; i < s.subscriptions.size(); i++) {
+                if (s.subscriptions[i].filter == filter) {
+                    s.subscriptions.erase(s.subscriptions.begin()+i);
+                    break;
+                }
+            }
+            if (type == MQTTSUBSCRIBE) {
+                FakeSubscription sub;
+                sub.filter = filter;
+                sub.qos = (body[pos] > 1) ? 1 : body[pos];
+                s.subscriptions.push_back(sub);
+                ack.push_back(sub.qos);
+                pos++;
+            }
+        }
+        send(session,(type == MQTTSUBSCRIBE) ? MQTTSUBACK : MQTTUNSUBACK,&ack[0],ack.size());
+        return true;
+    }
+    case MQTTPINGREQ:
+        send(session,MQTTPINGRESP,NULL,0);
+        return true;
+    case MQTTDISCONNECT:
+        return false;
+    }
+    return false;
+}
+
+void FakeBroker::route(const std::string& topic, const uint8_t* payload, uint32_t length, uint8_t qos) {
+    std::vector<uint8_t> body;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        FakeSession& s = *sessions[i];
+        if (!s.connected) {
+            continue;
+        }
+        // A client gets one copy, at the highest QoS of its matching filters
+        int granted = -1;
+        for (size_t j = 0; j < s.subscriptions.size(); j++) {
+            if (matches(s.subscriptions[j].filter,topic) && s.subscriptions[j].qos > granted) {
+                granted = s.subscriptions[j].qos;
+            }
+        }
+        if (granted < 0) {
+            continue;
+        }
+        uint8_t q = (qos < granted) ? qos : granted;
+        body.clear();
+        body.push_back(topic.size() >> 8);
+        body.push_back(topic.size() & 0xFF);
+        body.insert(body.end(),topic.begin(),topic.end());
+        if (q) {
+            body.push_back(s.nextMsgId >> 8);
+            body.push_back(s.nextMsgId & 0xFF);
+            s.nextMsgId = (s.nextMsgId == 0xFFFF) ? 1 : s.nextMsgId+1;
+            s.unacked++;
+        }
+        body.insert(body.end(),payload,payload+length);
+        send(i,MQTTPUBLISH|(q << 1),&body[0],body.size());
+        _delivered++;
+    }
+}
+
+bool FakeBroker::matches(const std::string& filter, const std::string& topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/') {
+                t++;
+            }
+            f++;
+        } else {
+            if (t >= topic.size() || filter[f] != topic[t]) {
+                // a/# also matches its parent level a
+                return t == topic.size() && filter.compare(f,std::string::npos,"/#") == 0;
+            }
+            f++;
+            t++;
+        }
+    }
+    return t == topic.size();
+}
+
+uint32_t FakeBroker::published() {
+    return _published;
+}
+
+uint32_t FakeBroker::delivered() {
+    return _delivered;
+}
+
+uint32_t FakeBroker::unacked(int session) {
+    return sessions[session]->unacked;
+}
+
+
+LoopbackClient::LoopbackClient(FakeBroker& broker) {
+    this->broker = &broker;
+    this->session = -1;
+}
+
+int LoopbackClient::connect(IPAddress ip, uint16_t port) {
+    if (connected()) {
+        stop();
+    }
+    this->session = broker->open();
+    return 1;
+}
+
+int LoopbackClient::connect(const char *host, uint16_t port) {
+    return connect(IPAddress(0,0,0,0),port);
+}
+
+size_t LoopbackClient::write(uint8_t b) {
+    return write(&b,1);
+}
+
+size_t LoopbackClient::write(const uint8_t *buf, size_t size) {
+    if (!connected()) {
+        return 0;
+    }
+    broker->receive(session,buf,size);
+    return size;
+}
+
+int LoopbackClient::available() {
+    if (session < 0) {
+        return 0;
+    }
+    return broker->output(session).size();
+}
+
+int LoopbackClient::read() {
+    if (available() == 0) {
+        return -1;
+    }
+    std::deque<uint8_t>& out = broker->output(session);
+    uint8_t b = out.front();
+    out.pop_front();
+    return b;
+}
+
+int LoopbackClient::read(uint8_t *buf, size_t size) {
+    size_t i = 0;
+    for (; i < size && available() > 0; i++) {
+        buf[i] = read();
+    }
+    return i;
+}
+
+int LoopbackClient::peek() {
+    if (available() == 0) {
+        return -1;
+    }
+    return broker->output(session).front();
+}
+
+void LoopbackClient::flush() {
+}
+
+void LoopbackClient::stop() {
+    if (session >= 0 && broker->isOpen(session)) {
+        broker->close(session);
+    }
+}
+
+uint8_t LoopbackClient::connected() {
+    return session >= 0 && broker->isOpen(session);
+}
+
+LoopbackClient::operator bool() {
+    return connected();
+}
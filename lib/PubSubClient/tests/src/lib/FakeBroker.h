@@ -0,0 +1,84 @@
+#ifndef fakebroker_h
+#define fakebroker_h
+
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+#include "MQTTPacketDecoder.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// Largest packet the broker accepts; larger ones are dropped
+#define FAKE_BROKER_MAX_PACKET 65536
+
+typedef struct {
+    std::string filter;
+    uint8_t qos;
+} FakeSubscription;
+
+typedef struct {
+    bool open;
+    bool connected;
+    std::string clientId;
+    uint8_t* storage;
+    MQTTPacketDecoder* decoder;
+    std::deque<uint8_t> toClient;
+    std::vector<FakeSubscription> subscriptions;
+    uint16_t nextMsgId;
+    uint32_t unacked;
+} FakeSession;
+
+// An MQTT 3.1.1 broker living in the test process. LoopbackClients hand it
+// whatever PubSubClient writes and read back what it sends, so several
+// clients can talk to each other without a network. It handles CONNECT,
+// SUBSCRIBE, UNSUBSCRIBE, PUBLISH at QoS 0 and 1, PUBACK, PINGREQ and
+// DISCONNECT; anything else closes the connection.
+class FakeBroker {
+private:
+    std::vector<FakeSession*> sessions;
+    uint32_t _published;
+    uint32_t _delivered;
+    bool process(int session, const MQTTPacket& packet);
+    void send(int session, uint8_t header, const uint8_t* body, uint32_t length);
+    void route(const std::string& topic, const uint8_t* payload, uint32_t length, uint8_t qos);
+    static bool matches(const std::string& filter, const std::string& topic);
+
+public:
+    FakeBroker();
+    ~FakeBroker();
+    int open();
+    void close(int session);
+    void receive(int session, const uint8_t* buf, size_t size);
+    std::deque<uint8_t>& output(int session);
+    bool isOpen(int session);
+
+    // PUBLISH packets received from clients and sent to subscribers
+    uint32_t published();
+    uint32_t delivered();
+    // QoS 1 messages sent to session that it has not acknowledged
+    uint32_t unacked(int session);
+};
+
+class LoopbackClient : public Client {
+private:
+    FakeBroker* broker;
+    int session;
+
+public:
+  LoopbackClient(FakeBroker& broker);
+  virtual int connect(IPAddress ip, uint16_t port);
+  virtual int connect(const char *host, uint16_t port);
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  virtual int available();
+  virtual int read();
+  virtual int read(uint8_t *buf, size_t size);
+  virtual int peek();
+  virtual void flush();
+  virtual void stop();
+  virtual uint8_t connected();
+  virtual operator bool();
+};
+
+#endif
@@ -8,6 +8,11 @@ extern "C" {
     uint32_t millis(void) {
        return time(0)*1000;
     }
+    uint32_t micros(void) {
+       struct timespec ts;
+       clock_gettime(CLOCK_MONOTONIC,&ts);
+       return ts.tv_sec*1000000+ts.tv_nsec/1000;
+    }
 }
 
 ShimClient::ShimClient() {
@@ -18,9 +23,15 @@ ShimClient::ShimClient() {
     this->_error = false;
     this->expectAnything = true;
     this->_received = 0;
+    this->_writes = 0;
     this->_expectedPort = 0;
 }
 
+ShimClient::~ShimClient() {
+    delete this->responseBuffer;
+    delete this->expectBuffer;
+}
+
 int ShimClient::connect(IPAddress ip, uint16_t port) {
     if (this->_allowConnect) {
         this->_connected = true;
@@ -56,6 +67,7 @@ int ShimClient::connect(const char *host, uint16_t port)  {
 }
 size_t ShimClient::write(uint8_t b)  {
     this->_received += 1;
+    this->_writes += 1;
     TRACE(std::hex << (unsigned int)b);
     if (!this->expectAnything) {
         if (this->expectBuffer->available()) {
@@ -73,8 +85,9 @@ size_t ShimClient::write(uint8_t b)  {
 }
 size_t ShimClient::write(const uint8_t *buf, size_t size)  {
     this->_received += size;
+    this->_writes += 1;
     TRACE( "[" << std::dec << (unsigned int)(size) << "] ");
-    uint16_t i=0;
+    size_t i=0;
     for (;i<size;i++) {
         if (i>0) {
             TRACE(":");
@@ -101,7 +114,7 @@ int ShimClient::available()  {
 }
 int ShimClient::read()  { return this->responseBuffer->next(); }
 int ShimClient::read(uint8_t *buf, size_t size) {
-    uint16_t i = 0;
+    size_t i = 0;
     for (;i<size;i++) {
         buf[i] = this->read();
     }
@@ -121,6 +134,11 @@ ShimClient* ShimClient::respond(uint8_t *buf, size_t size) {
     return this;
 }
 
+ShimClient* ShimClient::respond(BufferGenerator generator) {
+    this->responseBuffer->generate(generator);
+    return this;
+}
+
 ShimClient* ShimClient::expect(uint8_t *buf, size_t size) {
     this->expectAnything = false;
     this->expectBuffer->add(buf,size);
@@ -138,10 +156,14 @@ bool ShimClient::error() {
     return this->_error;
 }
 
-uint16_t ShimClient::received() {
+size_t ShimClient::received() {
     return this->_received;
 }
 
+size_t ShimClient::writes() {
+    return this->_writes;
+}
+
 void ShimClient::expectConnect(IPAddress ip, uint16_t port) {
     this->_expectedIP = ip;
     this->_expectedPort = port;
@@ -15,13 +15,15 @@ private:
     bool _connected;
     bool expectAnything;
     bool _error;
-    uint16_t _received;
+    size_t _received;
+    size_t _writes;
     IPAddress _expectedIP;
     uint16_t _expectedPort;
     const char* _expectedHost;
     
 public:
   ShimClient();
+  virtual ~ShimClient();
   virtual int connect(IPAddress ip, uint16_t port);
   virtual int connect(const char *host, uint16_t port);
   virtual size_t write(uint8_t);
@@ -37,11 +39,15 @@ public:
   
   virtual ShimClient* respond(uint8_t *buf, size_t size);
   virtual ShimClient* expect(uint8_t *buf, size_t size);
+  // Responds with whatever the generator adds each time the client has read
+  // all there is, for scripts too long to write out up front
+  virtual ShimClient* respond(BufferGenerator generator);
   
   virtual void expectConnect(IPAddress ip, uint16_t port);
   virtual void expectConnect(const char *host, uint16_t port);
   
-  virtual uint16_t received();
+  virtual size_t received();
+  virtual size_t writes();
   virtual bool error();
   
   virtual void setAllowConnect(bool b);
@@ -0,0 +1,159 @@
+#include "ShimUdp.h"
+#include "trace.h"
+
+ShimUdp::ShimUdp() {
+    this->responseBuffer = new Buffer();
+    this->expectBuffer = new Buffer();
+    this->responseCount = 0;
+    this->responseNext = 0;
+    this->expectCount = 0;
+    this->expectNext = 0;
+    this->readLeft = 0;
+    this->packetLength = 0;
+    this->inPacket = false;
+    this->expectAnything = true;
+    this->_error = false;
+    this->_sent = 0;
+    this->_expectedPort = 0;
+}
+
+uint8_t ShimUdp::begin(uint16_t port) {
+    return 1;
+}
+
+void ShimUdp::stop() {
+}
+
+int ShimUdp::beginPacket(IPAddress ip, uint16_t port) {
+    if (this->_expectedPort != 0 && port != this->_expectedPort) {
+        TRACE("port mismatch\n");
+        this->_error = true;
+    }
+    this->packetLength = 0;
+    this->inPacket = true;
+    return 1;
+}
+
+int ShimUdp::beginPacket(const char *host, uint16_t port) {
+    return beginPacket(IPAddress(0,0,0,0),port);
+}
+
+int ShimUdp::endPacket() {
+    if (!this->inPacket) {
+        this->_error = true;
+        return 0;
+    }
+    this->inPacket = false;
+    this->_sent++;
+    TRACE("<" << std::dec << this->packetLength << "> ");
+    for (uint16_t i=0;i<this->packetLength;i++) {
+        TRACE(std::hex << (unsigned int)this->packet[i] << ":");
+    }
+    TRACE("\n" << std::dec);
+    if (this->expectAnything) {
+        return 1;
+    }
+    if (this->expectNext >= this->expectCount) {
+        this->_error = true;
+        return 1;
+    }
+    uint16_t size = this->expectSizes[this->expectNext++];
+    if (size != this->packetLength) {
+        TRACE("size != " << size << "\n");
+        this->_error = true;
+    }
+    for (uint16_t i=0;i<size;i++) {
+        uint8_t expected = this->expectBuffer->next();
+        if (i < this->packetLength && expected != this->packet[i]) {
+            TRACE("byte " << i << " != " << std::hex << (unsigned int)expected << std::dec << "\n");
+            this->_error = true;
+        }
+    }
+    return 1;
+}
+
+size_t ShimUdp::write(uint8_t b) {
+    return write(&b,1);
+}
+
+size_t ShimUdp::write(const uint8_t *buf, size_t size) {
+    if (!this->inPacket) {
+        this->_error = true;
+        return 0;
+    }
+    for (size_t i=0;i<size;i++) {
+        this->packet[this->packetLength++] = buf[i];
+    }
+    return size;
+}
+
+int ShimUdp::parsePacket() {
+    while (this->readLeft > 0) {
+        this->responseBuffer->next();
+        this->readLeft--;
+    }
+    if (this->responseNext < this->responseCount) {
+        this->readLeft = this->responseSizes[this->responseNext++];
+    }
+    return this->readLeft;
+}
+
+int ShimUdp::available() {
+    return this->readLeft;
+}
+
+int ShimUdp::read() {
+    if (this->readLeft == 0) {
+        return -1;
+    }
+    this->readLeft--;
+    return this->responseBuffer->next();
+}
+
+int ShimUdp::read(unsigned char* buffer, size_t len) {
+    size_t i = 0;
+    for (;i<len && this->readLeft > 0;i++) {
+        buffer[i] = read();
+    }
+    return i;
+}
+
+int ShimUdp::peek() {
+    return 0;
+}
+
+void ShimUdp::flush() {
+}
+
+IPAddress ShimUdp::remoteIP() {
+    return IPAddress(0,0,0,0);
+}
+
+uint16_t ShimUdp::remotePort() {
+    return 0;
+}
+
+ShimUdp* ShimUdp::respond(uint8_t *buf, size_t size) {
+    this->responseBuffer->add(buf,size);
+    this->responseSizes[this->responseCount++] = size;
+    return this;
+}
+
+ShimUdp* ShimUdp::expect(uint8_t *buf, size_t size) {
+    this->expectAnything = false;
+    this->expectBuffer->add(buf,size);
+    this->expectSizes[this->expectCount++] = size;
+    return this;
+}
+
+void ShimUdp::expectPort(uint16_t port) {
+    this->_expectedPort = port;
+}
+
+uint16_t ShimUdp::sent() {
+    return this->_sent;
+}
+
+bool ShimUdp::error() {
+    return this->_error;
+}
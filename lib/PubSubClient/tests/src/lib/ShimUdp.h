@@ -0,0 +1,57 @@
+#ifndef shimudp_h
+#define shimudp_h
+
+#include "Arduino.h"
+#include "Udp.h"
+#include "IPAddress.h"
+#include "Buffer.h"
+
+#define SHIM_UDP_MAX_DATAGRAMS 32
+
+// Like ShimClient, but checks and answers whole datagrams
+class ShimUdp : public UDP {
+private:
+    Buffer* responseBuffer;
+    Buffer* expectBuffer;
+    uint16_t responseSizes[SHIM_UDP_MAX_DATAGRAMS];
+    uint16_t expectSizes[SHIM_UDP_MAX_DATAGRAMS];
+    uint8_t responseCount;
+    uint8_t responseNext;
+    uint8_t expectCount;
+    uint8_t expectNext;
+    uint16_t readLeft;
+    uint8_t packet[1024];
+    uint16_t packetLength;
+    bool inPacket;
+    bool expectAnything;
+    bool _error;
+    uint16_t _sent;
+    uint16_t _expectedPort;
+
+public:
+  ShimUdp();
+  virtual uint8_t begin(uint16_t);
+  virtual void stop();
+  virtual int beginPacket(IPAddress ip, uint16_t port);
+  virtual int beginPacket(const char *host, uint16_t port);
+  virtual int endPacket();
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual int parsePacket();
+  virtual int available();
+  virtual int read();
+  virtual int read(unsigned char* buffer, size_t len);
+  virtual int peek();
+  virtual void flush();
+  virtual IPAddress remoteIP();
+  virtual uint16_t remotePort();
+
+  virtual ShimUdp* respond(uint8_t *buf, size_t size);
+  virtual ShimUdp* expect(uint8_t *buf, size_t size);
+  virtual void expectPort(uint16_t port);
+
+  virtual uint16_t sent();
+  virtual bool error();
+};
+
+#endif
@@ -5,6 +5,12 @@
 #include <stdlib.h>
 
 #define LOG(x) {std::cout << x << std::flush; }
-#define TRACE(x) {if (getenv("TRACE")) { std::cout << x << std::flush; }}
+#define TRACE(x) {if (tracing()) { std::cout << x << std::flush; }}
+
+// Looked up once, as TRACE is called for every byte written
+inline bool tracing() {
+    static bool enabled = getenv("TRACE") != NULL;
+    return enabled;
+}
 
 #endif
@@ -0,0 +1,275 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Virtual time, moved on by the tests instead of sleeping
+unsigned long now = 0;
+
+unsigned long virtualClock() {
+    return now;
+}
+
+void advance(unsigned int seconds) {
+    now += seconds*1000UL;
+}
+
+
+int test_metrics_start_empty() {
+    IT("starts with every count at zero");
+
+    ShimClient shimClient;
+    PubSubClient client(server, 1883, callback, shimClient);
+    const MQTTMetrics& metrics = client.metrics();
+    for (int i = 0; i < 16; i++) {
+        IS_EQUAL(metrics.packetsIn[i],0);
+        IS_EQUAL(metrics.packetsOut[i],0);
+    }
+    IS_EQUAL(metrics.connects,0);
+    IS_EQUAL(metrics.pings,0);
+
+    END_IT
+}
+
+int test_metrics_count_connect() {
+    IT("counts the connect, its latency and later reconnects");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.packetsOut[MQTTCONNECT >> 4],1);
+    IS_EQUAL(metrics.bytesOut[MQTTCONNECT >> 4],26);
+    IS_EQUAL(metrics.packetsIn[MQTTCONNACK >> 4],1);
+    IS_EQUAL(metrics.bytesIn[MQTTCONNACK >> 4],4);
+    IS_EQUAL(metrics.connects,1);
+    IS_EQUAL(metrics.reconnects,0);
+    IS_EQUAL(metrics.connackLatency,0);
+    IS_EQUAL(metrics.writes,1);
+
+    client.disconnect();
+    IS_EQUAL(metrics.packetsOut[MQTTDISCONNECT >> 4],1);
+
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_EQUAL(metrics.connects,2);
+    IS_EQUAL(metrics.reconnects,1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_metrics_count_publish() {
+    IT("counts packets and bytes by type in both directions");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    byte publishQos1[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(publish,16);
+    shimClient.respond(publishQos1,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.packetsOut[MQTTPUBLISH >> 4],1);
+    IS_EQUAL(metrics.bytesOut[MQTTPUBLISH >> 4],16);
+    IS_EQUAL(metrics.packetsIn[MQTTPUBLISH >> 4],2);
+    IS_EQUAL(metrics.bytesIn[MQTTPUBLISH >> 4],34);
+    IS_EQUAL(metrics.packetsOut[MQTTPUBACK >> 4],1);
+    IS_EQUAL(metrics.bytesOut[MQTTPUBACK >> 4],4);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_metrics_count_oversize() {
+    IT("counts inbound packets dropped for being too big");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    int length = MQTT_MAX_PACKET_SIZE+1;
+    byte bigPublish[length];
+    memset(bigPublish,'A',length);
+    memcpy(bigPublish,publish,16);
+    bigPublish[1] = length-2;
+    shimClient.respond(bigPublish,length);
+    shimClient.respond(publish,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.oversizeDropped,1);
+    IS_EQUAL(metrics.packetsIn[MQTTPUBLISH >> 4],1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_metrics_ping_rtt() {
+    IT("keeps the minimum, maximum and total ping round trip");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setClock(virtualClock);
+    client.setKeepAlive(1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte pingreq[] = { 0xC0,0x0 };
+    byte pingresp[] = { 0xD0,0x0 };
+    // Answered after one second, then after three
+    for (int wait = 1; wait <= 3; wait += 2) {
+        shimClient.expect(pingreq,2);
+        advance(2);
+        rc = client.loop();
+        IS_TRUE(rc);
+        advance(wait);
+        shimClient.respond(pingresp,2);
+        rc = client.loop();
+        IS_TRUE(rc);
+    }
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.pings,2);
+    IS_EQUAL(metrics.pingRttMin,1000);
+    IS_EQUAL(metrics.pingRttMax,3000);
+    IS_EQUAL(metrics.pingRttTotal/metrics.pings,2000);
+    IS_EQUAL(metrics.packetsOut[MQTTPINGREQ >> 4],2);
+    IS_EQUAL(metrics.packetsIn[MQTTPINGRESP >> 4],2);
+
+    client.resetMetrics();
+    IS_EQUAL(metrics.pings,0);
+    IS_EQUAL(metrics.packetsOut[MQTTPINGREQ >> 4],0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_metrics_inflight_in_rejected() {
+    IT("counts inbound qos 2 messages refused for want of a slot");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x34,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte pubrec[] = {0x50,0x2,0x0,0x0};
+    for (int i = 1; i <= MQTT_MAX_INFLIGHT_IN+1; i++) {
+        publish[10] = i;
+        shimClient.respond(publish,18);
+        if (i <= MQTT_MAX_INFLIGHT_IN) {
+            pubrec[3] = i;
+            shimClient.expect(pubrec,4);
+        }
+    }
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.inflightInRejected,1);
+    IS_EQUAL(metrics.packetsOut[MQTTPUBREC >> 4],MQTT_MAX_INFLIGHT_IN);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_metrics_inflight_out_lost() {
+    IT("counts qos 2 messages given up when a session is resumed");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+    IS_TRUE(rc);
+
+    // The connection drops before PUBREC arrives
+    shimClient.setConnected(false);
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const MQTTMetrics& metrics = client.metrics();
+    IS_EQUAL(metrics.inflightOutLost,1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Metrics");
+    test_metrics_start_empty();
+    test_metrics_count_connect();
+    test_metrics_count_publish();
+    test_metrics_count_oversize();
+    test_metrics_ping_rtt();
+    test_metrics_inflight_in_rejected();
+    test_metrics_inflight_out_lost();
+
+    FINISH
+}
@@ -0,0 +1,553 @@
+#include "PubSubClient.h"
+#include "MQTTProperties.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// Built with -DMQTT_VERSION=5
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+char lastTopic[1024];
+char lastPayload[1024];
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+uint32_t chunkReceived;
+
+void chunkCallback(char* topic, uint32_t total, uint32_t offset, byte* chunk, unsigned int length) {
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload+offset,chunk,length);
+    chunkReceived += length;
+}
+
+byte connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+
+int test_mqtt5_connect() {
+    IT("sends an MQTT 5 connect packet with properties");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x1f,0x0,0x4,0x4d,0x51,0x54,0x54,0x5,0x2,0x0,0xf,
+                      0x6,0x21,0x0,MQTT_MAX_INFLIGHT_IN,0x22,0x0,MQTT5_TOPIC_ALIAS_IN,
+                      0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,33);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_EQUAL(client.reasonCode(),0);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_connect_refused() {
+    IT("reports the CONNACK reason code when refused");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte refused[] = { 0x20, 0x03, 0x00, 0x87, 0x00 };
+    shimClient.respond(refused,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_EQUAL(client.state(),0x87);
+    IS_EQUAL(client.reasonCode(),0x87);
+
+    END_IT
+}
+
+int test_mqtt5_publish_topic_alias() {
+    IT("publishes with a topic alias once the server allows it");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte aliases[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, 0x0a };
+    shimClient.respond(aliases,8);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte first[] = {0x30,0x12,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x3,0x23,0x0,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(first,20);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    // Later messages leave the topic out
+    byte next[] = {0x30,0xd,0x0,0x0,0x3,0x23,0x0,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(next,15);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    byte other[] = {0x30,0x12,0x0,0x5,0x6f,0x74,0x68,0x65,0x72,0x3,0x23,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(other,20);
+    rc = client.publish((char*)"other",(char*)"payload");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_publish_no_alias() {
+    IT("publishes with an empty property list when aliases are not allowed");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xf,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,17);
+    shimClient.expect(publish,17);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_publish_unbuffered() {
+    IT("sends an empty property list from publish_P and beginPublish");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xf,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,17);
+    rc = client.publish_P((char*)"topic",(const uint8_t*)"payload",7,false);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    shimClient.expect(publish,17);
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    IS_EQUAL(client.write((const uint8_t*)"payload",7),7);
+    rc = client.endPublish();
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_receive_maximum() {
+    IT("keeps to the server's receive maximum");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte receiveMax[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x21, 0x00, 0x01 };
+    shimClient.respond(receiveMax,8);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0xb,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x0,0x61};
+    shimClient.expect(publish,13);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_FALSE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte puback[] = {0x40,0x3,0x0,0x2,0x10};
+    shimClient.respond(puback,5);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(client.reasonCode(),0x10);
+
+    byte publish2[] = {0x32,0xb,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x3,0x0,0x61};
+    shimClient.expect(publish2,13);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_pubrec_refused() {
+    IT("ends a qos 2 exchange when PUBREC carries an error");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    for (int i = 0; i < MQTT_MAX_INFLIGHT_OUT; i++) {
+        rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+        IS_TRUE(rc);
+    }
+    byte pubrec[] = {0x50,0x3,0x0,0x2,0x97};
+    shimClient.respond(pubrec,5);
+    // No PUBREL is sent
+    byte nothing[] = {0};
+    shimClient.expect(nothing,0);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(client.reasonCode(),0x97);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+    IS_TRUE(rc);
+
+    END_IT
+}
+
+int test_mqtt5_inflight_in_full() {
+    IT("refuses a qos 2 message with no free in-flight slot");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x34,0xb,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x0,0x0,0x61};
+    byte pubrec[] = {0x50,0x2,0x0,0x0};
+    for (int i = 1; i <= MQTT_MAX_INFLIGHT_IN; i++) {
+        publish[10] = i;
+        pubrec[3] = i;
+        shimClient.respond(publish,13);
+        shimClient.expect(pubrec,4);
+    }
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    reset_callback();
+    publish[10] = MQTT_MAX_INFLIGHT_IN+1;
+    shimClient.respond(publish,13);
+    byte refused[] = {0x50,0x3,0x0,MQTT_MAX_INFLIGHT_IN+1,0x97};
+    shimClient.expect(refused,5);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_receive_topic_alias() {
+    IT("receives messages that use a topic alias");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte first[] = {0x30,0x12,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x3,0x23,0x0,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(first,20);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_EQUAL(lastLength,7);
+
+    reset_callback();
+    byte next[] = {0x30,0x9,0x0,0x0,0x3,0x23,0x0,0x1,0x6e,0x65,0x77};
+    shimClient.respond(next,11);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_EQUAL(lastLength,3);
+    IS_TRUE(memcmp(lastPayload,"new",3)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_receive_unknown_alias() {
+    IT("disconnects on an alias the server never set up");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x9,0x0,0x0,0x3,0x23,0x0,0x2,0x6e,0x65,0x77};
+    shimClient.respond(publish,11);
+    client.loop();
+    IS_FALSE(callback_called);
+    IS_FALSE(client.connected());
+
+    END_IT
+}
+
+int test_mqtt5_receive_properties() {
+    IT("skips the properties of a received message");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Content type "json" and a user property a=b on a qos 1 message
+    byte publish[] = {0x32,0x1c,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,
+                      0xe,0x3,0x0,0x4,0x6a,0x73,0x6f,0x6e,0x26,0x0,0x1,0x61,0x0,0x1,0x62,
+                      0x7b,0x7d,0x20,0x20};
+    shimClient.respond(publish,30);
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_EQUAL(lastLength,4);
+    IS_TRUE(memcmp(lastPayload,"{}  ",4)==0);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_receive_chunked() {
+    IT("receives an oversized message with properties in chunks");
+    reset_callback();
+    chunkReceived = 0;
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setChunkCallback(chunkCallback);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[313] = {0x30,0xb6,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x2,0x1,0x1};
+    for (int i = 13; i < 313; i++) {
+        publish[i] = i & 0xFF;
+    }
+    shimClient.respond(publish,313);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_EQUAL(chunkReceived,300);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,publish+13,300)==0);
+
+    END_IT
+}
+
+int test_mqtt5_suback() {
+    IT("reads SUBACK and UNSUBACK reason codes after their properties");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTSubscription subscriptions[] = { {"topic",1,0}, {"denied",0,0} };
+    byte subscribe[] = {0x82,0x14,0x0,0x2,0x0,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1,0x0,0x6,0x64,0x65,0x6e,0x69,0x65,0x64,0x0};
+    shimClient.expect(subscribe,22);
+    rc = client.subscribe(subscriptions,2);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte suback[] = {0x90,0xc,0x0,0x2,0x7,0x1f,0x0,0x4,0x6f,0x6b,0x61,0x79,0x1,0x87};
+    shimClient.respond(suback,14);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(subscriptions[0].result,1);
+    IS_EQUAL(subscriptions[1].result,0x87);
+
+    MQTTSubscription unsubscriptions[] = { {"topic",0,0} };
+    byte unsubscribe[] = {0xa2,0xa,0x0,0x3,0x0,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.expect(unsubscribe,12);
+    rc = client.unsubscribe(unsubscriptions,1);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte unsuback[] = {0xb0,0x4,0x0,0x3,0x0,0x11};
+    shimClient.respond(unsuback,6);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(unsubscriptions[0].result,0x11);
+
+    END_IT
+}
+
+int test_mqtt5_subscribe_single() {
+    IT("sends an empty property list from single topic subscribe and unsubscribe");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte subscribe[] = {0x82,0xb,0x0,0x2,0x0,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1};
+    shimClient.expect(subscribe,13);
+    rc = client.subscribe((char*)"topic",1);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte unsubscribe[] = {0xa2,0xa,0x0,0x3,0x0,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.expect(unsubscribe,12);
+    rc = client.unsubscribe((char*)"topic");
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_server_disconnect() {
+    IT("reports the reason code of a DISCONNECT from the server");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte disconnect[] = {0xe0,0x1,0x8e};
+    shimClient.respond(disconnect,3);
+    client.loop();
+    IS_FALSE(client.connected());
+    IS_EQUAL(client.state(),MQTT_CONNECTION_LOST);
+    IS_EQUAL(client.reasonCode(),0x8e);
+
+    END_IT
+}
+
+int test_mqtt5_queue() {
+    IT("queues packets with an empty property list");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    uint8_t storage[64];
+    MQTTOutboundQueue queue(storage,64);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setOutboundQueue(queue);
+
+    int rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    shimClient.respond(connack,5);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xf,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,17);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(queue.empty());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_properties() {
+    IT("reads and writes properties");
+    uint8_t buf[32];
+    uint16_t pos = 0;
+    pos = MQTTProperties::writeByte(buf,pos,0x01,1);
+    pos = MQTTProperties::writeUint16(buf,pos,MQTT_PROP_TOPIC_ALIAS,0x1234);
+    pos = MQTTProperties::writeUint32(buf,pos,MQTT_PROP_SESSION_EXPIRY,0x01020304);
+    byte expected[] = {0x01,0x1,0x23,0x12,0x34,0x11,0x1,0x2,0x3,0x4};
+    IS_EQUAL(pos,10);
+    IS_TRUE(memcmp(buf,expected,10)==0);
+    // Subscription identifier 200, then a reason string
+    byte more[] = {0x0b,0xc8,0x1,0x1f,0x0,0x2,0x68,0x69};
+    memcpy(buf+pos,more,8);
+
+    MQTTProperties properties(buf,18);
+    IS_TRUE(properties.next());
+    IS_EQUAL(properties.id(),0x01);
+    IS_EQUAL(properties.value(),1);
+    IS_TRUE(properties.next());
+    IS_EQUAL(properties.value(),0x1234);
+    IS_TRUE(properties.next());
+    IS_EQUAL(properties.value(),0x01020304);
+    IS_TRUE(properties.next());
+    IS_EQUAL(properties.id(),0x0b);
+    IS_EQUAL(properties.value(),200);
+    IS_TRUE(properties.next());
+    IS_EQUAL(properties.id(),MQTT_PROP_REASON_STRING);
+    IS_EQUAL(properties.dataLength(),2);
+    IS_TRUE(memcmp(properties.data(),"hi",2)==0);
+    IS_FALSE(properties.next());
+    IS_FALSE(properties.malformed());
+
+    // A truncated string and an unknown identifier
+    MQTTProperties truncated(more+3,4);
+    IS_FALSE(truncated.next());
+    IS_TRUE(truncated.malformed());
+    byte unknown[] = {0x7f,0x0};
+    MQTTProperties bad(unknown,2);
+    IS_FALSE(bad.next());
+    IS_TRUE(bad.malformed());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("MQTT 5");
+    test_mqtt5_connect();
+    test_mqtt5_connect_refused();
+    test_mqtt5_publish_topic_alias();
+    test_mqtt5_publish_no_alias();
+    test_mqtt5_publish_unbuffered();
+    test_mqtt5_receive_maximum();
+    test_mqtt5_pubrec_refused();
+    test_mqtt5_inflight_in_full();
+    test_mqtt5_receive_topic_alias();
+    test_mqtt5_receive_unknown_alias();
+    test_mqtt5_receive_properties();
+    test_mqtt5_receive_chunked();
+    test_mqtt5_suback();
+    test_mqtt5_subscribe_single();
+    test_mqtt5_server_disconnect();
+    test_mqtt5_queue();
+    test_mqtt5_properties();
+
+    FINISH
+}
@@ -0,0 +1,382 @@
+#include "MQTTSNClient.h"
+#include "ShimUdp.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+char lastTopic[1024];
+char lastPayload[1024];
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+// Virtual time, moved on by the tests and by a millisecond at each read, so
+// that waits for an acknowledgement run out without sleeping
+unsigned long now = 0;
+
+unsigned long virtualClock() {
+    return now++;
+}
+
+void advance(unsigned int seconds) {
+    now += seconds*1000UL;
+}
+
+byte connectPacket[] = { 0x12,0x04,0x04,0x01,0x00,0x0f,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31 };
+byte connack[] = { 0x03,0x05,0x00 };
+
+int test_mqttsn_connect() {
+    IT("connects to a gateway");
+    ShimUdp shimUdp;
+    shimUdp.expectPort(1883);
+    shimUdp.expect(connectPacket,18);
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.connected());
+    IS_EQUAL(client.state(),MQTT_CONNECTED);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_connect_refused() {
+    IT("reports a refused connection");
+    ShimUdp shimUdp;
+    byte refused[] = { 0x03,0x05,0x03 };
+    shimUdp.respond(refused,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_FALSE(client.connected());
+    IS_EQUAL(client.state(),MQTT_CONNECT_BAD_PROTOCOL);
+
+    END_IT
+}
+
+int test_mqttsn_connect_timeout() {
+    IT("gives up connecting after the retries");
+    ShimUdp shimUdp;
+    shimUdp.expect(connectPacket,18);
+    shimUdp.expect(connectPacket,18);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    client.setClock(virtualClock);
+    client.setRetry(1000,1);
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_EQUAL(client.state(),MQTT_CONNECTION_TIMEOUT);
+    IS_EQUAL(shimUdp.sent(),2);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_publish_qos_minus_one() {
+    IT("publishes at QoS -1 to a predefined topic without connecting");
+    ShimUdp shimUdp;
+    byte publish[] = { 0x08,0x0c,0x61,0x00,0x05,0x00,0x00,0x31 };
+    shimUdp.expect(publish,8);
+    shimUdp.expect(publish,8);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    IS_TRUE(client.setPredefinedTopic(5,"car/speed"));
+    int rc = client.publish("car/speed",(const uint8_t*)"1",1,-1,false);
+    IS_TRUE(rc);
+    rc = client.publish((uint16_t)5,(const uint8_t*)"1",1,-1,false);
+    IS_TRUE(rc);
+    IS_FALSE(client.connected());
+
+    rc = client.publish("car/unknown",(const uint8_t*)"1",1,-1,false);
+    IS_FALSE(rc);
+    rc = client.publish("car/speed","1");
+    IS_FALSE(rc);
+
+    IS_EQUAL(shimUdp.sent(),2);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_publish_registers() {
+    IT("registers a topic once before publishing to it");
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte registerPacket[] = { 0x0b,0x0a,0x00,0x00,0x00,0x01,0x74,0x6f,0x70,0x69,0x63 };
+    byte regack[] = { 0x07,0x0b,0x00,0x21,0x00,0x01,0x00 };
+    byte publish[] = { 0x08,0x0c,0x00,0x00,0x21,0x00,0x00,0x61 };
+    byte publishRetained[] = { 0x08,0x0c,0x10,0x00,0x21,0x00,0x00,0x62 };
+    shimUdp.expect(registerPacket,11);
+    shimUdp.respond(regack,7);
+    shimUdp.expect(publish,8);
+    shimUdp.expect(publishRetained,8);
+
+    rc = client.publish("topic","a");
+    IS_TRUE(rc);
+    rc = client.publish("topic","b",true);
+    IS_TRUE(rc);
+
+    IS_EQUAL(shimUdp.sent(),4);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_publish_qos1() {
+    IT("waits for the PUBACK of a QoS 1 message to a short topic");
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = { 0x08,0x0c,0x22,0x61,0x62,0x00,0x01,0x78 };
+    byte puback[] = { 0x07,0x0d,0x61,0x62,0x00,0x01,0x00 };
+    shimUdp.expect(publish,8);
+    shimUdp.respond(puback,7);
+
+    rc = client.publish("ab",(const uint8_t*)"x",1,1,false);
+    IS_TRUE(rc);
+    IS_TRUE(client.connected());
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_publish_qos1_retry() {
+    IT("sends a QoS 1 message again with the DUP flag");
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    client.setClock(virtualClock);
+    client.setRetry(1000,1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = { 0x08,0x0c,0x22,0x61,0x62,0x00,0x01,0x78 };
+    byte publishDup[] = { 0x08,0x0c,0xa2,0x61,0x62,0x00,0x01,0x78 };
+    shimUdp.expect(publish,8);
+    shimUdp.expect(publishDup,8);
+
+    rc = client.publish("ab",(const uint8_t*)"x",1,1,false);
+    IS_FALSE(rc);
+    IS_FALSE(client.connected());
+    IS_EQUAL(client.state(),MQTT_CONNECTION_TIMEOUT);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_subscribe() {
+    IT("subscribes and receives messages on the granted topic id");
+    reset_callback();
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte subscribe[] = { 0x0a,0x12,0x20,0x00,0x01,0x74,0x6f,0x70,0x69,0x63 };
+    byte suback[] = { 0x08,0x13,0x20,0x00,0x07,0x00,0x01,0x00 };
+    byte publish[] = { 0x0c,0x0c,0x20,0x00,0x07,0x00,0x09,0x70,0x61,0x79,0x6c,0x64 };
+    byte puback[] = { 0x07,0x0d,0x00,0x07,0x00,0x09,0x00 };
+    shimUdp.expect(subscribe,10);
+    shimUdp.respond(suback,8);
+    shimUdp.respond(publish,12);
+    shimUdp.expect(puback,7);
+
+    rc = client.subscribe("topic",1);
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payld",5)==0);
+    IS_EQUAL(lastLength,5);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_receive_registered() {
+    IT("accepts topics registered by the gateway");
+    reset_callback();
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte registerPacket[] = { 0x0d,0x0a,0x00,0x03,0x00,0x02,0x63,0x61,0x72,0x2f,0x72,0x70,0x6d };
+    byte regack[] = { 0x07,0x0b,0x00,0x03,0x00,0x02,0x00 };
+    byte publish[] = { 0x08,0x0c,0x00,0x00,0x03,0x00,0x00,0x39 };
+    shimUdp.respond(registerPacket,13);
+    shimUdp.respond(publish,8);
+    shimUdp.expect(regack,7);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"car/rpm")==0);
+    IS_EQUAL(lastLength,1);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_receive_unknown_topic() {
+    IT("rejects messages for unknown topic ids");
+    reset_callback();
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = { 0x08,0x0c,0x20,0x00,0x04,0x00,0x05,0x39 };
+    byte puback[] = { 0x07,0x0d,0x00,0x04,0x00,0x05,0x02 };
+    shimUdp.respond(publish,8);
+    shimUdp.expect(puback,7);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_receive_predefined() {
+    IT("receives messages on predefined and short topics");
+    reset_callback();
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    client.setPredefinedTopic(9,"car/cmd");
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte predefined[] = { 0x08,0x0c,0x01,0x00,0x09,0x00,0x00,0x31 };
+    shimUdp.respond(predefined,8);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(strcmp(lastTopic,"car/cmd")==0);
+
+    byte shortTopic[] = { 0x08,0x0c,0x02,0x67,0x6f,0x00,0x00,0x32 };
+    shimUdp.respond(shortTopic,8);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(strcmp(lastTopic,"go")==0);
+    IS_TRUE(memcmp(lastPayload,"2",1)==0);
+
+    END_IT
+}
+
+int test_mqttsn_keepalive() {
+    IT("pings the gateway when idle");
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    client.setClock(virtualClock);
+    client.setKeepAlive(1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte pingreq[] = { 0x02,0x16 };
+    byte pingresp[] = { 0x02,0x17 };
+    shimUdp.expect(pingreq,2);
+
+    advance(2);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(shimUdp.sent(),2);
+
+    shimUdp.respond(pingresp,2);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(shimUdp.sent(),2);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int test_mqttsn_disconnect() {
+    IT("disconnects from the gateway, or is disconnected by it");
+    ShimUdp shimUdp;
+    shimUdp.respond(connack,3);
+
+    MQTTSNClient client(server, 1883, callback, shimUdp);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte disconnect[] = { 0x02,0x18 };
+    shimUdp.expect(disconnect,2);
+    client.disconnect();
+    IS_FALSE(client.connected());
+    IS_EQUAL(client.state(),MQTT_DISCONNECTED);
+
+    shimUdp.expect(connectPacket,18);
+    shimUdp.respond(connack,3);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    shimUdp.respond(disconnect,2);
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_EQUAL(client.state(),MQTT_CONNECTION_LOST);
+    IS_FALSE(shimUdp.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("MQTT-SN");
+    test_mqttsn_connect();
+    test_mqttsn_connect_refused();
+    test_mqttsn_connect_timeout();
+    test_mqttsn_publish_qos_minus_one();
+    test_mqttsn_publish_registers();
+    test_mqttsn_publish_qos1();
+    test_mqttsn_publish_qos1_retry();
+    test_mqttsn_subscribe();
+    test_mqttsn_receive_registered();
+    test_mqttsn_receive_unknown_topic();
+    test_mqttsn_receive_predefined();
+    test_mqttsn_keepalive();
+    test_mqttsn_disconnect();
+
+    FINISH
+}
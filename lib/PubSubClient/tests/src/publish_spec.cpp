@@ -172,8 +172,284 @@ int test_publish_P() {
     END_IT
 }
 
+int test_publish_P_large() {
+    IT("publishes a large PROGMEM payload in buffer-sized writes");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte payload[300];
+    for (int i = 0; i < 300; i++) {
+        payload[i] = i & 0xFF;
+    }
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint16_t writes = shimClient.writes();
+
+    byte header[] = {0x30,0xb3,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.expect(header,10);
+    shimClient.expect(payload,300);
+
+    rc = client.publish_P((char*)"topic",payload,300,false);
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes()-writes,3);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_streamed() {
+    IT("streams a payload over 64 KiB");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // 70000 bytes of payload + 7 bytes of topic need a three byte length
+    byte header[] = {0x31,0xf7,0xa2,0x4,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.expect(header,11);
+    byte chunk[] = {0x1,0x2,0x3,0x4};
+    shimClient.expect(chunk,4);
+    shimClient.expect(chunk,1);
+
+    rc = client.beginPublish((char*)"topic",70000,true);
+    IS_TRUE(rc);
+    IS_EQUAL(client.write(chunk,4),4);
+    IS_EQUAL(client.write(chunk[0]),1);
+    IS_TRUE(client.endPublish());
+
+    IS_FALSE(client.beginPublish((char*)"topic",MQTT_VARINT_MAX,false));
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1() {
+    IT("publishes qos 1");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,1,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos2() {
+    IT("publishes qos 2 exactly once");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x35,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
 
+    rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,2,true);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte pubrec[] = {0x50,0x2,0x0,0x2};
+    shimClient.respond(pubrec,4);
+    byte pubrel[] = {0x62,0x2,0x0,0x2};
+    shimClient.expect(pubrel,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte pubcomp[] = {0x70,0x2,0x0,0x2};
+    shimClient.respond(pubcomp,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos2_inflight_full() {
+    IT("publish qos 2 fails when all in-flight slots are used");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
 
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    for (int i = 0; i < MQTT_MAX_INFLIGHT_OUT; i++) {
+        rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,2,false);
+        IS_TRUE(rc);
+    }
+    rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,2,false);
+    IS_FALSE(rc);
+
+    // Completing the first message frees its slot
+    byte pubrec[] = {0x50,0x2,0x0,0x2};
+    byte pubcomp[] = {0x70,0x2,0x0,0x2};
+    shimClient.respond(pubrec,4);
+    client.loop();
+    shimClient.respond(pubcomp,4);
+    client.loop();
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,2,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_invalid_qos() {
+    IT("publish fails with invalid qos values");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"payload",7,3,false);
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+
+int test_publish_batched() {
+    IT("gathers publishes into one write at the end of loop");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t writeBuffer[64];
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    size_t writes = shimClient.writes();
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (int i = 0; i < 3; i++) {
+        shimClient.expect(publish,16);
+        rc = client.publish((char*)"topic",(char*)"payload");
+        IS_TRUE(rc);
+    }
+    IS_EQUAL(shimClient.writes()-writes,0);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes()-writes,1);
+    IS_EQUAL(shimClient.received(),26+48);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_batched_full() {
+    IT("writes out the gathered packets when the write buffer is full");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t writeBuffer[40];
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    size_t writes = shimClient.writes();
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (int i = 0; i < 3; i++) {
+        shimClient.expect(publish,16);
+        rc = client.publish((char*)"topic",(char*)"payload");
+        IS_TRUE(rc);
+    }
+    // Two fit in the buffer; the third needs it emptied
+    IS_EQUAL(shimClient.writes()-writes,1);
+
+    rc = client.flush();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes()-writes,2);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_batched_flush() {
+    IT("writes a message straight away when flushed");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t writeBuffer[64];
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    size_t writes = shimClient.writes();
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.flush();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes()-writes,1);
+
+    // Nothing left for loop() to write
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(shimClient.writes()-writes,1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
 
 int main()
 {
@@ -185,6 +461,15 @@ int main()
     test_publish_not_connected();
     test_publish_too_long();
     test_publish_P();
+    test_publish_P_large();
+    test_publish_streamed();
+    test_publish_qos1();
+    test_publish_qos2();
+    test_publish_qos2_inflight_full();
+    test_publish_invalid_qos();
+    test_publish_batched();
+    test_publish_batched_full();
+    test_publish_batched_flush();
 
     FINISH
 }
@@ -0,0 +1,167 @@
+#include "PubSubClient.h"
+#include "MQTTOutboundQueue.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int test_queue_push_peek() {
+    IT("stores encoded packets back to back");
+    uint8_t storage[64];
+    MQTTOutboundQueue queue(storage,64);
+
+    IS_TRUE(queue.empty());
+    IS_TRUE(queue.push(MQTTPUBLISH,"topic",(const uint8_t*)"payload",7,false));
+    IS_TRUE(queue.push(MQTTPUBLISH|1,"topic",(const uint8_t*)"ab",2,false));
+    IS_EQUAL(queue.depth(),2);
+    IS_EQUAL(queue.size(),16+11);
+
+    const uint8_t* data;
+    IS_EQUAL(queue.peek(&data),27);
+    byte expected[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64,
+                       0x31,0x9,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x61,0x62};
+    IS_TRUE(memcmp(data,expected,27)==0);
+
+    queue.pop(27);
+    IS_TRUE(queue.empty());
+    IS_EQUAL(queue.peek(&data),0);
+
+    END_IT
+}
+
+int test_queue_rejects_qos() {
+    IT("only queues qos 0 packets");
+    uint8_t storage[64];
+    MQTTOutboundQueue queue(storage,64);
+
+    IS_FALSE(queue.push(MQTTPUBLISH|MQTTQOS1,"topic",(const uint8_t*)"payload",7,false));
+    IS_TRUE(queue.empty());
+
+    END_IT
+}
+
+int test_queue_drops_oldest() {
+    IT("drops the oldest packets when full");
+    uint8_t storage[40];
+    MQTTOutboundQueue queue(storage,40);
+
+    // Each packet is 16 bytes
+    IS_TRUE(queue.push(MQTTPUBLISH,"topic",(const uint8_t*)"payload",7,false));
+    IS_TRUE(queue.push(MQTTPUBLISH,"topic",(const uint8_t*)"PAYLOAD",7,false));
+    IS_TRUE(queue.push(MQTTPUBLISH,"topic",(const uint8_t*)"pAyLoAd",7,false));
+    IS_EQUAL(queue.depth(),2);
+    IS_EQUAL(queue.dropped(),1);
+
+    // The third packet wrapped to the start of the storage
+    const uint8_t* data;
+    IS_EQUAL(queue.peek(&data),16);
+    IS_TRUE(memcmp(data+9,"PAYLOAD",7)==0);
+    queue.pop(16);
+    IS_EQUAL(queue.peek(&data),16);
+    IS_TRUE(data == storage);
+    IS_TRUE(memcmp(data+9,"pAyLoAd",7)==0);
+
+    // Larger than the whole storage
+    uint8_t big[64];
+    IS_FALSE(queue.push(MQTTPUBLISH,"topic",big,64,false));
+    IS_EQUAL(queue.dropped(),2);
+
+    END_IT
+}
+
+int test_queue_coalesces() {
+    IT("coalesces latest-only packets on the same topic");
+    uint8_t storage[128];
+    MQTTOutboundQueue queue(storage,128);
+
+    IS_TRUE(queue.push(MQTTPUBLISH,"speed",(const uint8_t*)"10",2,true));
+    IS_TRUE(queue.push(MQTTPUBLISH,"steer",(const uint8_t*)"-5",2,true));
+    IS_TRUE(queue.push(MQTTPUBLISH,"speed",(const uint8_t*)"20",2,true));
+    IS_EQUAL(queue.depth(),2);
+    IS_EQUAL(queue.coalesced(),1);
+
+    // Same size: replaced in place, keeping its position
+    const uint8_t* data;
+    IS_EQUAL(queue.peek(&data),22);
+    IS_TRUE(memcmp(data+9,"20",2)==0);
+    IS_TRUE(memcmp(data+20,"-5",2)==0);
+
+    // Different size: the old copy is dropped and the new one appended
+    IS_TRUE(queue.push(MQTTPUBLISH,"speed",(const uint8_t*)"100",3,true));
+    IS_EQUAL(queue.depth(),2);
+    IS_EQUAL(queue.coalesced(),2);
+    IS_EQUAL(queue.peek(&data),11+12);
+    IS_TRUE(memcmp(data+9,"-5",2)==0);
+    IS_TRUE(memcmp(data+11+9,"100",3)==0);
+
+    // Packets that are not latest-only are never coalesced
+    IS_TRUE(queue.push(MQTTPUBLISH,"speed",(const uint8_t*)"200",3,false));
+    IS_EQUAL(queue.depth(),3);
+    IS_EQUAL(queue.coalesced(),2);
+
+    END_IT
+}
+
+int test_queue_publish_offline() {
+    IT("queues publishes while disconnected and drains them on connect");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    uint8_t storage[128];
+    MQTTOutboundQueue queue(storage,128);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setOutboundQueue(queue);
+
+    int rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.publishLatest((char*)"speed",(const uint8_t*)"10",2,false);
+    IS_TRUE(rc);
+    rc = client.publishLatest((char*)"speed",(const uint8_t*)"20",2,false);
+    IS_TRUE(rc);
+    IS_EQUAL(queue.depth(),2);
+    IS_EQUAL(shimClient.writes(),0);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    byte queued[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64,
+                     0x30,0x9,0x0,0x5,0x73,0x70,0x65,0x65,0x64,0x32,0x30};
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.expect(connect,26);
+    shimClient.expect(queued,27);
+    shimClient.respond(connack,4);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(queue.empty());
+    // One write for CONNECT and one for all the queued packets
+    IS_EQUAL(shimClient.writes(),2);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    IS_TRUE(queue.empty());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Queue");
+    test_queue_push_peek();
+    test_queue_rejects_qos();
+    test_queue_drops_oldest();
+    test_queue_coalesces();
+    test_queue_publish_offline();
+
+    FINISH
+}
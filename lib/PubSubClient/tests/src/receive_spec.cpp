@@ -8,12 +8,14 @@
 byte server[] = { 172, 16, 0, 2 };
 
 bool callback_called = false;
+int callback_count = 0;
 char lastTopic[1024];
 char lastPayload[1024];
 unsigned int lastLength;
 
 void reset_callback() {
     callback_called = false;
+    callback_count = 0;
     lastTopic[0] = '\0';
     lastPayload[0] = '\0';
     lastLength = 0;
@@ -21,11 +23,34 @@ void reset_callback() {
 
 void callback(char* topic, byte* payload, unsigned int length) {
     callback_called = true;
+    callback_count++;
     strcpy(lastTopic,topic);
     memcpy(lastPayload,payload,length);
     lastLength = length;
 }
 
+int chunk_count = 0;
+uint32_t chunkTotal;
+uint32_t chunkReceived;
+char chunkPayload[1024];
+
+void reset_chunks() {
+    chunk_count = 0;
+    chunkTotal = 0;
+    chunkReceived = 0;
+}
+
+void chunkCallback(char* topic, uint32_t total, uint32_t offset, byte* chunk, unsigned int length) {
+    // Chunks must arrive in order and without gaps
+    if (offset == chunkReceived) {
+        chunk_count++;
+        strcpy(lastTopic,topic);
+        chunkTotal = total;
+        memcpy(chunkPayload+offset,chunk,length);
+        chunkReceived += length;
+    }
+}
+
 int test_receive_callback() {
     IT("receives a callback message");
     reset_callback();
@@ -57,6 +82,88 @@ int test_receive_callback() {
     END_IT
 }
 
+void handler(char* topic, byte* payload, unsigned int length, void* context) {
+    *(int*)context += 1;
+    callback(topic,payload,length);
+}
+
+int test_receive_handler() {
+    IT("receives a message through a handler with context");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    int calls = 0;
+    PubSubClient client(server, 1883, shimClient);
+    client.setCallback(handler,&calls);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(calls,1);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == 7);
+
+    // Setting a plain callback replaces the handler
+    client.setCallback(callback);
+    shimClient.respond(publish,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(calls,1);
+    IS_EQUAL(callback_count,2);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_partial_with_decoder() {
+    IT("does not wait for the rest of a packet when given a decoder");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t decoderBuffer[MQTT_MAX_PACKET_SIZE];
+    MQTTPacketDecoder decoder(decoderBuffer,sizeof(decoderBuffer));
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setDecoder(decoder);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte pingresp[] = {0xD0,0x0};
+    shimClient.respond(publish,5);
+    rc = client.loop(0,0);
+    IS_EQUAL(rc,0);
+    IS_FALSE(callback_called);
+
+    shimClient.respond(publish+5,11);
+    shimClient.respond(pingresp,2);
+    shimClient.respond(publish,16);
+    rc = client.loop(0,0);
+    IS_EQUAL(rc,3);
+    IS_EQUAL(callback_count,2);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_TRUE(lastLength == 7);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int test_receive_stream() {
     IT("receives a streamed callback message");
     reset_callback();
@@ -107,7 +214,7 @@ int test_receive_max_sized_message() {
 
     int length = MQTT_MAX_PACKET_SIZE;
     byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
-    byte bigPublish[length];
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
@@ -143,7 +250,7 @@ int test_receive_oversized_message() {
 
     int length = MQTT_MAX_PACKET_SIZE+1;
     byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
-    byte bigPublish[length];
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
@@ -160,6 +267,183 @@ int test_receive_oversized_message() {
     END_IT
 }
 
+int test_receive_chunked_message() {
+    IT("receives an oversized message in chunks");
+    reset_callback();
+    reset_chunks();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setChunkCallback(chunkCallback);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[310] = {0x30,0xb3,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    for (int i = 10; i < 310; i++) {
+        publish[i] = i & 0xFF;
+    }
+    shimClient.respond(publish,310);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_FALSE(callback_called);
+    IS_TRUE(chunk_count > 1);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_EQUAL(chunkTotal,300);
+    IS_EQUAL(chunkReceived,300);
+    IS_TRUE(memcmp(chunkPayload,publish+10,300)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_chunked_qos1() {
+    IT("acknowledges an oversized qos 1 message after its last chunk");
+    reset_callback();
+    reset_chunks();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setChunkCallback(chunkCallback);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[312] = {0x32,0xb5,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34};
+    for (int i = 12; i < 312; i++) {
+        publish[i] = i & 0xFF;
+    }
+    shimClient.respond(publish,312);
+
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_FALSE(callback_called);
+    IS_EQUAL(chunkTotal,300);
+    IS_EQUAL(chunkReceived,300);
+    IS_TRUE(memcmp(chunkPayload,publish+12,300)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_chunked_then_callback() {
+    IT("receives a normal message after a chunked one");
+    reset_callback();
+    reset_chunks();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setChunkCallback(chunkCallback);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte big[310] = {0x30,0xb3,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    memset(big+10,'A',300);
+    shimClient.respond(big,310);
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_EQUAL(chunkReceived,300);
+    IS_TRUE(callback_called);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_EQUAL(lastLength,7);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_malformed_length() {
+    IT("disconnects on a malformed remaining length");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xff,0xff,0xff,0xff,0x7f};
+    shimClient.respond(publish,6);
+
+    client.loop();
+
+    IS_FALSE(callback_called);
+    IS_FALSE(client.connected());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_topic_overrun() {
+    IT("disconnects on a topic length past the end of the packet");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x5,0x0,0x40,0x74,0x6f,0x70};
+    shimClient.respond(publish,7);
+
+    client.loop();
+
+    IS_FALSE(callback_called);
+    IS_FALSE(client.connected());
+
+    // At qos 1 the message id must fit too
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publishQos1[] = {0x32,0x6,0x0,0x3,0x74,0x6f,0x70,0x12};
+    shimClient.respond(publishQos1,8);
+
+    client.loop();
+
+    IS_FALSE(callback_called);
+    IS_FALSE(client.connected());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int test_receive_oversized_stream_message() {
     IT("drops an oversized message");
     reset_callback();
@@ -179,7 +463,7 @@ int test_receive_oversized_stream_message() {
     int length = MQTT_MAX_PACKET_SIZE+1;
     byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
 
-    byte bigPublish[length];
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
@@ -235,15 +519,195 @@ int test_receive_qos1() {
     END_IT
 }
 
+int test_receive_qos2() {
+    IT("receives a qos2 message exactly once");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x34,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+
+    byte pubrec[] = {0x50,0x2,0x12,0x34};
+    shimClient.expect(pubrec,4);
+
+    rc = client.loop();
+
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_TRUE(lastLength == 7);
+    IS_FALSE(shimClient.error());
+
+    // A redelivery before PUBREL is acknowledged but not passed on
+    reset_callback();
+    byte dup[] = {0x3C,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(dup,18);
+    shimClient.expect(pubrec,4);
+
+    rc = client.loop();
+
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_FALSE(shimClient.error());
+
+    byte pubrel[] = {0x62,0x2,0x12,0x34};
+    shimClient.respond(pubrel,4);
+    byte pubcomp[] = {0x70,0x2,0x12,0x34};
+    shimClient.expect(pubcomp,4);
+
+    rc = client.loop();
+
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_FALSE(shimClient.error());
+
+    // Once released, the packet id may carry a new message
+    shimClient.respond(publish,18);
+    shimClient.expect(pubrec,4);
+
+    rc = client.loop();
+
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_drains_available() {
+    IT("receives every available message in one loop");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (int i = 0; i < 3; i++) {
+        shimClient.respond(publish,16);
+    }
+
+    rc = client.loop();
+
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,3);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_loop_budget() {
+    IT("stops receiving when the packet budget is spent");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (int i = 0; i < 3; i++) {
+        shimClient.respond(publish,16);
+    }
+
+    rc = client.loop(2,0);
+    IS_EQUAL(rc,2);
+    IS_EQUAL(callback_count,2);
+
+    rc = client.loop(2,0);
+    IS_EQUAL(rc,1);
+    IS_EQUAL(callback_count,3);
+
+    rc = client.loop(2,0);
+    IS_EQUAL(rc,0);
+
+    client.setLoopBudget(1,0);
+    shimClient.respond(publish,16);
+    shimClient.respond(publish,16);
+    IS_TRUE(client.loop());
+    IS_EQUAL(callback_count,4);
+
+    client.disconnect();
+    rc = client.loop(2,0);
+    IS_EQUAL(rc,-1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_generated_stream() {
+    IT("receives a generated stream far longer than the shim's first buffer");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    int generated = 0;
+    shimClient.respond([&](Buffer& buffer) {
+        buffer.add(publish,16);
+        return ++generated < 10000;
+    });
+
+    while (client.loop() && callback_count < 10000);
+    IS_EQUAL(callback_count,10000);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_FALSE(shimClient.available());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Receive");
     test_receive_callback();
+    test_receive_handler();
+    test_receive_partial_with_decoder();
     test_receive_stream();
     test_receive_max_sized_message();
     test_receive_oversized_message();
+    test_receive_chunked_message();
+    test_receive_chunked_qos1();
+    test_receive_chunked_then_callback();
+    test_receive_malformed_length();
+    test_receive_topic_overrun();
     test_receive_oversized_stream_message();
     test_receive_qos1();
+    test_receive_qos2();
+    test_receive_drains_available();
+    test_receive_loop_budget();
+    test_receive_generated_stream();
 
     FINISH
 }
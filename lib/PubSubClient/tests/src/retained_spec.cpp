@@ -0,0 +1,230 @@
+#include "PubSubClient.h"
+#include "MQTTRetainedCache.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+int callback_count = 0;
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_count++;
+}
+
+int test_cache_update() {
+    IT("stores a retained message and reports when it is unchanged");
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+    IS_EQUAL(cache.depth(),1);
+    IS_EQUAL(cache.size(),12);
+    IS_FALSE(cache.update("topic",5,(const uint8_t*)"payload",7));
+    IS_EQUAL(cache.unchanged(),1);
+
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"PAYLOAD",7));
+    IS_EQUAL(cache.depth(),1);
+    unsigned int length = 0;
+    const uint8_t* payload = cache.get("topic",&length);
+    IS_TRUE(payload != NULL);
+    IS_EQUAL(length,7);
+    IS_TRUE(memcmp(payload,"PAYLOAD",7)==0);
+    IS_TRUE(cache.get("other",&length) == NULL);
+
+    END_IT
+}
+
+int test_cache_empty_payload() {
+    IT("removes a topic when its retained message is cleared");
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"",0));
+    IS_EQUAL(cache.depth(),0);
+    IS_EQUAL(cache.size(),0);
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+
+    END_IT
+}
+
+int test_cache_forget() {
+    IT("forgets a topic");
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+    IS_TRUE(cache.update("other",5,(const uint8_t*)"payload",7));
+    cache.forget("topic",5);
+    cache.forget("unknown",7);
+    IS_EQUAL(cache.depth(),1);
+    unsigned int length;
+    IS_TRUE(cache.get("topic",&length) == NULL);
+    IS_TRUE(cache.get("other",&length) != NULL);
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+
+    END_IT
+}
+
+int test_cache_drops_oldest() {
+    IT("drops the oldest topics when full and reuses the space they leave");
+    uint8_t storage[30];
+    MQTTRetainedCache cache(storage,30);
+
+    // Each message takes 12 bytes
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"payload",7));
+    IS_TRUE(cache.update("other",5,(const uint8_t*)"payload",7));
+    IS_TRUE(cache.update("third",5,(const uint8_t*)"payload",7));
+    IS_EQUAL(cache.depth(),2);
+    unsigned int length;
+    IS_TRUE(cache.get("topic",&length) == NULL);
+    IS_TRUE(cache.get("other",&length) != NULL);
+
+    // Replacing the older one moves the newer one down
+    IS_TRUE(cache.update("other",5,(const uint8_t*)"PAYLOAD",7));
+    IS_EQUAL(cache.depth(),2);
+    IS_EQUAL(cache.size(),24);
+    IS_TRUE(memcmp(cache.get("third",&length),"payload",7)==0);
+    IS_TRUE(memcmp(cache.get("other",&length),"PAYLOAD",7)==0);
+
+    // Too big to keep at all
+    IS_TRUE(cache.update("topic",5,(const uint8_t*)"a payload longer than the storage",33));
+    IS_EQUAL(cache.depth(),2);
+    IS_TRUE(cache.get("topic",&length) == NULL);
+
+    END_IT
+}
+
+int test_cache_suppresses_unchanged() {
+    IT("does not pass on an unchanged retained message");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setRetainedCache(cache);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte retained[] = {0x31,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(retained,16);
+    shimClient.respond(retained,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,1);
+
+    // The same payload sent live, not retained, is always passed on
+    byte live[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(live,16);
+    // A changed retained payload is passed on
+    retained[15] = 'D';
+    shimClient.respond(retained,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,3);
+    IS_EQUAL(cache.unchanged(),1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_cache_live_supersedes() {
+    IT("passes on a retained message again after a live one on its topic");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setRetainedCache(cache);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Retained A, then live B, then retained A after a new subscription
+    byte retained[] = {0x31,0x8,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,'A'};
+    byte live[] = {0x30,0x8,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,'B'};
+    shimClient.respond(retained,10);
+    shimClient.respond(live,10);
+    shimClient.respond(retained,10);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,3);
+    IS_EQUAL(cache.unchanged(),0);
+
+    // Kept again, so a repeat is still suppressed
+    shimClient.respond(retained,10);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,3);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_cache_acknowledges_unchanged() {
+    IT("acknowledges an unchanged retained qos 1 message");
+    callback_count = 0;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t storage[64];
+    MQTTRetainedCache cache(storage,64);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setRetainedCache(cache);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte retained[] = {0x33,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.respond(retained,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    // Sent again after a new subscription, with a new message id
+    retained[10] = 0x35;
+    puback[3] = 0x35;
+    shimClient.respond(retained,18);
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(callback_count,1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Retained");
+    test_cache_update();
+    test_cache_empty_payload();
+    test_cache_forget();
+    test_cache_drops_oldest();
+    test_cache_suppresses_unchanged();
+    test_cache_live_supersedes();
+    test_cache_acknowledges_unchanged();
+
+    FINISH
+}
@@ -0,0 +1,118 @@
+#include "MQTTTopicRouter.h"
+#include "trace.h"
+#include <chrono>
+#include <stdio.h>
+
+// Compares MQTTTopicRouter dispatch with what applications do in their
+// callback, for 50 subscriptions: a strcmp chain for exact topics, and a
+// loop matching each wildcard filter in turn for filters using + and #.
+
+#define SUBSCRIPTIONS 50
+#define ITERATIONS 200000
+
+char filters[SUBSCRIPTIONS][32];
+char topicNames[SUBSCRIPTIONS][32];
+volatile unsigned long hits = 0;
+
+void handler(const MQTTTopic& topic, uint8_t* payload, unsigned int length, void* context) {
+    hits += (unsigned long)context;
+}
+
+int strcmpChain(const char* topic) {
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        if (strcmp(topic,filters[i]) == 0) {
+            return i+1;
+        }
+    }
+    return 0;
+}
+
+bool matches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+        } else if (*filter == *topic) {
+            filter++;
+            topic++;
+        } else {
+            // a/# also matches a
+            return *topic == 0 && strcmp(filter,"/#") == 0;
+        }
+    }
+    return *topic == 0;
+}
+
+int matchLoop(const char* topic) {
+    int matched = 0;
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        if (matches(filters[i],topic)) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+double elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Times the router and the loop an application would write on the topics in
+// topicNames. Returns false if they disagree on the number of matches.
+bool run(const char* name, int (*chain)(const char*)) {
+    MQTTTopicRouter router;
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        router.on(filters[i],handler,(void*)1);
+    }
+
+    MQTTTopic topics[SUBSCRIPTIONS];
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        topics[i].name = topicNames[i];
+        topics[i].length = strlen(topicNames[i]);
+    }
+
+    hits = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < ITERATIONS; n++) {
+        router.dispatch(topics[n%SUBSCRIPTIONS],NULL,0);
+    }
+    double trie = elapsedNs(start)/ITERATIONS;
+    unsigned long routed = hits;
+
+    unsigned long looped = 0;
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < ITERATIONS; n++) {
+        int matched = chain(topics[n%SUBSCRIPTIONS].name);
+        looped += (chain == strcmpChain)?(matched > 0):matched;
+    }
+    double loop = elapsedNs(start)/ITERATIONS;
+
+    LOG("Router dispatch, " << SUBSCRIPTIONS << " " << name << " subscriptions\n");
+    LOG(" - topic trie:   " << trie << " ns/message\n");
+    LOG(" - callback:     " << loop << " ns/message\n\n");
+    return routed == looped && routed > 0;
+}
+
+int main()
+{
+    const char* fields[] = { "speed", "steer", "battery", "motor/left", "motor/right" };
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        sprintf(filters[i],"hoalong/car%d/%s",i/5,fields[i%5]);
+        strcpy(topicNames[i],filters[i]);
+    }
+    bool ok = run("exact",strcmpChain);
+
+    // Topics that match one, two and three of these filters
+    const char* wildcards[] = { "speed", "steer", "+/left", "motor/+", "#" };
+    for (int i = 0; i < SUBSCRIPTIONS; i++) {
+        sprintf(filters[i],"hoalong/car%d/%s",i/5,wildcards[i%5]);
+    }
+    ok = run("wildcard",matchLoop) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+#include "PubSubClient.h"
+#include "MQTTTopicRouter.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+int handler_calls = 0;
+char lastTopic[1024];
+void* lastContext;
+
+void reset_callback() {
+    callback_called = false;
+    handler_calls = 0;
+    lastTopic[0] = '\0';
+    lastContext = NULL;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+}
+
+void handler(const MQTTTopic& topic, uint8_t* payload, unsigned int length, void* context) {
+    handler_calls++;
+    strcpy(lastTopic,topic.name);
+    lastContext = context;
+}
+
+int dispatch(MQTTTopicRouter& router, const char* name) {
+    MQTTTopic topic;
+    topic.name = name;
+    topic.length = strlen(name);
+    return router.dispatch(topic,NULL,0);
+}
+
+int test_router_exact() {
+    IT("routes an exact topic to its handler");
+    reset_callback();
+    MQTTTopicRouter router;
+    int ctx;
+
+    IS_TRUE(router.on("car/speed",handler,&ctx));
+
+    IS_EQUAL(dispatch(router,"car/speed"),1);
+    IS_TRUE(strcmp(lastTopic,"car/speed")==0);
+    IS_TRUE(lastContext == &ctx);
+
+    IS_EQUAL(dispatch(router,"car/speed/x"),0);
+    IS_EQUAL(dispatch(router,"car"),0);
+    IS_EQUAL(dispatch(router,"car/steer"),0);
+
+    END_IT
+}
+
+int test_router_single_level_wildcard() {
+    IT("matches the + wildcard against one level");
+    reset_callback();
+    MQTTTopicRouter router;
+
+    IS_TRUE(router.on("car/+/speed",handler));
+
+    IS_EQUAL(dispatch(router,"car/1/speed"),1);
+    IS_EQUAL(dispatch(router,"car//speed"),1);
+    IS_EQUAL(dispatch(router,"car/1/2/speed"),0);
+    IS_EQUAL(dispatch(router,"car/1"),0);
+
+    END_IT
+}
+
+int test_router_multi_level_wildcard() {
+    IT("matches the # wildcard against the remaining levels");
+    reset_callback();
+    MQTTTopicRouter router;
+
+    IS_TRUE(router.on("car/#",handler));
+
+    IS_EQUAL(dispatch(router,"car"),1);
+    IS_EQUAL(dispatch(router,"car/1"),1);
+    IS_EQUAL(dispatch(router,"car/1/speed"),1);
+    IS_EQUAL(dispatch(router,"cars/1"),0);
+
+    END_IT
+}
+
+int test_router_overlapping() {
+    IT("calls every matching handler");
+    reset_callback();
+    MQTTTopicRouter router;
+
+    IS_TRUE(router.on("car/1/speed",handler));
+    IS_TRUE(router.on("car/+/speed",handler));
+    IS_TRUE(router.on("car/#",handler));
+    IS_TRUE(router.on("#",handler));
+
+    IS_EQUAL(dispatch(router,"car/1/speed"),4);
+    IS_EQUAL(dispatch(router,"car/2/speed"),3);
+    IS_EQUAL(dispatch(router,"boat"),1);
+
+    END_IT
+}
+
+int test_router_system_topics() {
+    IT("does not match wildcards at the first level against $ topics");
+    reset_callback();
+    MQTTTopicRouter router;
+
+    IS_TRUE(router.on("#",handler));
+    IS_TRUE(router.on("+/broker",handler));
+    IS_EQUAL(dispatch(router,"$SYS/broker"),0);
+
+    IS_TRUE(router.on("$SYS/#",handler));
+    IS_EQUAL(dispatch(router,"$SYS/broker"),1);
+
+    END_IT
+}
+
+int test_router_invalid_filters() {
+    IT("rejects invalid filters");
+    reset_callback();
+    MQTTTopicRouter router;
+
+    IS_FALSE(router.on("car/#/speed",handler));
+    IS_FALSE(router.on("car/a+",handler));
+    IS_FALSE(router.on("car/#a",handler));
+
+    END_IT
+}
+
+int test_router_replaces_handler() {
+    IT("replaces the handler of an existing filter");
+    reset_callback();
+    MQTTTopicRouter router;
+    int ctx1, ctx2;
+
+    IS_TRUE(router.on("car/speed",handler,&ctx1));
+    IS_TRUE(router.on("car/speed",handler,&ctx2));
+
+    IS_EQUAL(dispatch(router,"car/speed"),1);
+    IS_TRUE(lastContext == &ctx2);
+
+    END_IT
+}
+
+int test_router_full() {
+    IT("fails when out of handler slots");
+    reset_callback();
+    MQTTTopicRouter router;
+    char filters[MQTT_ROUTER_MAX_HANDLERS+1][8];
+
+    for (int i = 0; i < MQTT_ROUTER_MAX_HANDLERS; i++) {
+        sprintf(filters[i],"t/%d",i);
+        IS_TRUE(router.on(filters[i],handler));
+    }
+    sprintf(filters[MQTT_ROUTER_MAX_HANDLERS],"t/x");
+    IS_FALSE(router.on(filters[MQTT_ROUTER_MAX_HANDLERS],handler));
+
+    router.clear();
+    IS_TRUE(router.on(filters[MQTT_ROUTER_MAX_HANDLERS],handler));
+
+    END_IT
+}
+
+int test_router_client() {
+    IT("dispatches received messages through the client's router");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    MQTTTopicRouter router;
+    router.on("topic",handler);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setRouter(router);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(handler_calls,1);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_FALSE(callback_called);
+
+    // Unmatched topics fall back to the callback
+    byte other[] = {0x30,0xe,0x0,0x5,0x6f,0x74,0x68,0x65,0x72,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(other,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(handler_calls,1);
+    IS_TRUE(callback_called);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Router");
+    test_router_exact();
+    test_router_single_level_wildcard();
+    test_router_multi_level_wildcard();
+    test_router_overlapping();
+    test_router_system_topics();
+    test_router_invalid_filters();
+    test_router_replaces_handler();
+    test_router_full();
+    test_router_client();
+
+    FINISH
+}
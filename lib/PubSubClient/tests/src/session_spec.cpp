@@ -0,0 +1,256 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+byte connectNoClean[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x0,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+
+int test_session_connect_flags() {
+    IT("leaves the clean session flag off when asked");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.expect(connectNoClean,26);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_FALSE(client.sessionPresent());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_session_present() {
+    IT("reports whether the server resumed the session");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.sessionPresent());
+
+    END_IT
+}
+
+int test_session_keeps_message_ids() {
+    IT("keeps message ids across reconnects");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish1[] = {0x32,0xa,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x61};
+    shimClient.expect(publish1,12);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+    IS_FALSE(client.connected());
+
+    shimClient.respond(connack,4);
+    shimClient.expect(connectNoClean,26);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish2[] = {0x32,0xa,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x3,0x61};
+    shimClient.expect(publish2,12);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_session_resends_pubrel() {
+    IT("resends PUBREL for a qos 2 message when the session is resumed");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+    IS_TRUE(rc);
+    byte pubrec[] = {0x50,0x2,0x0,0x2};
+    shimClient.respond(pubrec,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    // The connection drops before PUBCOMP arrives
+    shimClient.setConnected(false);
+
+    shimClient.respond(connack,4);
+    shimClient.expect(connectNoClean,26);
+    byte pubrel[] = {0x62,0x2,0x0,0x2};
+    shimClient.expect(pubrel,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    byte pubcomp[] = {0x70,0x2,0x0,0x2};
+    shimClient.respond(pubcomp,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    // All in-flight slots are free again
+    for (int i = 0; i < MQTT_MAX_INFLIGHT_OUT; i++) {
+        rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+        IS_TRUE(rc);
+    }
+
+    END_IT
+}
+
+int test_session_not_present() {
+    IT("drops in-flight messages when the server has no session");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+    IS_TRUE(rc);
+    byte pubrec[] = {0x50,0x2,0x0,0x2};
+    shimClient.respond(pubrec,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+
+    byte noSession[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(noSession,4);
+    shimClient.expect(connectNoClean,26);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_FALSE(client.sessionPresent());
+    // Nothing but the CONNECT was written
+    IS_FALSE(shimClient.error());
+
+    for (int i = 0; i < MQTT_MAX_INFLIGHT_OUT; i++) {
+        rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+        IS_TRUE(rc);
+    }
+
+    END_IT
+}
+
+int test_session_clean_resets() {
+    IT("starts message ids again with a clean session");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0xa,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x61};
+    shimClient.expect(publish,12);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_session_save_restore() {
+    IT("restores a saved session into another client");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x01, 0x00 };
+    shimClient.respond(connack,4);
+
+    MQTTSessionState session;
+    {
+        PubSubClient client(server, 1883, callback, shimClient);
+        client.setCleanSession(false);
+        int rc = client.connect((char*)"client_test1");
+        IS_TRUE(rc);
+        rc = client.publish((char*)"topic",(const uint8_t*)"a",1,2,false);
+        IS_TRUE(rc);
+        byte pubrec[] = {0x50,0x2,0x0,0x2};
+        shimClient.respond(pubrec,4);
+        rc = client.loop();
+        IS_TRUE(rc);
+        client.saveSession(session);
+    }
+    shimClient.setConnected(false);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setCleanSession(false);
+    client.restoreSession(session);
+
+    shimClient.respond(connack,4);
+    shimClient.expect(connectNoClean,26);
+    byte pubrel[] = {0x62,0x2,0x0,0x2};
+    shimClient.expect(pubrel,4);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0xa,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x3,0x61};
+    shimClient.expect(publish,12);
+    rc = client.publish((char*)"topic",(const uint8_t*)"a",1,1,false);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Session");
+    test_session_connect_flags();
+    test_session_present();
+    test_session_keeps_message_ids();
+    test_session_resends_pubrel();
+    test_session_not_present();
+    test_session_clean_resets();
+    test_session_save_restore();
+
+    FINISH
+}
@@ -61,6 +61,156 @@ int test_subscribe_qos_1() {
     END_IT
 }
 
+int test_subscribe_qos_2() {
+    IT("subscribes qos 2");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte subscribe[] = { 0x82,0xa,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x2 };
+    shimClient.expect(subscribe,12);
+    byte suback[] = { 0x90,0x3,0x0,0x2,0x2 };
+    shimClient.respond(suback,5);
+
+    rc = client.subscribe((char*)"topic",2);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_batch() {
+    IT("subscribes to several topics in one packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTSubscription subs[] = {
+        { "a/1", 0 },
+        { "b/2", 1 },
+        { "c/3", 2 }
+    };
+
+    byte subscribe[] = { 0x82,0x14,0x0,0x2,0x0,0x3,'a','/','1',0x0,0x0,0x3,'b','/','2',0x1,0x0,0x3,'c','/','3',0x2 };
+    shimClient.expect(subscribe,22);
+
+    rc = client.subscribe(subs,3);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+    IS_EQUAL(subs[0].result, MQTT_SUBACK_PENDING);
+    IS_EQUAL(subs[2].result, MQTT_SUBACK_PENDING);
+
+    byte suback[] = { 0x90,0x5,0x0,0x2,0x0,0x1,0x80 };
+    shimClient.respond(suback,7);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(subs[0].result, 0);
+    IS_EQUAL(subs[1].result, 1);
+    IS_EQUAL(subs[2].result, MQTT_SUBACK_FAILURE);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_batch_split() {
+    IT("splits a batch subscribe across packets");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint16_t sent = shimClient.received();
+
+    MQTTSubscription subs[] = {
+        { "12345678901234567890123456789012345678901234567890", 0 },
+        { "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghij", 1 },
+        { "ABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJ", 1 }
+    };
+
+    rc = client.subscribe(subs,3);
+    IS_TRUE(rc);
+    // Two topics fill the first packet, the third goes in a second one
+    IS_EQUAL(shimClient.received()-sent, 110+57);
+
+    byte suback1[] = { 0x90,0x4,0x0,0x2,0x0,0x1 };
+    byte suback2[] = { 0x90,0x3,0x0,0x3,0x1 };
+    shimClient.respond(suback2,5);
+    shimClient.respond(suback1,6);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(subs[0].result, 0);
+    IS_EQUAL(subs[1].result, 1);
+    IS_EQUAL(subs[2].result, 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_batch_not_connected() {
+    IT("batch subscribe fails when not connected");
+    ShimClient shimClient;
+
+    PubSubClient client(server, 1883, callback, shimClient);
+
+    MQTTSubscription subs[] = { { "topic", 0 } };
+    int rc = client.subscribe(subs,1);
+    IS_FALSE(rc);
+    IS_EQUAL(subs[0].result, MQTT_SUBACK_NOT_SENT);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_batch_invalid_qos() {
+    IT("batch subscribe sends nothing when a qos is invalid");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint16_t sent = shimClient.received();
+
+    MQTTSubscription subs[] = {
+        { "a/1", 1 },
+        { "b/2", 3 }
+    };
+    rc = client.subscribe(subs,2);
+    IS_FALSE(rc);
+    IS_EQUAL(shimClient.received(),sent);
+    IS_EQUAL(subs[0].result, MQTT_SUBACK_NOT_SENT);
+    IS_EQUAL(subs[1].result, MQTT_SUBACK_FAILURE);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int test_subscribe_not_connected() {
     IT("subscribe fails when not connected");
     ShimClient shimClient;
@@ -87,7 +237,7 @@ int test_subscribe_invalid_qos() {
     int rc = client.connect((char*)"client_test1");
     IS_TRUE(rc);
 
-    rc = client.subscribe((char*)"topic",2);
+    rc = client.subscribe((char*)"topic",3);
     IS_FALSE(rc);
     rc = client.subscribe((char*)"topic",254);
     IS_FALSE(rc);
@@ -149,6 +299,43 @@ int test_unsubscribe() {
     END_IT
 }
 
+int test_unsubscribe_batch() {
+    IT("unsubscribes from several topics in one packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTSubscription subs[] = {
+        { "a/1", 0 },
+        { "b/2", 0 }
+    };
+
+    byte unsubscribe[] = { 0xA2,0xc,0x0,0x2,0x0,0x3,'a','/','1',0x0,0x3,'b','/','2' };
+    shimClient.expect(unsubscribe,14);
+
+    rc = client.unsubscribe(subs,2);
+    IS_TRUE(rc);
+    IS_EQUAL(subs[1].result, MQTT_SUBACK_PENDING);
+
+    byte unsuback[] = { 0xB0,0x2,0x0,0x2 };
+    shimClient.respond(unsuback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(subs[0].result, 0);
+    IS_EQUAL(subs[1].result, 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int test_unsubscribe_not_connected() {
     IT("unsubscribe fails when not connected");
     ShimClient shimClient;
@@ -168,10 +355,16 @@ int main()
     SUITE("Subscribe");
     test_subscribe_no_qos();
     test_subscribe_qos_1();
+    test_subscribe_qos_2();
+    test_subscribe_batch();
+    test_subscribe_batch_split();
+    test_subscribe_batch_not_connected();
+    test_subscribe_batch_invalid_qos();
     test_subscribe_not_connected();
     test_subscribe_invalid_qos();
     test_subscribe_too_long();
     test_unsubscribe();
+    test_unsubscribe_batch();
     test_unsubscribe_not_connected();
     FINISH
 }
@@ -0,0 +1,136 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "trace.h"
+#include <chrono>
+
+// Raw client throughput against the shim, with no broker in the way:
+// receiving a generated stream of PUBLISH packets, and publishing. Each is
+// run with and without a write buffer, and reports the packets sent per
+// write call to the network client.
+
+#define MESSAGES 1000000
+// Packets added to the shim each time the client has read all there is
+#define BATCH 64
+// Publishes made between calls to loop()
+#define PUBLISHES_PER_LOOP 10
+// One TCP segment
+#define WRITE_BUFFER_SIZE 1460
+
+byte server[] = { 172, 16, 0, 2 };
+unsigned long received = 0;
+uint8_t writeBuffer[WRITE_BUFFER_SIZE];
+
+struct Result {
+    double rate;
+    double packetsPerWrite;
+};
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    received++;
+}
+
+double elapsedSeconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+Result receive(uint8_t qos, boolean batched) {
+    ShimClient shimClient;
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    PubSubClient client(server, 1883, callback, shimClient);
+    if (batched) {
+        client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    }
+    client.connect("bench");
+    size_t writes = shimClient.writes();
+    received = 0;
+
+    // "hoalong/car1/speed" {"speed":42,"steer":-3}
+    byte publish[] = {0x30,0x2d,0x0,0x12,
+        'h','o','a','l','o','n','g','/','c','a','r','1','/','s','p','e','e','d',
+        0x0,0x0,
+        '{','"','s','p','e','e','d','"',':','4','2',',','"','s','t','e','e','r','"',':','-','3','}'};
+    size_t length = sizeof(publish);
+    if (qos == 0) {
+        // No message id
+        memmove(publish+22,publish+24,length-24);
+        length -= 2;
+        publish[1] -= 2;
+    } else {
+        publish[0] |= qos << 1;
+    }
+    unsigned long generated = 0;
+    shimClient.respond([&](Buffer& buffer) {
+        for (int i = 0; i < BATCH && generated < MESSAGES; i++) {
+            generated++;
+            if (qos > 0) {
+                publish[22] = (generated >> 8) & 0xFF;
+                publish[23] = generated & 0xFF;
+            }
+            buffer.add(publish,length);
+        }
+        return generated < MESSAGES;
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (received < MESSAGES && client.loop());
+    double seconds = elapsedSeconds(start);
+    Result result;
+    result.rate = received == MESSAGES ? MESSAGES/seconds : 0;
+    // Only QoS 1 messages are answered
+    writes = shimClient.writes()-writes;
+    result.packetsPerWrite = writes ? (double)MESSAGES/writes : 0;
+    return result;
+}
+
+Result publish(uint8_t qos, boolean batched) {
+    ShimClient shimClient;
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    PubSubClient client(server, 1883, callback, shimClient);
+    if (batched) {
+        client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    }
+    client.connect("bench");
+    size_t writes = shimClient.writes();
+
+    const char* payload = "{\"speed\":42,\"steer\":-3}";
+    unsigned int plength = strlen(payload);
+    unsigned long sent = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < MESSAGES; n++) {
+        sent += client.publish("hoalong/car1/speed",(const uint8_t*)payload,plength,qos,false);
+        if (n % PUBLISHES_PER_LOOP == PUBLISHES_PER_LOOP-1) {
+            client.loop();
+        }
+    }
+    client.flush();
+    double seconds = elapsedSeconds(start);
+    Result result;
+    result.rate = sent == MESSAGES ? MESSAGES/seconds : 0;
+    writes = shimClient.writes()-writes;
+    result.packetsPerWrite = writes ? (double)MESSAGES/writes : 0;
+    return result;
+}
+
+void report(const char* name, Result result) {
+    LOG(" - " << name << ": " << (unsigned long)result.rate << " msgs/sec, " << result.packetsPerWrite << " packets/write\n");
+}
+
+int main()
+{
+    Result receive0 = receive(0,false);
+    Result receive1 = receive(1,false);
+    Result receive1Batched = receive(1,true);
+    Result publish0 = publish(0,false);
+    Result publish0Batched = publish(0,true);
+    LOG("Shim throughput, " << MESSAGES << " messages\n");
+    LOG(" - receive qos 0: " << (unsigned long)receive0.rate << " msgs/sec\n");
+    report("receive qos 1",receive1);
+    report("receive qos 1, write buffer",receive1Batched);
+    report("publish qos 0",publish0);
+    report("publish qos 0, write buffer",publish0Batched);
+    LOG("\n");
+    return (receive0.rate > 0 && receive1.rate > 0 && receive1Batched.rate > 0 &&
+            publish0.rate > 0 && publish0Batched.rate > 0) ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include "MQTTVarint.h"
+#include "trace.h"
+#include <chrono>
+
+// Times remaining length encoding and decoding against the divide and
+// modulo loop the client used before.
+
+#define ITERATIONS 1000000
+
+volatile uint32_t sink = 0;
+
+uint8_t encodeModulo(uint32_t len, uint8_t* buf) {
+    uint8_t pos = 0;
+    do {
+        uint8_t digit = len % 128;
+        len = len / 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (len > 0);
+    return pos;
+}
+
+double elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main()
+{
+    const uint32_t values[] = { 100, 10000, 1000000, 100000000 };
+    uint8_t buf[MQTT_VARINT_MAX_BYTES];
+
+    LOG("Remaining length codec\n");
+    for (int v = 0; v < 4; v++) {
+        uint32_t value = values[v];
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int n = 0; n < ITERATIONS; n++) {
+            sink += MQTTVarint::encode(value+(n&1),buf);
+        }
+        double encode = elapsedNs(start)/ITERATIONS;
+
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < ITERATIONS; n++) {
+            sink += encodeModulo(value+(n&1),buf);
+        }
+        double modulo = elapsedNs(start)/ITERATIONS;
+
+        uint8_t len = MQTTVarint::encode(value,buf);
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < ITERATIONS; n++) {
+            uint32_t decoded;
+            buf[0] ^= (n&1);
+            MQTTVarint::decode(buf,len,&decoded);
+            sink += decoded;
+        }
+        double decode = elapsedNs(start)/ITERATIONS;
+
+        LOG(" - " << (int)len << " byte length: encode " << encode << " ns, modulo loop " << modulo << " ns, decode " << decode << " ns\n");
+    }
+    LOG("\n");
+    return 0;
+}
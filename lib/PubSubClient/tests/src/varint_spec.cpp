@@ -0,0 +1,113 @@
+#include "MQTTVarint.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+int test_varint_encode() {
+    IT("encodes lengths at each size boundary");
+    uint8_t buf[MQTT_VARINT_MAX_BYTES];
+
+    IS_EQUAL(MQTTVarint::encode(0,buf),1);
+    IS_EQUAL(buf[0],0x00);
+    IS_EQUAL(MQTTVarint::encode(127,buf),1);
+    IS_EQUAL(buf[0],0x7F);
+
+    uint8_t two[] = {0x80,0x01};
+    IS_EQUAL(MQTTVarint::encode(128,buf),2);
+    IS_TRUE(memcmp(buf,two,2)==0);
+    uint8_t twoMax[] = {0xFF,0x7F};
+    IS_EQUAL(MQTTVarint::encode(16383,buf),2);
+    IS_TRUE(memcmp(buf,twoMax,2)==0);
+
+    uint8_t three[] = {0x80,0x80,0x01};
+    IS_EQUAL(MQTTVarint::encode(16384,buf),3);
+    IS_TRUE(memcmp(buf,three,3)==0);
+
+    uint8_t four[] = {0x80,0x80,0x80,0x01};
+    IS_EQUAL(MQTTVarint::encode(2097152,buf),4);
+    IS_TRUE(memcmp(buf,four,4)==0);
+    uint8_t fourMax[] = {0xFF,0xFF,0xFF,0x7F};
+    IS_EQUAL(MQTTVarint::encode(MQTT_VARINT_MAX,buf),4);
+    IS_TRUE(memcmp(buf,fourMax,4)==0);
+
+    IS_EQUAL(MQTTVarint::length(127),1);
+    IS_EQUAL(MQTTVarint::length(16383),2);
+    IS_EQUAL(MQTTVarint::length(2097151),3);
+    IS_EQUAL(MQTTVarint::length(2097152),4);
+
+    END_IT
+}
+
+int test_varint_too_large() {
+    IT("refuses lengths over 256 MiB");
+    uint8_t buf[MQTT_VARINT_MAX_BYTES];
+
+    IS_EQUAL(MQTTVarint::encode(MQTT_VARINT_MAX+1,buf),0);
+    IS_EQUAL(MQTTVarint::length(MQTT_VARINT_MAX+1),0);
+    IS_EQUAL(MQTTVarint::length(0xFFFFFFFF),0);
+
+    END_IT
+}
+
+int test_varint_push() {
+    IT("decodes one byte at a time");
+    MQTTVarint varint;
+
+    IS_EQUAL(varint.push(0xF7),MQTT_VARINT_MORE);
+    IS_EQUAL(varint.push(0xA2),MQTT_VARINT_MORE);
+    IS_EQUAL(varint.push(0x04),3);
+    IS_EQUAL(varint.value(),70007);
+
+    varint.reset();
+    IS_EQUAL(varint.push(0x05),1);
+    IS_EQUAL(varint.value(),5);
+
+    END_IT
+}
+
+int test_varint_malformed() {
+    IT("rejects a field longer than four bytes");
+    MQTTVarint varint;
+
+    IS_EQUAL(varint.push(0xFF),MQTT_VARINT_MORE);
+    IS_EQUAL(varint.push(0xFF),MQTT_VARINT_MORE);
+    IS_EQUAL(varint.push(0xFF),MQTT_VARINT_MORE);
+    IS_EQUAL(varint.push(0xFF),MQTT_VARINT_MALFORMED);
+
+    uint8_t buf[] = {0x80,0x80,0x80,0x80,0x01};
+    uint32_t value = 0;
+    IS_EQUAL(MQTTVarint::decode(buf,5,&value),MQTT_VARINT_MALFORMED);
+
+    END_IT
+}
+
+int test_varint_decode() {
+    IT("decodes what it encodes");
+    uint8_t buf[MQTT_VARINT_MAX_BYTES];
+    uint32_t value;
+
+    IS_EQUAL(MQTTVarint::decode(buf,0,&value),MQTT_VARINT_MORE);
+    buf[0] = 0x80;
+    IS_EQUAL(MQTTVarint::decode(buf,1,&value),MQTT_VARINT_MORE);
+
+    for (uint32_t v = 1; v <= MQTT_VARINT_MAX; v = v*3+1) {
+        uint8_t len = MQTTVarint::encode(v,buf);
+        value = 0;
+        IS_EQUAL(MQTTVarint::decode(buf,len,&value),len);
+        IS_EQUAL(value,v);
+    }
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Varint");
+    test_varint_encode();
+    test_varint_too_large();
+    test_varint_push();
+    test_varint_malformed();
+    test_varint_decode();
+
+    FINISH
+}
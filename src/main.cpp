@@ -98,18 +98,22 @@ void configWiFi() {
 // pubsub mqtt
 WiFiClient espClient;
 PubSubClient pubsubClient(espClient);
+uint8_t pubsubWriteBuffer[MQTT_MAX_PACKET_SIZE];
 
 boolean retryPublishIp() {
-  if (pubsubClient.connect(MQTT_CLIENT_ID)) {
-      char localIp[20];
-      WiFi.localIP().toString().toCharArray(localIp, 20);
+  char localIp[20];
+  WiFi.localIP().toString().toCharArray(localIp, 20);
+  // The IP goes out in the same write as the CONNECT, without waiting for
+  // the CONNACK
+  if (pubsubClient.beginConnect(MQTT_CLIENT_ID)) {
       pubsubClient.publish(MQTT_PUBLISH_CHANNEL, localIp);
   }
-  return pubsubClient.connected();
+  return pubsubClient.endConnect();
 }
 
 void configPubSub() {
   pubsubClient.setServer(MQTT_SERVER, MQTT_PORT);
+  pubsubClient.setWriteBuffer(pubsubWriteBuffer, sizeof(pubsubWriteBuffer));
 
   Serial.print("Attempting MQTT connection...");
   if (retryPublishIp()) {